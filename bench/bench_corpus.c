@@ -0,0 +1,313 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench_corpus.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+const char* const BENCH_CORPUS_NAMES[BENCH_CORPUS_COUNT] = {
+	"twitter",
+	"citm",
+	"canada",
+	"nested"
+};
+
+/* Number of JSON Pointers generated for each corpus */
+static const size_t BENCH_POINTERS = 256;
+
+/* Depth of the containers of the nested corpus, below the default nesting limit */
+static const size_t BENCH_NESTED_DEPTH = 100;
+
+typedef struct bench_buffer {
+	char* data;
+	size_t size;
+	size_t capacity;
+	int failed;
+} bench_buffer;
+
+static void bench_buffer_reserve(bench_buffer* buff, size_t addSize) {
+	if (buff->size + addSize + 1 <= buff->capacity) {
+		return;
+	}
+	size_t capacity = (buff->capacity) ? buff->capacity * 2 : 4096;
+	while (capacity < buff->size + addSize + 1) {
+		capacity *= 2;
+	}
+	char* data = realloc(buff->data, capacity);
+	if (!data) {
+		buff->failed = 1;
+		return;
+	}
+	buff->data = data;
+	buff->capacity = capacity;
+}
+
+static void bench_buffer_printf(bench_buffer* buff, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if (len < 0 || buff->failed) {
+		buff->failed = 1;
+		return;
+	}
+
+	bench_buffer_reserve(buff, (size_t) len);
+	if (buff->failed) {
+		return;
+	}
+	va_start(args, fmt);
+	vsnprintf(buff->data + buff->size, (size_t) len + 1, fmt, args);
+	va_end(args);
+	buff->size += (size_t) len;
+}
+
+/* Append a pointer and its null terminator */
+static void bench_buffer_pointer(bench_buffer* buff, size_t* numPointers, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	char pointer[256];
+	int len = vsnprintf(pointer, sizeof(pointer), fmt, args);
+	va_end(args);
+	if (len < 0 || (size_t) len >= sizeof(pointer)) {
+		buff->failed = 1;
+		return;
+	}
+
+	bench_buffer_reserve(buff, (size_t) len + 1);
+	if (buff->failed) {
+		return;
+	}
+	memcpy(buff->data + buff->size, pointer, (size_t) len + 1);
+	buff->size += (size_t) len + 1;
+	*numPointers += 1;
+}
+
+/* xorshift64* generator, seeded per corpus */
+static uint64_t bench_random(uint64_t* state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static const char* const BENCH_WORDS[] = {
+	"json", "parser", "library", "stream", "value", "caf\u00e9", "na\\u00efve", "\\\"quoted\\\"",
+	"line\\nbreak", "tab\\t", "\u65e5\u672c", "emoji \U0001F600", "benchmark", "object", "array", "number"
+};
+static const size_t BENCH_WORDS_LEN = sizeof(BENCH_WORDS) / sizeof(BENCH_WORDS[0]);
+
+/* Append a string of numWords random words, with its quotes */
+static void bench_buffer_words(bench_buffer* buff, uint64_t* rng, size_t numWords) {
+	bench_buffer_printf(buff, "\"");
+	for (size_t k = 0; k < numWords; k += 1) {
+		bench_buffer_printf(buff, (k) ? " %s" : "%s", BENCH_WORDS[bench_random(rng) % BENCH_WORDS_LEN]);
+	}
+	bench_buffer_printf(buff, "\"");
+}
+
+/* String-heavy statuses with nested user objects */
+static size_t bench_generate_twitter(bench_buffer* buff, uint64_t* rng, size_t targetSize) {
+	size_t count = 0;
+	bench_buffer_printf(buff, "{\"statuses\":[");
+	while (buff->size < targetSize && !buff->failed) {
+		const uint64_t id = 505874924095815681ULL + count;
+		bench_buffer_printf(buff, "%s{\"id\":%llu,\"id_str\":\"%llu\",\"text\":", (count) ? "," : "", (unsigned long long) id, (unsigned long long) id);
+		bench_buffer_words(buff, rng, 8 + bench_random(rng) % 16);
+		bench_buffer_printf(buff, ",\"user\":{\"id\":%llu,\"name\":", (unsigned long long) (bench_random(rng) % 4000000000ULL));
+		bench_buffer_words(buff, rng, 2);
+		bench_buffer_printf(buff, ",\"screen_name\":\"user_%zu\",\"description\":", count);
+		bench_buffer_words(buff, rng, 4 + bench_random(rng) % 12);
+		bench_buffer_printf(buff, ",\"followers_count\":%llu,\"verified\":%s,\"lang\":\"ja\"}", (unsigned long long) (bench_random(rng) % 100000), (bench_random(rng) % 8) ? "false" : "true");
+		const size_t start = bench_random(rng) % 100;
+		bench_buffer_printf(buff, ",\"entities\":{\"hashtags\":[{\"text\":\"tag%zu\",\"indices\":[%zu,%zu]}],\"urls\":[],\"user_mentions\":[]}", count % 97, start, start + 6);
+		bench_buffer_printf(buff, ",\"retweet_count\":%llu,\"favorited\":false,\"in_reply_to_status_id\":null}", (unsigned long long) (bench_random(rng) % 1000));
+		count += 1;
+	}
+	bench_buffer_printf(buff, "],\"search_metadata\":{\"count\":%zu,\"query\":\"%%23json\"}}", count);
+	return count;
+}
+
+/* Object-heavy events keyed by id, and performances referring to them */
+static size_t bench_generate_citm(bench_buffer* buff, uint64_t* rng, size_t targetSize) {
+	size_t count = 0;
+	bench_buffer_printf(buff, "{\"events\":{");
+	while (buff->size < targetSize / 3 && !buff->failed) {
+		bench_buffer_printf(buff, "%s\"%zu\":{\"description\":null,\"id\":%zu,\"logo\":\"/images/UE0AAAAACEKo%zu.jpg\",\"name\":", (count) ? "," : "", 138586341 + count, 138586341 + count, count);
+		bench_buffer_words(buff, rng, 3);
+		bench_buffer_printf(buff, ",\"subTopicIds\":[%llu,%llu,%llu],\"subjectCode\":null,\"subtitle\":null,\"topicIds\":[%llu,%llu]}",
+			(unsigned long long) (337184262 + bench_random(rng) % 100), (unsigned long long) (337184283 + bench_random(rng) % 100), (unsigned long long) (337184275 + bench_random(rng) % 100),
+			(unsigned long long) (324846099 + bench_random(rng) % 100), (unsigned long long) (107888604 + bench_random(rng) % 100));
+		count += 1;
+	}
+	const size_t events = count;
+	bench_buffer_printf(buff, "},\"performances\":[");
+	for (size_t k = 0; (buff->size < targetSize || k < events) && !buff->failed; k += 1) {
+		bench_buffer_printf(buff, "%s{\"eventId\":%zu,\"id\":%zu,\"logo\":null,\"name\":null,\"prices\":[", (k) ? "," : "", 138586341 + k % events, 339887544 + k);
+		const size_t numPrices = 1 + bench_random(rng) % 4;
+		for (size_t p = 0; p < numPrices; p += 1) {
+			bench_buffer_printf(buff, "%s{\"amount\":%llu,\"audienceSubCategoryId\":337100890,\"seatCategoryId\":%llu}", (p) ? "," : "", (unsigned long long) (10000 + bench_random(rng) % 90000), (unsigned long long) (338937295 + bench_random(rng) % 10));
+		}
+		bench_buffer_printf(buff, "],\"seatCategories\":[{\"areas\":[{\"areaId\":205705999,\"blockIds\":[]},{\"areaId\":205705998,\"blockIds\":[]}],\"seatCategoryId\":338937295}],\"seatMapImage\":null,\"start\":%llu,\"venueCode\":\"PLEYEL_PLEYEL\"}",
+			(unsigned long long) (1372701600000ULL + bench_random(rng) % 100000000));
+	}
+	bench_buffer_printf(buff, "]}");
+	return events;
+}
+
+/* Number-heavy polygon rings of coordinate pairs */
+static size_t bench_generate_canada(bench_buffer* buff, uint64_t* rng, size_t targetSize) {
+	size_t rings = 0;
+	bench_buffer_printf(buff, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\",\"properties\":{\"name\":\"Canada\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+	while (buff->size < targetSize && !buff->failed) {
+		bench_buffer_printf(buff, "%s[", (rings) ? "," : "");
+		double lon = -141.0 + (double) (bench_random(rng) % 8000) / 100.0;
+		double lat = 41.0 + (double) (bench_random(rng) % 4000) / 100.0;
+		for (size_t k = 0; k < 512; k += 1) {
+			lon += (double) ((int64_t) (bench_random(rng) % 2001) - 1000) / 1e6;
+			lat += (double) ((int64_t) (bench_random(rng) % 2001) - 1000) / 1e6;
+			bench_buffer_printf(buff, "%s[%.17g,%.17g]", (k) ? "," : "", lon, lat);
+		}
+		bench_buffer_printf(buff, "]");
+		rings += 1;
+	}
+	bench_buffer_printf(buff, "]}}]}");
+	return rings;
+}
+
+/* Chains of objects and arrays nested BENCH_NESTED_DEPTH deep */
+static size_t bench_generate_nested(bench_buffer* buff, uint64_t* rng, size_t targetSize) {
+	size_t chains = 0;
+	bench_buffer_printf(buff, "[");
+	while (buff->size < targetSize && !buff->failed) {
+		bench_buffer_printf(buff, (chains) ? "," : "");
+		for (size_t k = 0; k < BENCH_NESTED_DEPTH / 2 - 1; k += 1) {
+			bench_buffer_printf(buff, "{\"k\":[");
+		}
+		bench_buffer_printf(buff, "%llu", (unsigned long long) (bench_random(rng) % 1000));
+		for (size_t k = 0; k < BENCH_NESTED_DEPTH / 2 - 1; k += 1) {
+			bench_buffer_printf(buff, "]}");
+		}
+		chains += 1;
+	}
+	bench_buffer_printf(buff, "]");
+	return chains;
+}
+
+int bench_corpus_generate(bench_corpus* corpus, size_t index, size_t targetSize) {
+	if (!corpus || index >= BENCH_CORPUS_COUNT) {
+		return 1;
+	}
+
+	bench_buffer json = {NULL, 0, 0, 0};
+	bench_buffer pointers = {NULL, 0, 0, 0};
+	size_t numPointers = 0;
+	uint64_t rng = 0x9E3779B97F4A7C15ULL * (index + 1);
+
+	switch (index) {
+		case 0: {
+			const size_t count = bench_generate_twitter(&json, &rng, targetSize);
+			for (size_t k = 0; k < BENCH_POINTERS; k += 1) {
+				const size_t item = (count) ? (k * 7919) % count : 0;
+				if (k % 3 == 0) {
+					bench_buffer_pointer(&pointers, &numPointers, "/statuses/%zu/user/screen_name", item);
+				} else if (k % 3 == 1) {
+					bench_buffer_pointer(&pointers, &numPointers, "/statuses/%zu/entities/hashtags/0/indices/1", item);
+				} else {
+					bench_buffer_pointer(&pointers, &numPointers, "/statuses/%zu/text", item);
+				}
+			}
+		}
+		break;
+		case 1: {
+			const size_t count = bench_generate_citm(&json, &rng, targetSize);
+			for (size_t k = 0; k < BENCH_POINTERS; k += 1) {
+				const size_t item = (count) ? (k * 7919) % count : 0;
+				if (k % 2) {
+					bench_buffer_pointer(&pointers, &numPointers, "/events/%zu/name", 138586341 + item);
+				} else {
+					bench_buffer_pointer(&pointers, &numPointers, "/performances/%zu/prices/0/amount", item);
+				}
+			}
+		}
+		break;
+		case 2: {
+			const size_t count = bench_generate_canada(&json, &rng, targetSize);
+			for (size_t k = 0; k < BENCH_POINTERS; k += 1) {
+				const size_t item = (count) ? (k * 7919) % count : 0;
+				bench_buffer_pointer(&pointers, &numPointers, "/features/0/geometry/coordinates/%zu/%zu/%zu", item, (k * 31) % 512, k % 2);
+			}
+		}
+		break;
+		case 3: {
+			const size_t count = bench_generate_nested(&json, &rng, targetSize);
+			for (size_t k = 0; k < BENCH_POINTERS; k += 1) {
+				bench_buffer pointer = {NULL, 0, 0, 0};
+				bench_buffer_printf(&pointer, "/%zu", (count) ? (k * 7919) % count : 0);
+				for (size_t d = 0; d < BENCH_NESTED_DEPTH / 2 - 1; d += 1) {
+					bench_buffer_printf(&pointer, "/k/0");
+				}
+				if (!pointer.failed) {
+					bench_buffer_reserve(&pointers, pointer.size + 1);
+				}
+				if (pointer.failed || pointers.failed) {
+					pointers.failed = 1;
+				} else {
+					memcpy(pointers.data + pointers.size, pointer.data, pointer.size + 1);
+					pointers.size += pointer.size + 1;
+					numPointers += 1;
+				}
+				free(pointer.data);
+			}
+		}
+		break;
+	}
+
+	if (json.failed || pointers.failed) {
+		free(json.data);
+		free(pointers.data);
+		return 1;
+	}
+
+	corpus->name = BENCH_CORPUS_NAMES[index];
+	corpus->json = json.data;
+	corpus->jsonLen = json.size;
+	corpus->pointers = pointers.data;
+	corpus->numPointers = numPointers;
+	return 0;
+}
+
+void bench_corpus_free(bench_corpus* corpus) {
+	if (!corpus) {
+		return;
+	}
+	free(corpus->json);
+	free(corpus->pointers);
+	corpus->json = NULL;
+	corpus->jsonLen = 0;
+	corpus->pointers = NULL;
+	corpus->numPointers = 0;
+}
+
+double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
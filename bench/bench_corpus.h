@@ -0,0 +1,56 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Synthetic corpora for the benchmarks
+ *
+ * The generators are deterministic, so that every run measures the same
+ * documents. They model the usual JSON benchmark corpora without shipping them:
+ * string-heavy tweets, object-heavy event listings, number-heavy coordinates
+ * and deeply nested containers.
+ */
+
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stddef.h>
+
+typedef struct bench_corpus {
+	/* Name of the corpus */
+	const char* name;
+	/* JSON text of the corpus */
+	char* json;
+	size_t jsonLen;
+	/* JSON Pointers to values in the corpus, separated by null chars */
+	char* pointers;
+	size_t numPointers;
+} bench_corpus;
+
+/* Number of corpora generated by bench_corpus_generate() */
+#define BENCH_CORPUS_COUNT 4
+
+/* Names of the corpora, in the order generated */
+extern const char* const BENCH_CORPUS_NAMES[BENCH_CORPUS_COUNT];
+
+/* Generate corpus number index of about targetSize bytes; returns zero on success */
+int bench_corpus_generate(bench_corpus* corpus, size_t index, size_t targetSize);
+
+/* Free the memory of a corpus */
+void bench_corpus_free(bench_corpus* corpus);
+
+/* Returns the current time of a monotonic clock in seconds */
+double bench_now(void);
+
+#endif	//#ifndef BENCH_CORPUS_H
@@ -0,0 +1,281 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tail latency benchmark
+ *
+ * Runs 1, 2, 4, ... up to the given number of threads, each with its own
+ * json_parser_state, parsing, stringifying and freeing documents drawn from a
+ * mix of small, medium and large generated corpora. For each thread count it
+ * reports the p50, p99 and p99.9 latency of one document and the aggregate
+ * throughput as JSON on stdout. Flat latency and linear throughput as threads
+ * are added mean the threads don't contend; anything else points at shared
+ * state such as the allocator.
+ *
+ * Usage: bench_latency [-t max threads] [-n documents per thread] [-s size of the large documents]
+ */
+
+#include "../src/json.h"
+#include "bench_corpus.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* Sizes of the document classes relative to the large size, and how often each is drawn in 1000 */
+#define BENCH_SIZE_CLASSES 3
+static const size_t BENCH_SIZE_DIVISORS[BENCH_SIZE_CLASSES] = {256, 16, 1};
+static const unsigned BENCH_SIZE_WEIGHTS[BENCH_SIZE_CLASSES] = {700, 250, 50};
+
+typedef struct bench_pool {
+	bench_corpus corpora[BENCH_SIZE_CLASSES][BENCH_CORPUS_COUNT];
+} bench_pool;
+
+typedef struct bench_thread {
+	pthread_t thread;
+	const bench_pool* pool;
+	size_t documents;
+	uint64_t rng;
+	/* Latency of each document in seconds */
+	double* latencies;
+	size_t bytes;
+	int failed;
+} bench_thread;
+
+/* Threads start together once all are created */
+static pthread_mutex_t benchStartMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t benchStartCond = PTHREAD_COND_INITIALIZER;
+static int benchStarted = 0;
+
+/* xorshift64* generator, seeded per thread */
+static uint64_t bench_random(uint64_t* state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int bench_compare_double(const void* a, const void* b) {
+	const double x = *(const double*) a;
+	const double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static int bench_write_stdout(void* ctx, const char* data, size_t dataLen) {
+	return fwrite(data, 1, dataLen, (FILE*) ctx) != dataLen;
+}
+
+static const bench_corpus* bench_pick(const bench_pool* pool, uint64_t* rng) {
+	const uint64_t r = bench_random(rng);
+	unsigned draw = (unsigned) (r % 1000);
+	size_t sizeClass = 0;
+	while (sizeClass + 1 < BENCH_SIZE_CLASSES && draw >= BENCH_SIZE_WEIGHTS[sizeClass]) {
+		draw -= BENCH_SIZE_WEIGHTS[sizeClass];
+		sizeClass += 1;
+	}
+	return &pool->corpora[sizeClass][(r >> 32) % BENCH_CORPUS_COUNT];
+}
+
+static void* bench_thread_run(void* arg) {
+	bench_thread* thread = arg;
+	json_parser_state* parserState = json_parser_init(NULL, NULL);
+	if (!parserState) {
+		thread->failed = 1;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&benchStartMutex);
+	while (!benchStarted) {
+		pthread_cond_wait(&benchStartCond, &benchStartMutex);
+	}
+	pthread_mutex_unlock(&benchStartMutex);
+
+	for (size_t k = 0; k < thread->documents; k += 1) {
+		const bench_corpus* corpus = bench_pick(thread->pool, &thread->rng);
+		const double start = bench_now();
+
+		json_parser_reset(parserState);
+		json_value* topVal = json_parser_parse(parserState, corpus->json, corpus->jsonLen);
+		size_t strLen = 0;
+		char* str = (topVal) ? json_value_stringify(parserState, topVal, NULL, json_stringify_default, &strLen) : NULL;
+		free(str);
+		if (topVal) {
+			json_visitor_free_all(parserState, topVal);
+		}
+
+		thread->latencies[k] = bench_now() - start;
+		thread->bytes += corpus->jsonLen;
+		if (!str) {
+			thread->failed = 1;
+			break;
+		}
+	}
+
+	json_parser_clear(parserState);
+	return NULL;
+}
+
+/* Run numThreads threads and write their results as a JSON object */
+static int bench_run(json_writer* writer, const bench_pool* pool, size_t numThreads, size_t documents) {
+	int retVal = 1;
+	bench_thread* threads = calloc(numThreads, sizeof(bench_thread));
+	double* latencies = malloc(sizeof(double) * numThreads * documents);
+	if (!threads || !latencies) {
+		free(threads);
+		free(latencies);
+		return retVal;
+	}
+
+	benchStarted = 0;
+	size_t created = 0;
+	for (; created < numThreads; created += 1) {
+		bench_thread* thread = threads + created;
+		thread->pool = pool;
+		thread->documents = documents;
+		thread->rng = 0x9E3779B97F4A7C15ULL * (created + 1);
+		thread->latencies = latencies + created * documents;
+		if (pthread_create(&thread->thread, NULL, bench_thread_run, thread)) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&benchStartMutex);
+	benchStarted = 1;
+	const double start = bench_now();
+	pthread_cond_broadcast(&benchStartCond);
+	pthread_mutex_unlock(&benchStartMutex);
+
+	size_t bytes = 0;
+	int failed = created != numThreads;
+	for (size_t k = 0; k < created; k += 1) {
+		pthread_join(threads[k].thread, NULL);
+		bytes += threads[k].bytes;
+		failed |= threads[k].failed;
+	}
+	const double elapsed = bench_now() - start;
+
+	if (failed) {
+		fprintf(stderr, "bench: %zu threads: a thread failed\n", numThreads);
+		free(threads);
+		free(latencies);
+		return retVal;
+	}
+
+	const size_t count = numThreads * documents;
+	qsort(latencies, count, sizeof(double), bench_compare_double);
+	const double p50 = latencies[count / 2];
+	const double p99 = latencies[(size_t) (count * 0.99)];
+	const double p999 = latencies[(size_t) (count * 0.999)];
+	const double worst = latencies[count - 1];
+
+	retVal = json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "threads", 7);
+	retVal |= json_writer_number(writer, (double) numThreads);
+	retVal |= json_writer_key(writer, "documents", 9);
+	retVal |= json_writer_number(writer, (double) count);
+	retVal |= json_writer_key(writer, "p50_us", 6);
+	retVal |= json_writer_number(writer, p50 * 1e6);
+	retVal |= json_writer_key(writer, "p99_us", 6);
+	retVal |= json_writer_number(writer, p99 * 1e6);
+	retVal |= json_writer_key(writer, "p999_us", 7);
+	retVal |= json_writer_number(writer, p999 * 1e6);
+	retVal |= json_writer_key(writer, "max_us", 6);
+	retVal |= json_writer_number(writer, worst * 1e6);
+	retVal |= json_writer_key(writer, "documents_per_sec", 17);
+	retVal |= json_writer_number(writer, (elapsed > 0) ? (double) count / elapsed : 0);
+	retVal |= json_writer_key(writer, "mb_per_sec", 10);
+	retVal |= json_writer_number(writer, (elapsed > 0) ? (double) bytes / elapsed / 1e6 : 0);
+	retVal |= json_writer_end(writer);
+
+	free(threads);
+	free(latencies);
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t maxThreads = (cores > 0) ? (size_t) cores : 1;
+	size_t documents = 2000;
+	size_t largeSize = 1024 * 1024;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+		switch (opt) {
+			case 't':
+				maxThreads = strtoul(optarg, NULL, 10);
+			break;
+			case 'n':
+				documents = strtoul(optarg, NULL, 10);
+			break;
+			case 's':
+				largeSize = strtoul(optarg, NULL, 10);
+			break;
+			default:
+				fprintf(stderr, "Usage: %s [-t max threads] [-n documents per thread] [-s size of the large documents]\n", argv[0]);
+				return 2;
+			break;
+		}
+	}
+	if (!maxThreads || !documents || largeSize < BENCH_SIZE_DIVISORS[0]) {
+		fprintf(stderr, "%s: threads and documents must be positive and the size at least %zu\n", argv[0], BENCH_SIZE_DIVISORS[0]);
+		return 2;
+	}
+
+	bench_pool* pool = calloc(1, sizeof(bench_pool));
+	int retVal = (pool) ? 0 : 1;
+	for (size_t sizeClass = 0; sizeClass < BENCH_SIZE_CLASSES && !retVal; sizeClass += 1) {
+		for (size_t index = 0; index < BENCH_CORPUS_COUNT && !retVal; index += 1) {
+			retVal = bench_corpus_generate(&pool->corpora[sizeClass][index], index, largeSize / BENCH_SIZE_DIVISORS[sizeClass]);
+		}
+	}
+
+	json_parser_state* parserState = (!retVal) ? json_parser_init(NULL, NULL) : NULL;
+	json_writer* writer = (parserState) ? json_writer_init_sink(parserState, "  ", json_stringify_indent | json_stringify_spaces, bench_write_stdout, stdout) : NULL;
+	if (retVal || !parserState || !writer) {
+		fprintf(stderr, "%s: initialization failed\n", argv[0]);
+		return 1;
+	}
+
+	retVal = json_writer_begin_array(writer);
+	for (size_t numThreads = 1; !retVal; numThreads *= 2) {
+		if (numThreads > maxThreads) {
+			numThreads = maxThreads;
+		}
+		retVal = bench_run(writer, pool, numThreads, documents);
+		if (numThreads == maxThreads) {
+			break;
+		}
+	}
+	if (!retVal) {
+		retVal = json_writer_end(writer);
+	}
+	if (!retVal) {
+		retVal = json_writer_finish(writer, NULL, NULL);
+		fputc('\n', stdout);
+	}
+
+	json_writer_clear(writer);
+	json_parser_clear(parserState);
+	for (size_t sizeClass = 0; sizeClass < BENCH_SIZE_CLASSES; sizeClass += 1) {
+		for (size_t index = 0; index < BENCH_CORPUS_COUNT; index += 1) {
+			bench_corpus_free(&pool->corpora[sizeClass][index]);
+		}
+	}
+	free(pool);
+	return retVal;
+}
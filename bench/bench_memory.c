@@ -0,0 +1,281 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory footprint benchmark
+ *
+ * Parses each generated corpus through a counting allocator, once with the
+ * default options and once with the options that make documents smaller, and
+ * reports as JSON on stdout the number of allocations, the peak and retained
+ * bytes, the bytes of tree per byte of input and the breakdown returned by
+ * json_value_memory_usage(). The peak resident set size of the process is
+ * reported last; it includes the corpora themselves.
+ *
+ * Usage: bench_memory [-s corpus size in bytes] [-c corpus]
+ */
+
+#include "../src/json.h"
+#include "bench_corpus.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+/* Size of the header before each counted allocation; keeps malloc alignment */
+#define BENCH_ALLOC_HEADER 16
+
+static size_t benchAllocations = 0;
+static size_t benchLiveBytes = 0;
+static size_t benchPeakBytes = 0;
+
+static void* bench_alloc(size_t size) {
+	char* ptr = malloc(BENCH_ALLOC_HEADER + size);
+	if (!ptr) {
+		return NULL;
+	}
+
+	*(size_t*) ptr = size;
+	benchAllocations += 1;
+	benchLiveBytes += size;
+	if (benchLiveBytes > benchPeakBytes) {
+		benchPeakBytes = benchLiveBytes;
+	}
+	return ptr + BENCH_ALLOC_HEADER;
+}
+
+static void bench_free(void* ptr) {
+	if (!ptr) {
+		return;
+	}
+
+	char* base = (char*) ptr - BENCH_ALLOC_HEADER;
+	benchLiveBytes -= *(size_t*) base;
+	free(base);
+}
+
+static void* bench_realloc(void* ptr, size_t size) {
+	if (!ptr) {
+		return bench_alloc(size);
+	}
+
+	char* base = (char*) ptr - BENCH_ALLOC_HEADER;
+	const size_t oldSize = *(size_t*) base;
+	char* newBase = realloc(base, BENCH_ALLOC_HEADER + size);
+	if (!newBase) {
+		return NULL;
+	}
+
+	*(size_t*) newBase = size;
+	benchAllocations += 1;
+	benchLiveBytes = benchLiveBytes - oldSize + size;
+	if (benchLiveBytes > benchPeakBytes) {
+		benchPeakBytes = benchLiveBytes;
+	}
+	return newBase + BENCH_ALLOC_HEADER;
+}
+
+static int bench_write_stdout(void* ctx, const char* data, size_t dataLen) {
+	return fwrite(data, 1, dataLen, (FILE*) ctx) != dataLen;
+}
+
+/* Parser options of each configuration */
+typedef struct bench_config {
+	const char* name;
+	int compact;
+} bench_config;
+
+static const bench_config BENCH_CONFIGS[] = {
+	{"default", 0},
+	{"compact", 1}
+};
+
+static int bench_report_usage(json_writer* writer, const json_memory_usage* usage) {
+	int retVal = 0;
+
+	retVal |= json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "value_count", 11);
+	retVal |= json_writer_number(writer, (double) usage->valueCount);
+	retVal |= json_writer_key(writer, "values", 6);
+	retVal |= json_writer_number(writer, (double) usage->values);
+	retVal |= json_writer_key(writer, "objects", 7);
+	retVal |= json_writer_number(writer, (double) usage->objects);
+	retVal |= json_writer_key(writer, "object_members", 14);
+	retVal |= json_writer_number(writer, (double) usage->objectMembers);
+	retVal |= json_writer_key(writer, "shapes", 6);
+	retVal |= json_writer_number(writer, (double) usage->shapes);
+	retVal |= json_writer_key(writer, "arrays", 6);
+	retVal |= json_writer_number(writer, (double) usage->arrays);
+	retVal |= json_writer_key(writer, "array_elements", 14);
+	retVal |= json_writer_number(writer, (double) usage->arrayElements);
+	retVal |= json_writer_key(writer, "strings", 7);
+	retVal |= json_writer_number(writer, (double) usage->strings);
+	retVal |= json_writer_key(writer, "string_bytes", 12);
+	retVal |= json_writer_number(writer, (double) usage->stringBytes);
+	retVal |= json_writer_key(writer, "numbers", 7);
+	retVal |= json_writer_number(writer, (double) usage->numbers);
+	retVal |= json_writer_key(writer, "literals", 8);
+	retVal |= json_writer_number(writer, (double) usage->literals);
+	retVal |= json_writer_key(writer, "total", 5);
+	retVal |= json_writer_number(writer, (double) usage->total);
+	retVal |= json_writer_end(writer);
+
+	return retVal;
+}
+
+/* Parse a corpus with one configuration and write its results as a JSON object */
+static int bench_run(json_writer* writer, const bench_corpus* corpus, const bench_config* config) {
+	int retVal = 1;
+
+	json_parser_state* parserState = json_parser_init(bench_alloc, bench_free);
+	if (!parserState) {
+		fprintf(stderr, "bench: json_parser_init() failed\n");
+		return retVal;
+	}
+
+	retVal = json_parser_reset(parserState);
+	retVal |= json_parser_setopt(parserState, json_realloc_function, bench_realloc);
+	if (config->compact) {
+		retVal |= json_parser_setopt(parserState, json_pack_number_arrays, 1);
+		retVal |= json_parser_setopt(parserState, json_share_object_shapes, 1);
+		retVal |= json_parser_setopt(parserState, json_intern_names, 1);
+	}
+	if (retVal) {
+		fprintf(stderr, "bench: json_parser_setopt() failed\n");
+		json_parser_clear(parserState);
+		return retVal;
+	}
+
+	const size_t baseAllocations = benchAllocations;
+	const size_t baseBytes = benchLiveBytes;
+	benchPeakBytes = benchLiveBytes;
+	json_value* topVal = json_parser_parse(parserState, corpus->json, corpus->jsonLen);
+	if (!topVal) {
+		fprintf(stderr, "bench: %s: json_parser_parse() failed\n", corpus->name);
+		json_parser_clear(parserState);
+		return 1;
+	}
+	const size_t allocations = benchAllocations - baseAllocations;
+	const size_t peakBytes = benchPeakBytes - baseBytes;
+	const size_t retainedBytes = benchLiveBytes - baseBytes;
+
+	json_memory_usage usage;
+	retVal = json_value_memory_usage(topVal, &usage);
+	if (retVal) {
+		fprintf(stderr, "bench: %s: json_value_memory_usage() failed\n", corpus->name);
+		json_visitor_free_all(parserState, topVal);
+		json_parser_clear(parserState);
+		return retVal;
+	}
+
+	retVal |= json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "corpus", 6);
+	retVal |= json_writer_string(writer, corpus->name, strlen(corpus->name));
+	retVal |= json_writer_key(writer, "config", 6);
+	retVal |= json_writer_string(writer, config->name, strlen(config->name));
+	retVal |= json_writer_key(writer, "bytes", 5);
+	retVal |= json_writer_number(writer, (double) corpus->jsonLen);
+	retVal |= json_writer_key(writer, "allocations", 11);
+	retVal |= json_writer_number(writer, (double) allocations);
+	retVal |= json_writer_key(writer, "peak_bytes", 10);
+	retVal |= json_writer_number(writer, (double) peakBytes);
+	retVal |= json_writer_key(writer, "retained_bytes", 14);
+	retVal |= json_writer_number(writer, (double) retainedBytes);
+	retVal |= json_writer_key(writer, "bytes_per_input_byte", 20);
+	retVal |= json_writer_number(writer, (double) retainedBytes / (double) corpus->jsonLen);
+	retVal |= json_writer_key(writer, "usage", 5);
+	retVal |= bench_report_usage(writer, &usage);
+	retVal |= json_writer_end(writer);
+
+	json_visitor_free_all(parserState, topVal);
+	json_parser_clear(parserState);
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	size_t corpusSize = 4 * 1024 * 1024;
+	const char* only = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:c:")) != -1) {
+		switch (opt) {
+			case 's':
+				corpusSize = strtoul(optarg, NULL, 10);
+			break;
+			case 'c':
+				only = optarg;
+			break;
+			default:
+				fprintf(stderr, "Usage: %s [-s corpus size in bytes] [-c corpus]\n", argv[0]);
+				return 2;
+			break;
+		}
+	}
+	if (!corpusSize) {
+		fprintf(stderr, "%s: corpus size must be positive\n", argv[0]);
+		return 2;
+	}
+
+	//The writer uses its own parser state so that its memory isn't counted
+	json_parser_state* writerState = json_parser_init(NULL, NULL);
+	json_writer* writer = (writerState) ? json_writer_init_sink(writerState, "  ", json_stringify_indent | json_stringify_spaces, bench_write_stdout, stdout) : NULL;
+	if (!writerState || !writer) {
+		fprintf(stderr, "%s: initialization failed\n", argv[0]);
+		return 1;
+	}
+
+	int retVal = json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "results", 7);
+	retVal |= json_writer_begin_array(writer);
+	for (size_t index = 0; index < BENCH_CORPUS_COUNT && !retVal; index += 1) {
+		if (only && strcmp(only, BENCH_CORPUS_NAMES[index])) {
+			continue;
+		}
+
+		bench_corpus corpus;
+		if (bench_corpus_generate(&corpus, index, corpusSize)) {
+			fprintf(stderr, "%s: generating corpus %s failed\n", argv[0], BENCH_CORPUS_NAMES[index]);
+			retVal = 1;
+			break;
+		}
+
+		for (size_t k = 0; k < sizeof(BENCH_CONFIGS) / sizeof(BENCH_CONFIGS[0]) && !retVal; k += 1) {
+			retVal = bench_run(writer, &corpus, &BENCH_CONFIGS[k]);
+		}
+		bench_corpus_free(&corpus);
+	}
+	if (!retVal) {
+		retVal = json_writer_end(writer);
+	}
+
+	struct rusage usage;
+	if (!retVal && !getrusage(RUSAGE_SELF, &usage)) {
+		//ru_maxrss is in kilobytes on Linux and the BSDs
+		retVal |= json_writer_key(writer, "max_rss_kb", 10);
+		retVal |= json_writer_number(writer, (double) usage.ru_maxrss);
+	}
+	if (!retVal) {
+		retVal = json_writer_end(writer);
+	}
+	if (!retVal) {
+		retVal = json_writer_finish(writer, NULL, NULL);
+		fputc('\n', stdout);
+	}
+
+	json_writer_clear(writer);
+	json_parser_clear(writerState);
+	return retVal;
+}
@@ -0,0 +1,227 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput benchmark
+ *
+ * Parses, stringifies, queries and frees each generated corpus a number of
+ * times and reports the median and best time of each phase as JSON on stdout.
+ * Rates in MB/s are relative to the size of the input text. The -l option
+ * forces the byte scanning kernels to a JSON_CPU_LEVEL, 0 for scalar.
+ *
+ * Usage: bench_throughput [-r repetitions] [-s corpus size in bytes] [-c corpus] [-l cpu level]
+ */
+
+#include "../src/json.h"
+#include "bench_corpus.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+	bench_phase_parse = 0,
+	bench_phase_stringify,
+	bench_phase_query,
+	bench_phase_free,
+	bench_phase_count
+};
+
+static const char* const BENCH_PHASE_NAMES[bench_phase_count] = {
+	"parse",
+	"stringify",
+	"query",
+	"free"
+};
+
+static int bench_compare_double(const void* a, const void* b) {
+	const double x = *(const double*) a;
+	const double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static int bench_write_stdout(void* ctx, const char* data, size_t dataLen) {
+	return fwrite(data, 1, dataLen, (FILE*) ctx) != dataLen;
+}
+
+/* Run one repetition over a corpus; times are stored in seconds per phase */
+static int bench_run(json_parser_state* parserState, const bench_corpus* corpus, double* times) {
+	json_parser_reset(parserState);
+
+	double start = bench_now();
+	json_value* topVal = json_parser_parse(parserState, corpus->json, corpus->jsonLen);
+	times[bench_phase_parse] = bench_now() - start;
+	if (!topVal) {
+		fprintf(stderr, "bench: %s: json_parser_parse() failed\n", corpus->name);
+		return 1;
+	}
+
+	size_t strLen = 0;
+	start = bench_now();
+	char* str = json_value_stringify(parserState, topVal, NULL, json_stringify_default, &strLen);
+	times[bench_phase_stringify] = bench_now() - start;
+	if (!str) {
+		fprintf(stderr, "bench: %s: json_value_stringify() failed\n", corpus->name);
+		json_visitor_free_all(parserState, topVal);
+		return 1;
+	}
+	free(str);
+
+	size_t found = 0;
+	start = bench_now();
+	const char* pointer = corpus->pointers;
+	for (size_t k = 0; k < corpus->numPointers; k += 1) {
+		const size_t pointerLen = strlen(pointer);
+		found += json_value_query(parserState, topVal, pointer, pointerLen) != NULL;
+		pointer += pointerLen + 1;
+	}
+	times[bench_phase_query] = bench_now() - start;
+	if (found != corpus->numPointers) {
+		fprintf(stderr, "bench: %s: json_value_query() found %zu of %zu values\n", corpus->name, found, corpus->numPointers);
+		json_visitor_free_all(parserState, topVal);
+		return 1;
+	}
+
+	start = bench_now();
+	json_visitor_free_all(parserState, topVal);
+	times[bench_phase_free] = bench_now() - start;
+
+	return 0;
+}
+
+/* Write the results of a corpus as a JSON object */
+static int bench_report(json_writer* writer, const bench_corpus* corpus, double* times, size_t repetitions) {
+	int retVal = 0;
+
+	retVal |= json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "corpus", 6);
+	retVal |= json_writer_string(writer, corpus->name, strlen(corpus->name));
+	retVal |= json_writer_key(writer, "bytes", 5);
+	retVal |= json_writer_number(writer, (double) corpus->jsonLen);
+	retVal |= json_writer_key(writer, "repetitions", 11);
+	retVal |= json_writer_number(writer, (double) repetitions);
+
+	for (size_t phase = 0; phase < bench_phase_count; phase += 1) {
+		double* phaseTimes = times + phase * repetitions;
+		qsort(phaseTimes, repetitions, sizeof(double), bench_compare_double);
+		const double median = (repetitions % 2) ? phaseTimes[repetitions / 2] : (phaseTimes[repetitions / 2 - 1] + phaseTimes[repetitions / 2]) / 2;
+		const double best = phaseTimes[0];
+
+		const char* name = BENCH_PHASE_NAMES[phase];
+		retVal |= json_writer_key(writer, name, strlen(name));
+		retVal |= json_writer_begin_object(writer);
+		retVal |= json_writer_key(writer, "median_ms", 9);
+		retVal |= json_writer_number(writer, median * 1e3);
+		retVal |= json_writer_key(writer, "best_ms", 7);
+		retVal |= json_writer_number(writer, best * 1e3);
+		if (phase == bench_phase_query) {
+			retVal |= json_writer_key(writer, "queries_per_sec", 15);
+			retVal |= json_writer_number(writer, (median > 0) ? (double) corpus->numPointers / median : 0);
+		} else if (phase != bench_phase_free) {
+			retVal |= json_writer_key(writer, "mb_per_sec", 10);
+			retVal |= json_writer_number(writer, (median > 0) ? (double) corpus->jsonLen / median / 1e6 : 0);
+		}
+		retVal |= json_writer_end(writer);
+	}
+
+	retVal |= json_writer_end(writer);
+	return retVal;
+}
+
+int main(int argc, char** argv) {
+	size_t repetitions = 10;
+	size_t corpusSize = 4 * 1024 * 1024;
+	const char* only = NULL;
+	int cpuLevel = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "r:s:c:l:")) != -1) {
+		switch (opt) {
+			case 'r':
+				repetitions = strtoul(optarg, NULL, 10);
+			break;
+			case 's':
+				corpusSize = strtoul(optarg, NULL, 10);
+			break;
+			case 'c':
+				only = optarg;
+			break;
+			case 'l':
+				cpuLevel = atoi(optarg);
+			break;
+			default:
+				fprintf(stderr, "Usage: %s [-r repetitions] [-s corpus size in bytes] [-c corpus] [-l cpu level]\n", argv[0]);
+				return 2;
+			break;
+		}
+	}
+	if (!repetitions || !corpusSize) {
+		fprintf(stderr, "%s: repetitions and corpus size must be positive\n", argv[0]);
+		return 2;
+	}
+
+	json_parser_state* parserState = json_parser_init(NULL, NULL);
+	double* times = malloc(sizeof(double) * bench_phase_count * repetitions);
+	json_writer* writer = (parserState) ? json_writer_init_sink(parserState, "  ", json_stringify_indent | json_stringify_spaces, bench_write_stdout, stdout) : NULL;
+	if (!parserState || !times || !writer) {
+		fprintf(stderr, "%s: initialization failed\n", argv[0]);
+		return 1;
+	}
+	if (cpuLevel >= 0 && json_parser_setopt(parserState, json_cpu_level, cpuLevel)) {
+		fprintf(stderr, "%s: cpu level %d is above the %d of this CPU\n", argv[0], cpuLevel, (int) json_cpu_detect());
+		return 2;
+	}
+
+	int retVal = json_writer_begin_array(writer);
+	for (size_t index = 0; index < BENCH_CORPUS_COUNT && !retVal; index += 1) {
+		if (only && strcmp(only, BENCH_CORPUS_NAMES[index])) {
+			continue;
+		}
+
+		bench_corpus corpus;
+		if (bench_corpus_generate(&corpus, index, corpusSize)) {
+			fprintf(stderr, "%s: generating corpus %s failed\n", argv[0], BENCH_CORPUS_NAMES[index]);
+			retVal = 1;
+			break;
+		}
+
+		//Warm up caches and the allocator before measuring
+		double repTimes[bench_phase_count];
+		retVal = bench_run(parserState, &corpus, repTimes);
+		for (size_t rep = 0; rep < repetitions && !retVal; rep += 1) {
+			retVal = bench_run(parserState, &corpus, repTimes);
+			for (size_t phase = 0; phase < bench_phase_count; phase += 1) {
+				times[phase * repetitions + rep] = repTimes[phase];
+			}
+		}
+		if (!retVal) {
+			retVal = bench_report(writer, &corpus, times, repetitions);
+		}
+		bench_corpus_free(&corpus);
+	}
+	if (!retVal) {
+		retVal = json_writer_end(writer);
+	}
+	if (!retVal) {
+		retVal = json_writer_finish(writer, NULL, NULL);
+		fputc('\n', stdout);
+	}
+
+	json_writer_clear(writer);
+	free(times);
+	json_parser_clear(parserState);
+	return retVal;
+}
@@ -36,6 +36,7 @@
 #include "json_parser.h"
 #include "json_utils.h"
 #include "json_introspect.h"
+#include "json_writer.h"
 
 
 #endif	//#ifndef JSON_H
@@ -0,0 +1,182 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_factory_inline.h
+ *  @brief Inline construction of nodes for the default json_factory
+ *
+ *  This header is internal to the library and is not installed. The
+ *  json_factory_init_* functions fill in a newly allocated node and are shared
+ *  by the default factory functions and the parser. When a parser uses the
+ *  default factory and the default allocator, JSON_NEW_NODE() and
+ *  JSON_NEW_LITERAL() allocate with malloc and build the node inline in the
+ *  parse loop. Otherwise they call through the json_factory.
+ */
+
+
+#ifndef JSON_FACTORY_INLINE_H
+#define JSON_FACTORY_INLINE_H
+
+
+#include "json_types.h"
+#include "json_stats.h"
+
+#include <stdlib.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+/*! @cond */
+int json_factory_is_default(json_factory* jsonFact);
+
+//Allocate from malloc, only valid with the default allocator
+static inline void* json_factory_fast_alloc(json_factory* jsonFact, const JSON_ALLOC_CATEGORY category, const size_t size) {
+#ifdef JSON_ENABLE_STATS
+	return JSON_MALLOC(jsonFact->allocator, category, size);
+#else
+	(void) jsonFact;
+	(void) category;
+	return malloc(size);
+#endif	//#ifdef JSON_ENABLE_STATS
+}
+
+static inline void* json_factory_fast_alloc_node(json_factory* jsonFact, const JSON_NODE_POOL pool, const size_t size) {
+	json_node_pool* nodePool = jsonFact->pools + pool;
+	void* node = nodePool->head;
+	if (!node) {
+		return json_factory_fast_alloc(jsonFact, (JSON_ALLOC_CATEGORY) pool, size);
+	}
+
+	nodePool->head = *((void**) node);
+	nodePool->count -= 1;
+	return node;
+}
+
+//Each json_factory_init_* function returns its node, or NULL if passed NULL
+static inline json_object* json_factory_init_json_object(json_object* obj, json_value* objParentValue) {
+	if (!obj) {
+		return NULL;
+	}
+
+	obj->members = NULL;
+	obj->shape = NULL;
+	obj->values = NULL;
+	obj->size = 0;
+	obj->capacity = 0;
+	obj->source = NULL;
+	obj->sourceLen = 0;
+	obj->parentValue = objParentValue;
+
+	return obj;
+}
+static inline json_value* json_factory_init_json_value(json_value* value, JSON_VALUE valValueType, void* valValue, JSON_VALUE valParentValueType, void* valParentValue) {
+	if (!value) {
+		return NULL;
+	}
+
+	value->valueType = valValueType;
+	value->value = valValue;
+
+	value->parentValueType = valParentValueType;
+	value->parentValue = valParentValue;
+
+	return value;
+}
+static inline json_string* json_factory_init_json_string(json_string* str, const char* strValue, size_t strValueLen, json_value* strParentValue) {
+	if (!str) {
+		return NULL;
+	}
+
+	str->value = strValue;
+	str->valueLen = strValueLen;
+	str->parentValue = strParentValue;
+
+	return str;
+}
+static inline json_number* json_factory_init_json_number(json_number* num, double numValue, json_value* numParentValue) {
+	if (!num) {
+		return NULL;
+	}
+
+	num->value = numValue;
+	num->parentValue = numParentValue;
+
+	return num;
+}
+static inline json_array* json_factory_init_json_array(json_array* arr, json_value* arrParentValue) {
+	if (!arr) {
+		return NULL;
+	}
+
+	arr->values = NULL;
+	arr->numbers = NULL;
+	arr->size = 0;
+	arr->capacity = 0;
+	arr->source = NULL;
+	arr->sourceLen = 0;
+	arr->parentValue = arrParentValue;
+
+	return arr;
+}
+static inline json_true* json_factory_init_json_true(json_true* tru, json_value* truParentValue) {
+	if (!tru) {
+		return NULL;
+	}
+
+	tru->parentValue = truParentValue;
+
+	return tru;
+}
+static inline json_false* json_factory_init_json_false(json_false* fal, json_value* falParentValue) {
+	if (!fal) {
+		return NULL;
+	}
+
+	fal->parentValue = falParentValue;
+
+	return fal;
+}
+static inline json_null* json_factory_init_json_null(json_null* nul, json_value* nulParentValue) {
+	if (!nul) {
+		return NULL;
+	}
+
+	nul->parentValue = nulParentValue;
+
+	return nul;
+}
+
+//Make a pooled node of the given type, inline when parserState->defaultFactory is set
+#define JSON_NEW_NODE(parserState, type, pool, ...) (((parserState)->defaultFactory) ?\
+	json_factory_init_json_##type((json_##type*) json_factory_fast_alloc_node((parserState)->JSON_Factory, (pool), sizeof(json_##type)), __VA_ARGS__) :\
+	(parserState)->JSON_Factory->new_json_##type((parserState)->JSON_Factory, __VA_ARGS__))
+
+//Make a json_true, json_false or json_null, inline when parserState->defaultFactory is set
+#define JSON_NEW_LITERAL(parserState, type, parentValue) (((parserState)->defaultFactory) ?\
+	json_factory_init_json_##type((json_##type*) json_factory_fast_alloc((parserState)->JSON_Factory, json_alloc_literal, sizeof(json_##type)), (parentValue)) :\
+	(parserState)->JSON_Factory->new_json_##type((parserState)->JSON_Factory, (parentValue)))
+/*! @endcond */
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_FACTORY_INLINE_H
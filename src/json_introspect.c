@@ -22,8 +22,12 @@
 
 
 #include "json_types.h"
+#include "json_factory_inline.h"
 #include "json_introspect.h"
 #include "json_parser.h"
+#include "json_utils.h"
+#include "json_string_buffer.h"
+#include "json_probes.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -31,6 +35,21 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif	//#ifdef HAVE_UNISTD_H
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+_Static_assert(
+	sizeof(json_iovec) == sizeof(struct iovec)
+	&& offsetof(json_iovec, iov_base) == offsetof(struct iovec, iov_base)
+	&& offsetof(json_iovec, iov_len) == offsetof(struct iovec, iov_len),
+	"json_iovec must match struct iovec"
+);
+#endif	//#ifdef HAVE_SYS_UIO_H
 
 
 #ifdef __cplusplus
@@ -38,10 +57,6 @@ extern "C" {
 #endif	//#ifdef __cplusplus
 
 
-const size_t JSON_STR_BUFF_INIT_SIZE = 32;
-const double JSON_STR_BUFF_INCR_SIZE = 1.5;
-
-
 //Loop through string:value pairs in the passed object, call iter callback passing object, string and value
 //Returns nonzero if passed object or callback is null, zero otherwise
 //Callback should return truthy value, or zero to stop iterating
@@ -62,9 +77,18 @@ int json_object_foreach_obj(json_object* obj, json_object_foreach_cb iter) {
 		return 1;
 	}
 
-	size_t k = 0, numElems = obj->size;
-	while (k < numElems && iter(obj, obj->names[k], obj->values[k])) {
-		k += 1;
+	if (obj->shape) {
+		size_t k = 0, numElems = obj->size;
+		while (k < numElems && iter(obj, obj->shape->names[k], obj->values[k])) {
+			k += 1;
+		}
+		return 0;
+	}
+
+	json_object_member* member = obj->members;
+	json_object_member* end = member + obj->size;
+	while (member < end && iter(obj, member->name, member->value)) {
+		member += 1;
 	}
 
 	return 0;
@@ -91,6 +115,22 @@ int json_array_foreach_arr(json_array* arr, json_array_foreach_cb iter) {
 	}
 
 	size_t k = 0, numElems = arr->size;
+	if (arr->numbers) {
+		//Pass each number of a packed array in a temporary value
+		json_value val;
+		json_number num;
+		json_factory_init_json_value(&val, number_value, &num, array_value, arr);
+		json_factory_init_json_number(&num, 0.0, &val);
+		while (k < numElems) {
+			num.value = arr->numbers[k];
+			if (!iter(arr, &val)) {
+				break;
+			}
+			k += 1;
+		}
+		return 0;
+	}
+
 	while (k < numElems && iter(arr, arr->values[k])) {
 		k += 1;
 	}
@@ -98,6 +138,130 @@ int json_array_foreach_arr(json_array* arr, json_array_foreach_cb iter) {
 	return 0;
 }
 
+const double* json_array_get_numbers(json_array* arr, size_t* len) {
+	if (!arr || !arr->numbers) {
+		return NULL;
+	}
+
+	if (len) {
+		*len = arr->size;
+	}
+	return arr->numbers;
+}
+
+/* JSON memory usage functions */
+
+//Count a member name unless it is interned and owned by the parser
+static void json_memory_usage_name(json_memory_usage* usage, const json_string* name, const uint32_t flags) {
+	if (flags & json_member_interned_name) {
+		return;
+	}
+	usage->strings += sizeof(json_string);
+	usage->stringBytes += name->valueLen + 1;
+}
+
+static int json_memory_usage_value(json_memory_usage* usage, const json_value* value) {
+	int retVal = 1;
+	if (!value) {
+		return retVal;
+	}
+
+	usage->valueCount += 1;
+	usage->values += sizeof(json_value);
+	switch (value->valueType) {
+		case object_value: {
+			const json_object* obj = value->value;
+			usage->objects += sizeof(json_object);
+			if (obj->shape) {
+				const json_object_shape* shape = obj->shape;
+				usage->objectMembers += sizeof(json_value*) * obj->capacity;
+
+				//Same layout as allocated by json_object_shape_new()
+				const size_t namesOffset = align_offset(sizeof(json_object_shape), JSON_ALIGN_SIZE);
+				size_t shapeBytes = namesOffset + (sizeof(json_string*) + sizeof(uint32_t)) * shape->size + sizeof(uint32_t) * (shape->tableMask + 1);
+				if (!(shape->flags & json_member_interned_name)) {
+					for (size_t k = 0; k < shape->size; k += 1) {
+						shapeBytes += sizeof(json_string) + shape->names[k]->valueLen + 1;
+					}
+				}
+				usage->shapes += shapeBytes / ((shape->refCount) ? shape->refCount : 1);
+			} else {
+				usage->objectMembers += sizeof(json_object_member) * obj->capacity;
+				for (size_t k = 0; k < obj->size; k += 1) {
+					json_memory_usage_name(usage, obj->members[k].name, obj->members[k].flags);
+				}
+			}
+			for (size_t k = 0; k < obj->size; k += 1) {
+				retVal = json_memory_usage_value(usage, (obj->shape) ? obj->values[k] : obj->members[k].value);
+				if (retVal) {
+					return retVal;
+				}
+			}
+		}
+		break;
+		case array_value: {
+			const json_array* arr = value->value;
+			usage->arrays += sizeof(json_array);
+			if (arr->numbers) {
+				usage->arrayElements += sizeof(double) * arr->capacity;
+			} else {
+				usage->arrayElements += sizeof(json_value*) * arr->capacity;
+				for (size_t k = 0; k < arr->size; k += 1) {
+					retVal = json_memory_usage_value(usage, arr->values[k]);
+					if (retVal) {
+						return retVal;
+					}
+				}
+			}
+		}
+		break;
+		case string_value: {
+			const json_string* str = value->value;
+			usage->strings += sizeof(json_string);
+			usage->stringBytes += str->valueLen + 1;
+		}
+		break;
+		case number_value:
+			usage->numbers += sizeof(json_number);
+		break;
+		case true_value:
+			usage->literals += sizeof(json_true);
+		break;
+		case false_value:
+			usage->literals += sizeof(json_false);
+		break;
+		case null_value:
+			usage->literals += sizeof(json_null);
+		break;
+		default:
+			return retVal;
+		break;
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_value_memory_usage(json_value* value, json_memory_usage* usage) {
+	int retVal = 1;
+	if (!value || !usage) {
+		return retVal;
+	}
+
+	memset(usage, 0, sizeof(json_memory_usage));
+	retVal = json_memory_usage_value(usage, value);
+	if (retVal) {
+		return retVal;
+	}
+
+	usage->total = usage->values + usage->objects + usage->objectMembers + usage->shapes
+		+ usage->arrays + usage->arrayElements + usage->strings + usage->stringBytes
+		+ usage->numbers + usage->literals;
+
+	retVal = 0;
+	return retVal;
+}
+
 /* JSON Pointer functions */
 
 /*! @cond */
@@ -135,7 +299,7 @@ static reference_token* parse_json_pointer(
 		}
 	}
 
-	tokens = jsAlloc->malloc(sizeof(reference_token) * numTokens);
+	tokens = json_allocator_malloc(jsAlloc, sizeof(reference_token) * numTokens);
 	if (!tokens) {
 		return tokens;
 	}
@@ -148,12 +312,12 @@ static reference_token* parse_json_pointer(
 			const size_t tokenLen = (jsonPtrStr + k + off) - (lastTokenStart + 1);
 			reference_token* token = tokens + tokenIndex;
 			token->tokenLen = tokenLen;
-			token->token = jsAlloc->malloc(sizeof(char) * tokenLen);
+			token->token = json_allocator_malloc(jsAlloc, sizeof(char) * tokenLen);
 			if (!token->token) {
 				for (size_t iK = 0; iK < tokenIndex; iK += 1) {
-					jsAlloc->free(tokens[iK].token);
+					json_allocator_free(jsAlloc, tokens[iK].token);
 				}
-				jsAlloc->free(tokens);
+				json_allocator_free(jsAlloc, tokens);
 				return NULL;
 			}
 
@@ -179,9 +343,9 @@ static reference_token* parse_json_pointer(
 					(ptr[iK + 1] != '0' && ptr[iK + 1] != '1')
 				) {//Incomplete/invalid escaped token
 					for (size_t n = 0; n < numTokens; n += 1) {
-						jsAlloc->free(tokens[n].token);
+						json_allocator_free(jsAlloc, tokens[n].token);
 					}
-					jsAlloc->free(tokens);
+					json_allocator_free(jsAlloc, tokens);
 					return NULL;
 				} else {
 					if (ptr[iK + 1] == '1') {
@@ -210,9 +374,9 @@ static reference_token* parse_json_pointer(
 					(ptr[iK + 1] != '0' && ptr[iK + 1] != '1')
 				) {//Incomplete/invalid escaped token
 					for (size_t n = 0; n < numTokens; n += 1) {
-						jsAlloc->free(tokens[n].token);
+						json_allocator_free(jsAlloc, tokens[n].token);
 					}
-					jsAlloc->free(tokens);
+					json_allocator_free(jsAlloc, tokens);
 					return NULL;
 				} else {
 					if (ptr[iK + 1] == '0') {
@@ -233,7 +397,8 @@ static reference_token* parse_json_pointer(
 	return tokens;
 }
 
-json_value* json_value_query(
+//Resolve a JSON Pointer; json_value_query() wraps it with probes
+static json_value* json_value_query_pointer(
 	json_parser_state* parserState,
 	json_value* value,
 	const char* query,
@@ -272,6 +437,7 @@ json_value* json_value_query(
 			json_array* arr = val->value;
 			const size_t maxDigits = 32;
 			char digits[32];
+			long index = -1;
 			if (!arr->size || token->tokenLen > maxDigits - 1) {
 				err = 1;
 				val = NULL;
@@ -282,7 +448,7 @@ json_value* json_value_query(
 							err = 1;
 							val = NULL;
 						} else {
-							val = arr->values[0];
+							index = 0;
 						}
 					}
 					break;
@@ -301,12 +467,10 @@ json_value* json_value_query(
 							digits[iK] = ptr[iK];
 						}
 						digits[tokenLen] = 0;
-						long index = strtol(digits, &ptr, 10);
+						index = strtol(digits, &ptr, 10);
 						if (!index || index == LONG_MAX || index >= arr->size || (ptr - digits) != tokenLen) {
 							err = 1;
 							val = NULL;
-						} else {
-							val = arr->values[index];
 						}
 					}
 					break;
@@ -318,31 +482,52 @@ json_value* json_value_query(
 					break;
 				}
 			}
+
+			if (!err && arr->numbers) {
+				//Materialize the element in the parser so the packed array is not modified
+				json_value* elemValue = &parserState->queryValue;
+				json_number* elemNumber = &parserState->queryNumber;
+				json_factory_init_json_number(elemNumber, arr->numbers[index], elemValue);
+				val = json_factory_init_json_value(elemValue, number_value, elemNumber, array_value, arr);
+			} else if (!err) {
+				val = arr->values[index];
+			}
 		} else if (val->valueType == object_value) {
 			json_object* obj = val->value;
 			bool matched = false;	//Did any obj name match
-			for (size_t iK = 0, numNames = obj->size; iK < numNames; iK += 1) {
-				const char* ptr = obj->names[iK]->value;
-				const size_t ptrLen = obj->names[iK]->valueLen;
-				bool noMatch = false;	//Did this obj name match
-
-				if (token->tokenLen == ptrLen) {
-					for (size_t n = 0; n < token->tokenLen && n < ptrLen; n += 1) {
-						if (ptr[n] != token->token[n]) {
-							noMatch = true;
-							break;
-						}
+			//Members sharing the interned name match by pointer
+			const json_string* interned = json_parser_find_name(parserState, token->token, token->tokenLen);
+			const uint32_t hash = (interned) ? ((const json_interned_string*) interned)->hash : json_hash_string(token->token, token->tokenLen);
+			if (obj->shape) {
+				const json_object_shape* shape = obj->shape;
+				size_t slot = hash & shape->tableMask;
+				while (shape->table[slot]) {
+					const size_t iK = shape->table[slot] - 1;
+					const json_string* name = shape->names[iK];
+					if (name == interned || (
+						shape->hashes[iK] == hash
+						&& name->valueLen == token->tokenLen
+						&& !memcmp(name->value, token->token, token->tokenLen)
+					)) {
+						matched = true;
+						val = obj->values[iK];
+						break;
 					}
-					if (noMatch) {
-						continue;
+					slot = (slot + 1) & shape->tableMask;
+				}
+			} else {
+				const json_object_member* member = obj->members;
+				for (const json_object_member* end = member + obj->size; member < end; member += 1) {
+					if (member->name == interned || (
+						member->hash == hash
+						&& member->name->valueLen == token->tokenLen
+						&& !memcmp(member->name->value, token->token, token->tokenLen)
+					)) {
+						matched = true;
+						val = member->value;
+						break;
 					}
-				} else {
-					continue;
 				}
-
-				matched = true;
-				val = obj->values[iK];
-				break;
 			}
 			if (!matched) {
 				err = 1;
@@ -359,25 +544,25 @@ json_value* json_value_query(
 	}
 
 	for (size_t k = 0; k < numTokens; k += 1) {
-		parserState->JSON_Allocator->free(tokens[k].token);
+		json_allocator_free(parserState->JSON_Allocator, tokens[k].token);
 	}
-	parserState->JSON_Allocator->free(tokens);
+	json_allocator_free(parserState->JSON_Allocator, tokens);
 	return val;
 }
 
-/* JSON stringify functions */
+json_value* json_value_query(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* query,
+	const size_t queryLen
+) {
+	JSON_PROBE2(query__start, query, queryLen);
+	json_value* val = json_value_query_pointer(parserState, value, query, queryLen);
+	JSON_PROBE3(query__done, query, queryLen, val);
+	return val;
+}
 
-/*! @cond */
-typedef struct json_string_buffer {
-	char* string;
-	size_t size;
-	size_t capacity;
-	const char* indent;
-	size_t indentLen;
-	size_t indentLevel;
-	int flags;
-} json_string_buffer;
-/*! @endcond */
+/* JSON stringify functions */
 
 int json_value_stringify_value(json_parser_state* parserState, json_string_buffer* strBuff, json_value* value);
 int json_value_stringify_object(json_parser_state* parserState, json_string_buffer* strBuff, json_object* obj);
@@ -385,162 +570,279 @@ int json_value_stringify_array(json_parser_state* parserState, json_string_buffe
 int json_value_stringify_string(json_parser_state* parserState, json_string_buffer* strBuff, json_string* str);
 int json_value_stringify_number(json_parser_state* parserState, json_string_buffer* strBuff, json_number* num);
 
-//Resize and copy contents over if necessary
-//addSize is the additional size needed for the string
-static int json_string_buffer_resize(json_parser_state* parserState, json_string_buffer* strBuff, const size_t addSize) {
-	int retVal = 1;
-	const size_t neededSize = strBuff->size + addSize;
-
-	if (neededSize > strBuff->capacity) {
-		char* tmpStr = NULL;
-		size_t newCap = align_offset(strBuff->capacity * JSON_STR_BUFF_INCR_SIZE, 16);
-
-		//Try to maintain constant growth of capacity
-		//If inadequate, grow from neededSize
-		if (newCap < neededSize) {
-			newCap = align_offset(neededSize * JSON_STR_BUFF_INCR_SIZE, 16);
-		}
-
-		tmpStr = parserState->JSON_Allocator->malloc(sizeof(char) * newCap);
+//Stringify into memory from the allocator; json_value_stringify() wraps it with probes
+static char* json_value_stringify_growable(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	size_t* strLen
+) {
+	if (!parserState || !value || !strLen) {
+		return NULL;
+	}
 
-		if (!tmpStr) {
-			return retVal;
-		}
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.string = json_allocator_malloc(parserState->JSON_Allocator, sizeof(char) * JSON_STR_BUFF_INIT_SIZE);
+	if (!strBuff.string) {
+		return NULL;
+	}
+	strBuff.capacity = JSON_STR_BUFF_INIT_SIZE;
 
-		char* ptr = strBuff->string;
-		for (size_t k = 0, n = strBuff->size; k < n; k += 1) {
-			tmpStr[k] = ptr[k];
-		}
+	int retVal = json_value_stringify_value(parserState, &strBuff, value);
+	if (strBuff.indentBuffer) {
+		json_allocator_free(parserState->JSON_Allocator, strBuff.indentBuffer);
+	}
+	if (retVal) {
+		json_allocator_free(parserState->JSON_Allocator, strBuff.string);
+		return NULL;
+	}
 
-		strBuff->capacity = newCap;
-		parserState->JSON_Allocator->free(ptr);
-		strBuff->string = tmpStr;
+	retVal = json_string_buffer_append(parserState, &strBuff, "\0", 1);
+	if (retVal) {
+		json_allocator_free(parserState->JSON_Allocator, strBuff.string);
+		return NULL;
 	}
 
-	retVal = 0;
-	return retVal;
+	*strLen = strBuff.size;
+	return strBuff.string;
 }
 
-//Append to the buffer
-static int json_string_buffer_append(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const size_t strLen) {
+char* json_value_stringify(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	size_t* strLen
+) {
+	JSON_PROBE2(stringify__start, value, flags);
+	char* str = json_value_stringify_growable(parserState, value, indent, flags, strLen);
+	JSON_PROBE2(stringify__done, value, (str) ? *strLen : 0);
+	return str;
+}
+
+int json_value_stringify_to_sink(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	json_stringify_write_cb writeCb,
+	void* ctx
+) {
 	int retVal = 1;
+	if (!parserState || !value || !writeCb) {
+		return retVal;
+	}
 
-	retVal = json_string_buffer_resize(parserState, strBuff, strLen);
-	if (retVal) {
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.mode = json_buffer_sink;
+	strBuff.write = writeCb;
+	strBuff.writeCtx = ctx;
+	strBuff.string = json_allocator_malloc(parserState->JSON_Allocator, sizeof(char) * JSON_STR_BUFF_SINK_SIZE);
+	if (!strBuff.string) {
 		return retVal;
 	}
+	strBuff.capacity = JSON_STR_BUFF_SINK_SIZE;
 
-	char* ptr = strBuff->string;
-	for (size_t k = strBuff->size, n = k + strLen, m = 0; k < n; k += 1, m += 1) {
-		ptr[k] = str[m];
+	retVal = json_value_stringify_value(parserState, &strBuff, value);
+	if (!retVal) {
+		retVal = json_string_buffer_flush(&strBuff);
 	}
 
-	strBuff->size += strLen;
+	if (strBuff.indentBuffer) {
+		json_allocator_free(parserState->JSON_Allocator, strBuff.indentBuffer);
+	}
+	json_allocator_free(parserState->JSON_Allocator, strBuff.string);
 
-	retVal = 0;
 	return retVal;
 }
 
-//Append to the buffer escaped
-static int json_string_buffer_append_escaped(json_parser_state* parserState, json_string_buffer* strBuff, const char* str) {
-	int retVal = 1;
-
-	const size_t buffLen = 32;
-	char buff[32];
-	const uint8_t* ptr = (uint8_t*) str;
-	uint32_t c1 = ptr[0];
-	bool withinBMP = true;
-	uint32_t codePoint = 0;
-
-	if (c1 < 0x80) {
-		codePoint = c1;
-	} else if (c1 >= 0xC0 && c1 < 0xE0) {
-		codePoint = ((c1 & 0x1F) << 6) + (ptr[1] & 0x3F);
-	} else if (c1 >= 0xE0 && c1 < 0xF0) {
-		codePoint = ((c1 & 0x0F) << 12) + ((ptr[1] & 0x3F) << 6) + (ptr[2] & 0x3F);
-	} else if (c1 >= 0xF0) {
-		withinBMP = false;
-		codePoint = ((c1 & 0x07) << 18) + ((ptr[1] & 0x3F) << 12) + ((ptr[2] & 0x3F) << 6) + (ptr[3] & 0x3F);
-	} else {
-		return retVal;
+size_t json_value_stringify_size(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags
+) {
+	if (!parserState || !value) {
+		return 0;
 	}
 
-	int ret = 0;
-	if (withinBMP) {
-		ret = snprintf(buff, buffLen, "\\u%04X", codePoint);
-		if (ret < 0 || ret >= buffLen) {
-			return retVal;
-		}
-	} else {
-		const uint32_t cp = codePoint - 0x10000;
-		const uint16_t high = 0xD800 + (cp >> 10);
-		const uint16_t low = 0xDC00 + (cp & 0x3FF);
-		ret = snprintf(buff, buffLen, "\\u%04" PRIX16 "\\u%04" PRIX16, high, low);
-		if (ret < 0 || ret >= buffLen) {
-			return retVal;
-		}
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.mode = json_buffer_count;
+
+	if (json_value_stringify_value(parserState, &strBuff, value)) {
+		return 0;
 	}
 
-	return json_string_buffer_append(parserState, strBuff, buff, ret);
+	//Include the null terminator like json_value_stringify()
+	return strBuff.size + 1;
 }
 
-//Indent the buffer
-static int json_string_buffer_indent(json_parser_state* parserState, json_string_buffer* strBuff, const char* indent, const size_t indentLen, const size_t num) {
+int json_value_stringify_into(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	char* buff,
+	size_t buffLen,
+	size_t* strLen
+) {
 	int retVal = 1;
+	if (!parserState || !value || !buff || !buffLen) {
+		return retVal;
+	}
+
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.mode = json_buffer_fixed;
+	strBuff.string = buff;
+	strBuff.capacity = buffLen;
 
-	retVal = json_string_buffer_resize(parserState, strBuff, indentLen * num);
+	retVal = json_value_stringify_value(parserState, &strBuff, value);
+	if (!retVal) {
+		retVal = json_string_buffer_append(parserState, &strBuff, "\0", 1);
+	}
 	if (retVal) {
 		return retVal;
 	}
 
-	for (size_t k = 0; k < num; k += 1) {
-		retVal = json_string_buffer_append(parserState, strBuff, indent, indentLen);
-		if (retVal) {
-			return retVal;
-		}
+	if (strLen) {
+		*strLen = strBuff.size;
 	}
 
 	retVal = 0;
 	return retVal;
 }
 
-char* json_value_stringify(
+int json_value_stringify_iov(
 	json_parser_state* parserState,
 	json_value* value,
 	const char* indent,
 	int flags,
-	size_t* strLen
+	json_stringify_iov* result
 ) {
-	if (!parserState || !value || !strLen) {
-		return NULL;
+	int retVal = 1;
+	if (!parserState || !value || !result) {
+		return retVal;
 	}
 
-	json_string_buffer strBuff = {NULL, 0, 0, indent ? indent : "\t", 0, 0, flags};
-	strBuff.string = parserState->JSON_Allocator->malloc(sizeof(char) * JSON_STR_BUFF_INIT_SIZE);
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.mode = json_buffer_iov;
+	strBuff.string = json_allocator_malloc(parserState->JSON_Allocator, sizeof(char) * JSON_STR_BUFF_INIT_SIZE);
 	if (!strBuff.string) {
-		return NULL;
+		return retVal;
 	}
 	strBuff.capacity = JSON_STR_BUFF_INIT_SIZE;
-	const char* tmp = strBuff.indent;
-	while (*tmp) {
-		strBuff.indentLen += 1;
-		tmp += 1;
-	}
 
-	int retVal = json_value_stringify_value(parserState, &strBuff, value);
+	retVal = json_value_stringify_value(parserState, &strBuff, value);
+	if (!retVal) {
+		retVal = json_string_buffer_close_iov(parserState, &strBuff);
+	}
+	if (strBuff.indentBuffer) {
+		json_allocator_free(parserState->JSON_Allocator, strBuff.indentBuffer);
+	}
 	if (retVal) {
-		parserState->JSON_Allocator->free(strBuff.string);
-		return NULL;
+		json_allocator_free(parserState->JSON_Allocator, strBuff.string);
+		if (strBuff.iov) {
+			json_allocator_free(parserState->JSON_Allocator, strBuff.iov);
+		}
+		return retVal;
 	}
 
-	retVal = json_string_buffer_append(parserState, &strBuff, "\0", 1);
-	if (retVal) {
-		parserState->JSON_Allocator->free(strBuff.string);
-		return NULL;
+	//The string buffer may have moved while growing, so its iovecs are resolved in order last
+	size_t scratchPos = 0;
+	size_t size = 0;
+	for (size_t k = 0; k < strBuff.iovLen; k += 1) {
+		if (!strBuff.iov[k].iov_base) {
+			strBuff.iov[k].iov_base = strBuff.string + scratchPos;
+			scratchPos += strBuff.iov[k].iov_len;
+		}
+		size += strBuff.iov[k].iov_len;
 	}
 
-	*strLen = strBuff.size;
-	return strBuff.string;
+	result->iov = strBuff.iov;
+	result->iovLen = strBuff.iovLen;
+	result->scratch = strBuff.string;
+	result->size = size;
+
+	retVal = 0;
+	return retVal;
+}
+
+void json_stringify_iov_clear(json_parser_state* parserState, json_stringify_iov* result) {
+	if (!parserState || !result) {
+		return;
+	}
+
+	if (result->iov) {
+		json_allocator_free(parserState->JSON_Allocator, result->iov);
+	}
+	if (result->scratch) {
+		json_allocator_free(parserState->JSON_Allocator, result->scratch);
+	}
+	result->iov = NULL;
+	result->iovLen = 0;
+	result->scratch = NULL;
+	result->size = 0;
+}
+
+//Sink writing to a FILE*
+static int json_stringify_write_file(void* ctx, const char* data, size_t dataLen) {
+	return fwrite(data, sizeof(char), dataLen, (FILE*) ctx) != dataLen;
+}
+
+int json_value_stringify_to_file(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	FILE* file
+) {
+	if (!file) {
+		return 1;
+	}
+
+	return json_value_stringify_to_sink(parserState, value, indent, flags, json_stringify_write_file, file);
+}
+
+#ifdef HAVE_UNISTD_H
+//Sink writing to a file descriptor, retrying partial and interrupted writes
+static int json_stringify_write_fd(void* ctx, const char* data, size_t dataLen) {
+	const int fd = *(const int*) ctx;
+	while (dataLen) {
+		const ssize_t bytes = write(fd, data, dataLen);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		} else if (bytes <= 0) {
+			return 1;
+		}
+		data += bytes;
+		dataLen -= bytes;
+	}
+	return 0;
+}
+#endif	//#ifdef HAVE_UNISTD_H
+
+int json_value_stringify_to_fd(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	int fd
+) {
+#ifdef HAVE_UNISTD_H
+	if (fd < 0) {
+		return 1;
+	}
+
+	return json_value_stringify_to_sink(parserState, value, indent, flags, json_stringify_write_fd, &fd);
+#else
+	return 1;
+#endif	//#ifdef HAVE_UNISTD_H
 }
 
 int json_value_stringify_value(
@@ -556,6 +858,15 @@ int json_value_stringify_value(
 
 	switch (value->valueType) {
 		case object_value: {
+			const json_object* obj = value->value;
+			if ((flags & json_stringify_source_spans) && obj->source) {
+				retVal = json_string_buffer_append_ref(parserState, strBuff, obj->source, obj->sourceLen);
+				if (retVal) {
+					return retVal;
+				}
+				break;
+			}
+
 			retVal = json_string_buffer_append(parserState, strBuff, &JSON_TOKEN_NAMES[json_token_lbrace], 1);
 			if (retVal) {
 				return retVal;
@@ -581,6 +892,15 @@ int json_value_stringify_value(
 		}
 		break;
 		case array_value: {
+			const json_array* arr = value->value;
+			if ((flags & json_stringify_source_spans) && arr->source) {
+				retVal = json_string_buffer_append_ref(parserState, strBuff, arr->source, arr->sourceLen);
+				if (retVal) {
+					return retVal;
+				}
+				break;
+			}
+
 			retVal = json_string_buffer_append(parserState, strBuff, &JSON_TOKEN_NAMES[json_token_lbrack], 1);
 			if (retVal) {
 				return retVal;
@@ -649,6 +969,78 @@ int json_value_stringify_value(
 	return retVal;
 }
 
+//Compare two UTF-8 strings by their UTF-16 code units, as required for canonical output
+//UTF-8 byte order matches code point order, which differs from UTF-16 order only
+//in that U+E000 to U+FFFF sort after the surrogate pairs of U+10000 and above
+static int json_string_compare_utf16(const json_string* a, const json_string* b) {
+	const uint8_t* aPtr = (const uint8_t*) a->value;
+	const uint8_t* bPtr = (const uint8_t*) b->value;
+	const size_t len = (a->valueLen < b->valueLen) ? a->valueLen : b->valueLen;
+
+	for (size_t k = 0; k < len; k += 1) {
+		const uint8_t aByte = aPtr[k];
+		const uint8_t bByte = bPtr[k];
+		if (aByte == bByte) {
+			continue;
+		}
+		//Lead bytes 0xEE and 0xEF start U+E000 to U+FFFF, 0xF0 and above start U+10000 and above
+		if (aByte >= 0xEE && aByte <= 0xEF && bByte >= 0xF0) {
+			return 1;
+		} else if (bByte >= 0xEE && bByte <= 0xEF && aByte >= 0xF0) {
+			return -1;
+		}
+		return (aByte < bByte) ? -1 : 1;
+	}
+
+	if (a->valueLen == b->valueLen) {
+		return 0;
+	}
+	return (a->valueLen < b->valueLen) ? -1 : 1;
+}
+
+static int json_object_member_compare_utf16(const void* a, const void* b) {
+	return json_string_compare_utf16(((const json_object_member*) a)->name, ((const json_object_member*) b)->name);
+}
+
+//Returns whether the members of the object are in canonical order
+static bool json_object_is_sorted_utf16(const json_object* obj) {
+	for (size_t k = 1; k < obj->size; k += 1) {
+		const json_string* prev = (obj->shape) ? obj->shape->names[k - 1] : obj->members[k - 1].name;
+		const json_string* name = (obj->shape) ? obj->shape->names[k] : obj->members[k].name;
+		if (json_string_compare_utf16(prev, name) > 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Stringify the members of an object in canonical order through a sorted copy
+static int json_value_stringify_sorted_object(json_parser_state* parserState, json_string_buffer* strBuff, json_object* obj) {
+	int retVal = 1;
+
+	json_object_member* members = json_allocator_malloc(parserState->JSON_Allocator, sizeof(json_object_member) * obj->size);
+	if (!members) {
+		return retVal;
+	}
+	for (size_t k = 0; k < obj->size; k += 1) {
+		members[k].name = (obj->shape) ? obj->shape->names[k] : obj->members[k].name;
+		members[k].value = (obj->shape) ? obj->values[k] : obj->members[k].value;
+		members[k].hash = 0;
+		members[k].flags = 0;
+	}
+	qsort(members, obj->size, sizeof(json_object_member), json_object_member_compare_utf16);
+
+	json_object sorted = *obj;
+	sorted.members = members;
+	sorted.shape = NULL;
+	sorted.values = NULL;
+	retVal = json_value_stringify_object(parserState, strBuff, &sorted);
+
+	json_allocator_free(parserState->JSON_Allocator, members);
+	return retVal;
+}
+
 int json_value_stringify_object(
 	json_parser_state* parserState,
 	json_string_buffer* strBuff,
@@ -657,6 +1049,10 @@ int json_value_stringify_object(
 	int retVal = 1;
 	const int flags = strBuff->flags;
 
+	if ((flags & json_stringify_canonical) && !json_object_is_sorted_utf16(obj)) {
+		return json_value_stringify_sorted_object(parserState, strBuff, obj);
+	}
+
 	if (flags & json_stringify_indent) {
 		retVal = json_string_buffer_append(parserState, strBuff, "\n", 1);
 		if (retVal) {
@@ -672,7 +1068,7 @@ int json_value_stringify_object(
 			}
 		}
 
-		retVal = json_value_stringify_string(parserState, strBuff, obj->names[k]);
+		retVal = json_value_stringify_string(parserState, strBuff, (obj->shape) ? obj->shape->names[k] : obj->members[k].name);
 		if (retVal) {
 			return retVal;
 		}
@@ -689,7 +1085,7 @@ int json_value_stringify_object(
 			}
 		}
 
-		retVal = json_value_stringify_value(parserState, strBuff, obj->values[k]);
+		retVal = json_value_stringify_value(parserState, strBuff, (obj->shape) ? obj->values[k] : obj->members[k].value);
 		if (retVal) {
 			return retVal;
 		}
@@ -747,7 +1143,11 @@ int json_value_stringify_array(
 				return retVal;
 			}
 		}
-		retVal = json_value_stringify_value(parserState, strBuff, arr->values[k]);
+		if (arr->numbers) {
+			retVal = json_string_buffer_append_number(parserState, strBuff, arr->numbers[k]);
+		} else {
+			retVal = json_value_stringify_value(parserState, strBuff, arr->values[k]);
+		}
 		if (retVal) {
 			return retVal;
 		}
@@ -783,72 +1183,12 @@ int json_value_stringify_array(
 	return retVal;
 }
 
-//TODO: Handle flags regarding Unicode escapes in strings
 int json_value_stringify_string(
 	json_parser_state* parserState,
 	json_string_buffer* strBuff,
 	json_string* str
 ) {
-	int retVal = 1;
-	const int flags = strBuff->flags;
-
-	retVal = json_string_buffer_append(parserState, strBuff, "\"", 1);
-	if (retVal) {
-		return retVal;
-	}
-
-	const char* ptr = str->value;
-	const size_t ptrLen = str->valueLen;
-	size_t pos = 0;
-	bool escapeNonAscii = flags & json_stringify_escape_non_ascii;
-	bool escapeNonBmp = flags & json_stringify_escape_non_bmp;
-
-	while (pos < ptrLen) {
-		uint8_t c1 = ptr[pos];
-		bool needEscape = false;
-		size_t incr = 1;
-
-		if (c1 < 0x1F) {
-			needEscape = true;
-			incr = 1;
-		} else if (c1 < 0x80) {
-			needEscape = false;
-			incr = 1;
-		} else if (c1 >= 0xC0 && c1 < 0xE0 && (pos + 1 < ptrLen)) {
-			needEscape = escapeNonAscii;
-			incr = 2;
-		} else if (c1 >= 0xE0 && c1 < 0xF0 && (pos + 2 < ptrLen)) {
-			needEscape = escapeNonAscii;
-			incr = 3;
-		} else if (c1 >= 0xF0 && (pos + 3 < ptrLen)) {
-			needEscape = escapeNonAscii || escapeNonBmp;
-			incr = 4;
-		} else {
-			return retVal;
-		}
-
-		if (needEscape) {
-			retVal = json_string_buffer_append_escaped(parserState, strBuff, ptr + pos);
-			if (retVal) {
-				return retVal;
-			}
-		} else {
-			retVal = json_string_buffer_append(parserState, strBuff, ptr + pos, incr);
-			if (retVal) {
-				return retVal;
-			}
-		}
-
-		pos += incr;
-	}
-
-	retVal = json_string_buffer_append(parserState, strBuff, "\"", 1);
-	if (retVal) {
-		return retVal;
-	}
-
-	retVal = 0;
-	return retVal;
+	return json_string_buffer_append_string(parserState, strBuff, str->value, str->valueLen);
 }
 
 int json_value_stringify_number(
@@ -856,22 +1196,7 @@ int json_value_stringify_number(
 	json_string_buffer* strBuff,
 	json_number* num
 ) {
-	int retVal = 1;
-	const size_t buffLen = 128;
-	char buff[128];
-
-	int bytes = snprintf(buff, buffLen, "%.16g", num->value);
-	if (bytes < 1 || bytes >= buffLen) {
-		return retVal;
-	}
-
-	retVal = json_string_buffer_append(parserState, strBuff, buff, bytes);
-	if (retVal) {
-		return retVal;
-	}
-
-	retVal = 0;
-	return retVal;
+	return json_string_buffer_append_number(parserState, strBuff, num->value);
 }
 
 
@@ -33,6 +33,7 @@
 
 
 #include "json_types.h"
+#include <stdio.h>
 
 
 #ifdef __cplusplus
@@ -44,6 +45,35 @@ extern "C" {
 typedef int (*json_object_foreach_cb)(json_object*, json_string*, json_value*);
 /*! Prototype for a callback function used with json_array_foreach() */
 typedef int (*json_array_foreach_cb)(json_array*, json_value*);
+/*! Prototype for a callback function receiving output of json_value_stringify_to_sink(); returns zero on success */
+typedef int (*json_stringify_write_cb)(void* ctx, const char* data, size_t dataLen);
+
+/**
+ *  @brief Struct representing a piece of output of json_value_stringify_iov()
+ *
+ *  The layout matches POSIX @c struct @c iovec, so an array of json_iovec can be
+ *  passed to @c writev() or @c sendmsg() with a cast.
+ */
+typedef struct json_iovec {
+	/*! Start of the piece */
+	void* iov_base;
+	/*! Length of the piece in bytes */
+	size_t iov_len;
+} json_iovec;
+
+/**
+ *  @brief Struct representing the output of json_value_stringify_iov()
+ */
+typedef struct json_stringify_iov {
+	/*! Array of pieces of the output, in order */
+	json_iovec* iov;
+	/*! Number of pieces in @p iov */
+	size_t iovLen;
+	/*! Buffer holding the generated pieces */
+	char* scratch;
+	/*! Total length of the output in bytes */
+	size_t size;
+} json_stringify_iov;
 
 /*@{ */
 /**
@@ -81,6 +111,9 @@ int json_object_foreach_obj(json_object* obj, json_object_foreach_cb iter);
  *  json_value of each value in an array. The callback should match the prototype for
  *  json_array_foreach_cb and return nonzero to keep iterating or zero to stop.
  *
+ *  If the array is packed, the callback receives a temporary json_value holding each
+ *  number, which is only valid for the duration of the call.
+ *
  *  @param[in] val Pointer to json_value containing the json_array to iterate over
  *  @param[in] iter Callback function to iterate over array
  *  @return Zero on success, nonzero on failure
@@ -103,6 +136,71 @@ int json_array_foreach(json_value* val, json_array_foreach_cb iter);
 int json_array_foreach_arr(json_array* arr, json_array_foreach_cb iter);
 /*@} */
 
+/**
+ *  @brief Get the numbers of a packed array
+ *
+ *  Arrays that contain only numbers are stored packed when the json_pack_number_arrays
+ *  option is set. This function returns a pointer to the numbers of such an array, and
+ *  places the number of elements in @p len.
+ *
+ *  @param[in] arr Pointer to the json_array
+ *  @param[out] len Pointer to a @c size_t to receive the number of elements, or @c NULL
+ *  @return Pointer to the numbers of the array, or @c NULL if the array isn't packed
+ */
+const double* json_array_get_numbers(json_array* arr, size_t* len);
+
+/**
+ *  @brief Memory used by a tree of JSON values, by kind of allocation
+ *
+ *  All sizes are in bytes as requested from the allocator, without the overhead
+ *  of the allocator itself. The text of strings is counted at its unescaped
+ *  length plus the terminator, which may be less than was allocated for strings
+ *  that contained escapes.
+ *
+ *  @see json_value_memory_usage()
+ */
+typedef struct json_memory_usage {
+	/*@{ */
+	/*! Number of json_value structs */
+	size_t valueCount;
+	/*! Bytes of json_value structs */
+	size_t values;
+	/*! Bytes of json_object structs */
+	size_t objects;
+	/*! Bytes of the member and value arrays of objects, by capacity */
+	size_t objectMembers;
+	/*! Bytes of shapes and their names, divided among the objects sharing them */
+	size_t shapes;
+	/*! Bytes of json_array structs */
+	size_t arrays;
+	/*! Bytes of the value and number arrays of arrays, by capacity */
+	size_t arrayElements;
+	/*! Bytes of json_string structs of string values and member names */
+	size_t strings;
+	/*! Bytes of the text of string values and member names */
+	size_t stringBytes;
+	/*! Bytes of json_number structs */
+	size_t numbers;
+	/*! Bytes of json_true, json_false and json_null structs */
+	size_t literals;
+	/*! Sum of the bytes of all of the above */
+	size_t total;
+	/*@} */
+} json_memory_usage;
+
+/**
+ *  @brief Measure the memory used by a tree of JSON values
+ *
+ *  This function walks @p value and its children and fills @p usage with the
+ *  memory they use. Interned names are owned by the parser, see
+ *  json_intern_names, and aren't counted.
+ *
+ *  @param value A pointer to the json_value to measure
+ *  @param[out] usage Pointer to a json_memory_usage to receive the sizes
+ *  @return Zero on success, nonzero on failure
+ */
+int json_value_memory_usage(json_value* value, json_memory_usage* usage);
+
 /**
  *  @brief Query a JSON value with JSON Pointer
  *
@@ -117,6 +215,11 @@ int json_array_foreach_arr(json_array* arr, json_array_foreach_cb iter);
  *  control characters, the length of the query string must be passed
  *  to accomodate the null Unicode character.
  *
+ *  Querying an element of a packed array does not modify the array. The
+ *  json_value returned for the element is owned by @p parserState and is
+ *  only valid until the next query with @p parserState; it must not be
+ *  freed or modified.
+ *
  *  @param parserState A pointer to the parser isntance
  *  @param value A pointer to the json_value to query from
  *  @param query A string containing the query
@@ -145,7 +248,11 @@ enum JSON_STRINGIFY_FLAGS {
 	/*! Escape chars outside of Unicode BMP to \\uXXXX\\uXXXX UTF-16 surrogate pairs */
 	json_stringify_escape_non_bmp = 4,
 	/*! Escape all chars outside ASCII to \\uXXXX, implies json_stringify_escape_non_bmp  */
-	json_stringify_escape_non_ascii = 8
+	json_stringify_escape_non_ascii = 8,
+	/*! Copy the recorded source text of unmodified objects and arrays, see json_record_source_spans; their original whitespace and escapes are kept, so json_stringify_indent and json_stringify_spaces are not applied inside them; ignored with json_stringify_escape_non_bmp or json_stringify_escape_non_ascii */
+	json_stringify_source_spans = 16,
+	/*! Canonical output of RFC 8785 (JCS): no whitespace, members sorted by UTF-16 code units, minimal escapes with lowercase hex, and shortest numbers with @c 0 for negative zero; NaN and infinities fail; overrides the other flags */
+	json_stringify_canonical = 32
 };
 
 /**
@@ -175,6 +282,162 @@ enum JSON_STRINGIFY_FLAGS {
 	size_t* strLen
 );
 
+/**
+ *  @brief Compute the size of the stringified JSON value
+ *
+ *  This function computes the exact size of the output of json_value_stringify()
+ *  for the same arguments, including the @c null terminator, without writing
+ *  or allocating the output. It can be used to size the buffer given to
+ *  json_value_stringify_into().
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @return The size of the output including the @c null terminator, or zero on failure
+ */
+size_t json_value_stringify_size(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags
+);
+
+/**
+ *  @brief Stringify a JSON value into a caller-supplied buffer
+ *
+ *  This function writes the output of json_value_stringify(), including the
+ *  @c null terminator, into @p buff without allocating any memory. It fails
+ *  if the output doesn't fit in @p buffLen bytes, in which case the contents
+ *  of @p buff are unspecified. See json_value_stringify_size().
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param[out] buff The buffer to write to
+ *  @param buffLen Size of @p buff in bytes
+ *  @param[out] strLen A pointer to a @c size_t to receive the length written including the @c null terminator, or @c NULL
+ *  @return Zero on success, nonzero on failure
+ */
+int json_value_stringify_into(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	char* buff,
+	size_t buffLen,
+	size_t* strLen
+);
+
+/**
+ *  @brief Stringify a JSON value to a callback in bounded memory
+ *
+ *  This function produces the same text as json_value_stringify(), without
+ *  the @c null terminator, but writes it to @p writeCb through a fixed-size
+ *  buffer instead of building the whole string in memory. Output is written as
+ *  soon as the buffer fills, and strings longer than the buffer are passed to
+ *  @p writeCb directly.
+ *
+ *  @p writeCb receives @p ctx and the next chunk of output, and returns zero on
+ *  success or nonzero to stop stringifying with an error.
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param writeCb Callback function receiving the output
+ *  @param ctx Pointer passed to @p writeCb
+ *  @return Zero on success, nonzero on failure
+ *
+ *  @see json_value_stringify_to_file() json_value_stringify_to_fd()
+ */
+int json_value_stringify_to_sink(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	json_stringify_write_cb writeCb,
+	void* ctx
+);
+
+/**
+ *  @brief Stringify a JSON value into a scatter-gather list
+ *
+ *  This function produces the output of json_value_stringify(), without the
+ *  @c null terminator, as an array of pieces in @p result. Punctuation, numbers
+ *  and escapes are generated into a scratch buffer, while long runs of string
+ *  values that need no escaping are referenced directly from json_string::value
+ *  instead of being copied. The referenced memory must stay valid and unchanged
+ *  while the pieces are in use.
+ *
+ *  The pieces and scratch buffer are allocated from the parser's allocator and
+ *  must be released with json_stringify_iov_clear().
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param[out] result Pointer to a json_stringify_iov to receive the output
+ *  @return Zero on success, nonzero on failure
+ */
+int json_value_stringify_iov(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	json_stringify_iov* result
+);
+
+/**
+ *  @brief Free the output of json_value_stringify_iov()
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param result Pointer to the json_stringify_iov to clear
+ */
+void json_stringify_iov_clear(json_parser_state* parserState, json_stringify_iov* result);
+
+/**
+ *  @brief Stringify a JSON value to a stream
+ *
+ *  Writes the output of json_value_stringify_to_sink() to @p file with @c fwrite().
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param file The stream to write to
+ *  @return Zero on success, nonzero on failure
+ */
+int json_value_stringify_to_file(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	FILE* file
+);
+
+/**
+ *  @brief Stringify a JSON value to a file descriptor
+ *
+ *  Writes the output of json_value_stringify_to_sink() to @p fd with @c write(),
+ *  retrying partial and interrupted writes. Fails on platforms without @c unistd.h.
+ *
+ *  @param parserState A pointer to the parser instance
+ *  @param value A pointer to the json_value to stringify
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param fd The file descriptor to write to
+ *  @return Zero on success, nonzero on failure
+ */
+int json_value_stringify_to_fd(
+	json_parser_state* parserState,
+	json_value* value,
+	const char* indent,
+	int flags,
+	int fd
+);
+
 
 #ifdef __cplusplus
 }
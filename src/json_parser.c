@@ -22,6 +22,10 @@
 #include "json_parser.h"
 #include "json_types.h"
 #include "json_utils.h"
+#include "json_stats.h"
+#include "json_probes.h"
+#include "json_factory_inline.h"
+#include "json_simd.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -38,8 +42,21 @@ extern "C" {
 
 const size_t JSON_MAX_NESTED_DEFAULT = 128;
 
+static json_parser_state* json_parser_init_state(json_allocator* JSON_Allocator, json_factory* JSON_Factory);
 static void json_parser_skip_ws(json_parser_state* parserState);
+static int json_parser_index_containers(json_parser_state* parserState);
+static inline size_t json_parser_next_container_size(json_parser_state* parserState);
 static bool json_parser_expect(json_parser_state* parserState, const char c, const char* err);
+static inline bool json_parser_is_number_start(const char c);
+static inline bool json_parser_scan_number(json_parser_state* parserState, double* num);
+static int json_parser_parse_number_list(json_parser_state* parserState, json_array* arr);
+static void json_parser_share_shape(json_parser_state* parserState, json_object* obj);
+static void json_parser_release_shapes(json_parser_state* parserState);
+static bool json_parser_scan_string(json_parser_state* parserState, bool* hasEscape);
+static json_string* json_parser_parse_name(json_parser_state* parserState, uint32_t* hash, uint32_t* flags);
+static json_interned_string** json_parser_find_interned(json_parser_state* parserState, const char* name, const size_t nameLen, const uint32_t hash);
+static json_string* json_parser_intern_name(json_parser_state* parserState, const char* name, const size_t nameLen, const uint32_t hash);
+static void json_parser_release_names(json_parser_state* parserState);
 
 static inline int json_parser_check_state(json_parser_state* parserState, int state);
 static inline int json_parser_add_state(json_parser_state* parserState, int state);
@@ -69,6 +86,74 @@ int json_parser_setopt(json_parser_state* parserState, JSON_PARSER_OPT opt, ...)
 			parserState->errorStream = va_arg(args, FILE*);
 		}
 		break;
+		case json_realloc_function: {
+			realloc_function reallocFunction = va_arg(args, realloc_function);
+			//A json_allocator_ctx brings its own realloc function
+			if (parserState->JSON_Allocator->ctxMalloc) {
+				va_end(args);
+				return retVal;
+			}
+			parserState->JSON_Allocator->realloc = reallocFunction;
+		}
+		break;
+		case json_presize_containers: {
+			parserState->presizeContainers = va_arg(args, int);
+		}
+		break;
+		case json_pack_number_arrays: {
+			parserState->packNumberArrays = va_arg(args, int);
+		}
+		break;
+		case json_share_object_shapes: {
+			parserState->shareObjectShapes = va_arg(args, int);
+		}
+		break;
+		case json_intern_names: {
+			parserState->internNames = va_arg(args, int);
+		}
+		break;
+		case json_persist_interned_names: {
+			parserState->persistInternedNames = va_arg(args, int);
+		}
+		break;
+		case json_record_source_spans: {
+			parserState->recordSourceSpans = va_arg(args, int);
+		}
+		break;
+		case json_time_phases: {
+			const int timePhases = va_arg(args, int);
+#ifndef JSON_ENABLE_STATS
+			if (timePhases) {
+				va_end(args);
+				return retVal;
+			}
+#endif	//#ifndef JSON_ENABLE_STATS
+			if (timePhases && !parserState->timePhases) {
+				memset(&parserState->phaseStats, 0, sizeof(json_parser_phase_stats));
+			}
+			parserState->timePhases = timePhases;
+		}
+		break;
+		case json_node_pool_limit: {
+			int limit = va_arg(args, int);
+			if (limit < 0) {
+				va_end(args);
+				return retVal;
+			}
+			parserState->JSON_Factory->poolLimit = (size_t) limit;
+			json_factory_trim_pools(parserState->JSON_Factory, (size_t) limit);
+		}
+		break;
+		case json_cpu_level: {
+			int level = va_arg(args, int);
+			if (level < json_cpu_scalar || level > (int) json_cpu_detect()) {
+				va_end(args);
+				return retVal;
+			}
+			parserState->cpuLevel = (JSON_CPU_LEVEL) level;
+			parserState->kernels = json_simd_get_kernels(parserState->cpuLevel);
+		}
+		break;
 		default:
 		case JSON_PARSER_OPT_MAX:
 			va_end(args);
@@ -85,10 +170,29 @@ int json_parser_setopt(json_parser_state* parserState, JSON_PARSER_OPT opt, ...)
 json_parser_state* json_parser_init(alloc_function allocFunction, free_function freeFunction) {
 	json_allocator* JSON_Allocator;
 	json_factory* JSON_Factory;
-	json_types_init(allocFunction, freeFunction, &JSON_Allocator, &JSON_Factory);
+	if (json_types_init(allocFunction, freeFunction, &JSON_Allocator, &JSON_Factory)) {
+		return NULL;
+	}
 
-	json_parser_state* parserState = (json_parser_state*) JSON_Allocator->malloc(sizeof(json_parser_state));
+	return json_parser_init_state(JSON_Allocator, JSON_Factory);
+}
+
+json_parser_state* json_parser_init_ex(const json_allocator_ctx* ctxAlloc) {
+	json_allocator* JSON_Allocator;
+	json_factory* JSON_Factory;
+	if (json_types_init_ex(ctxAlloc, &JSON_Allocator, &JSON_Factory)) {
+		return NULL;
+	}
+
+	return json_parser_init_state(JSON_Allocator, JSON_Factory);
+}
+
+static json_parser_state* json_parser_init_state(json_allocator* JSON_Allocator, json_factory* JSON_Factory) {
+	json_parser_state* parserState = (json_parser_state*) json_allocator_malloc(JSON_Allocator, sizeof(json_parser_state));
 	if (!parserState) {
+		json_allocator_free_sized(JSON_Allocator, JSON_Factory, sizeof(json_factory));
+		json_allocator allocator = *JSON_Allocator;
+		json_allocator_free_sized(&allocator, JSON_Allocator, sizeof(json_allocator));
 		return NULL;
 	}
 
@@ -99,6 +203,27 @@ json_parser_state* json_parser_init(alloc_function allocFunction, free_function
 	parserState->nestedLevel = 0;
 	parserState->maxNestedLevel = JSON_MAX_NESTED_DEFAULT;
 	parserState->errorStream = stderr;
+	parserState->presizeContainers = 1;
+	parserState->containerSizes = NULL;
+	parserState->containerSizesLen = 0;
+	parserState->containerSizesCapacity = 0;
+	parserState->containerIndex = 0;
+	parserState->packNumberArrays = 0;
+	parserState->shareObjectShapes = 0;
+	parserState->shapeCache = NULL;
+	parserState->shapeCacheSize = 0;
+	parserState->shapeCacheCapacity = 0;
+	parserState->internNames = 0;
+	parserState->persistInternedNames = 0;
+	parserState->internTable = NULL;
+	parserState->internTableSize = 0;
+	parserState->internTableCapacity = 0;
+	parserState->recordSourceSpans = 0;
+	parserState->timePhases = 0;
+	parserState->defaultFactory = 0;
+	parserState->cpuLevel = json_cpu_detect();
+	parserState->kernels = json_simd_get_kernels(parserState->cpuLevel);
+	memset(&parserState->phaseStats, 0, sizeof(json_parser_phase_stats));
 
 	return parserState;
 }
@@ -108,10 +233,21 @@ int json_parser_clear(json_parser_state* parserState) {
 		return 1;
 	}
 
-	free_function freeFunction = parserState->JSON_Allocator->free;
-	freeFunction(parserState->JSON_Factory);
-	freeFunction(parserState->JSON_Allocator);
-	freeFunction(parserState);
+	//Free the allocator through a copy of itself
+	json_allocator allocator = *parserState->JSON_Allocator;
+	json_allocator_free_sized(&allocator, parserState->containerSizes, sizeof(uint32_t) * parserState->containerSizesCapacity);
+	if (parserState->shapeCache) {
+		json_parser_release_shapes(parserState);
+		json_allocator_free_sized(&allocator, parserState->shapeCache, sizeof(json_object_shape*) * parserState->shapeCacheCapacity);
+	}
+	if (parserState->internTable) {
+		json_parser_release_names(parserState);
+		json_allocator_free_sized(&allocator, parserState->internTable, sizeof(json_interned_string*) * parserState->internTableCapacity);
+	}
+	json_factory_trim_pools(parserState->JSON_Factory, 0);
+	json_allocator_free_sized(&allocator, parserState->JSON_Factory, sizeof(json_factory));
+	json_allocator_free_sized(&allocator, parserState->JSON_Allocator, sizeof(json_allocator));
+	json_allocator_free_sized(&allocator, parserState, sizeof(json_parser_state));
 
 	return 0;
 }
@@ -127,6 +263,8 @@ int json_parser_reset(json_parser_state* parserState) {
 	parserState->state = init_state;
 	parserState->nestedLevel = 0;
 	parserState->maxNestedLevel = JSON_MAX_NESTED_DEFAULT;
+	parserState->containerSizesLen = 0;
+	parserState->containerIndex = 0;
 
 	return 0;
 }
@@ -135,17 +273,46 @@ json_value* json_parser_parse(json_parser_state* parserState, const char* jsonSt
 	if (!parserState || !jsonStr || !jsonStrLength) {
 		return NULL;
 	}
+	JSON_PROBE2(parse__start, jsonStr, jsonStrLength);
+
+#ifdef JSON_ENABLE_STATS
+	const uint64_t parseStart = (parserState->timePhases) ? json_stats_ticks() : 0;
+#endif	//#ifdef JSON_ENABLE_STATS
 
 	parserState->jsonStr = jsonStr;
 	parserState->jsonStrLength = jsonStrLength;
+	parserState->defaultFactory = json_factory_is_default(parserState->JSON_Factory);
+
+	parserState->containerSizesLen = 0;
+	parserState->containerIndex = 0;
+	int indexed = 1;
+	if (parserState->presizeContainers) {
+		JSON_TIME_PHASE(parserState, json_phase_index, indexed = !json_parser_index_containers(parserState));
+	}
+	if (!indexed) {
+		//Containers will be grown as needed instead
+		parserState->containerSizesLen = 0;
+	}
 
 	json_value* topVal = json_parser_parse_value(parserState, NULL, unspecified_value);
+	json_parser_release_shapes(parserState);
+	if (!parserState->persistInternedNames) {
+		json_parser_release_names(parserState);
+	}
+#ifdef JSON_ENABLE_STATS
+	if (parserState->timePhases) {
+		parserState->phaseStats.parseTicks += json_stats_ticks() - parseStart;
+		parserState->phaseStats.parses += 1;
+	}
+#endif	//#ifdef JSON_ENABLE_STATS
 	if (!topVal) {
 		json_parser_add_state(parserState, error_state);
+		JSON_PROBE3(parse__done, jsonStrLength, parserState->state, topVal);
 		return NULL;
 	}
 
 	json_parser_add_state(parserState, complete_state);
+	JSON_PROBE3(parse__done, jsonStrLength, parserState->state, topVal);
 
 	return topVal;
 }
@@ -162,6 +329,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 
 	switch (parserState->jsonStr[parserState->jsonStrPos]) {
 		case '{': {
+			const size_t sourcePos = parserState->jsonStrPos;
 			parserState->jsonStrPos += 1;
 			if (parserState->nestedLevel < parserState->maxNestedLevel) {
 				parserState->nestedLevel += 1;
@@ -173,7 +341,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 				json_parser_add_state(parserState, error_state);
 				return NULL;
 			}
-			val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, object_value, NULL, unspecified_value, NULL);
+			JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, object_value, NULL, unspecified_value, NULL));
 			if (!val) {
 				json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 				json_parser_add_state(parserState, error_state);
@@ -181,18 +349,23 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			}
 			json_object* obj = json_parser_parse_object(parserState, val);
 			if (!obj) {
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			} else if (json_parser_check_state(parserState, error_state)) {
 				json_visitor_free_object(parserState->JSON_Factory, obj);
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			}
 			val->value = obj;
+			if (parserState->recordSourceSpans) {
+				obj->source = parserState->jsonStr + sourcePos;
+				obj->sourceLen = parserState->jsonStrPos - sourcePos;
+			}
 			parserState->nestedLevel -= 1;
 		}
 		break;
 		case '[': {
+			const size_t sourcePos = parserState->jsonStrPos;
 			parserState->jsonStrPos += 1;
 			if (parserState->nestedLevel < parserState->maxNestedLevel) {
 				parserState->nestedLevel += 1;
@@ -204,7 +377,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 				json_parser_add_state(parserState, error_state);
 				return NULL;
 			}
-			val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, array_value, NULL, unspecified_value, NULL);
+			JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, array_value, NULL, unspecified_value, NULL));
 			if (!val) {
 				json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 				json_parser_add_state(parserState, error_state);
@@ -212,19 +385,23 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			}
 			json_array* arr = json_parser_parse_array(parserState, val);
 			if (!arr) {
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			} else if (json_parser_check_state(parserState, error_state)) {
 				json_visitor_free_array(parserState->JSON_Factory, arr);
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			}
 			val->value = arr;
+			if (parserState->recordSourceSpans) {
+				arr->source = parserState->jsonStr + sourcePos;
+				arr->sourceLen = parserState->jsonStrPos - sourcePos;
+			}
 			parserState->nestedLevel -= 1;
 		}
 		break;
 		case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9': case '-': {
-			val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, number_value, NULL, unspecified_value, NULL);
+			JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, number_value, NULL, unspecified_value, NULL));
 			if (!val) {
 				json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 				json_parser_add_state(parserState, error_state);
@@ -232,7 +409,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			}
 			json_number* num = json_parser_parse_number(parserState, val);
 			if (!num) {
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			}
 			val->value = num;
@@ -240,7 +417,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 		break;
 		case '"': {
 			parserState->jsonStrPos += 1;
-			val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, string_value, NULL, unspecified_value, NULL);
+			JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, string_value, NULL, unspecified_value, NULL));
 			if (!val) {
 				json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 				json_parser_add_state(parserState, error_state);
@@ -248,7 +425,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			}
 			json_string* str = json_parser_parse_string(parserState, val);
 			if (!str) {
-				parserState->JSON_Allocator->free(val);
+				json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 				return NULL;
 			}
 			val->value = str;
@@ -258,7 +435,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			const size_t jsonStrPos = parserState->jsonStrPos;
 			const char* jsonStr = parserState->jsonStr + jsonStrPos;
 			if (parserState->jsonStrLength >= (jsonStrPos + 4) && strstr(jsonStr, JSON_VALUE_NAMES[true_value]) == jsonStr) {
-				val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, true_value, NULL, unspecified_value, NULL);
+				JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, true_value, NULL, unspecified_value, NULL));
 				if (!val) {
 					json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 					json_parser_add_state(parserState, error_state);
@@ -266,7 +443,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 				}
 				json_true* tru = json_parser_parse_true(parserState, val);
 				if (!tru) {
-					parserState->JSON_Allocator->free(val);
+					json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 					return NULL;
 				}
 				val->value = tru;
@@ -280,7 +457,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			const size_t jsonStrPos = parserState->jsonStrPos;
 			const char* jsonStr = parserState->jsonStr + jsonStrPos;
 			if (parserState->jsonStrLength >= (jsonStrPos + 5) && strstr(jsonStr, JSON_VALUE_NAMES[false_value]) == jsonStr) {
-				val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, false_value, NULL, unspecified_value, NULL);
+				JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, false_value, NULL, unspecified_value, NULL));
 				if (!val) {
 					json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 					json_parser_add_state(parserState, error_state);
@@ -288,7 +465,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 				}
 				json_false* fals = json_parser_parse_false(parserState, val);
 				if (!fals) {
-					parserState->JSON_Allocator->free(val);
+					json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 					return NULL;
 				}
 				val->value = fals;
@@ -302,7 +479,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 			const size_t jsonStrPos = parserState->jsonStrPos;
 			const char* jsonStr = parserState->jsonStr + jsonStrPos;
 			if (parserState->jsonStrLength >= (jsonStrPos + 4) && strstr(jsonStr, JSON_VALUE_NAMES[null_value]) == jsonStr) {
-				val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, null_value, NULL, unspecified_value, NULL);
+				JSON_TIME_PHASE(parserState, json_phase_allocation, val = JSON_NEW_NODE(parserState, value, json_pool_value, null_value, NULL, unspecified_value, NULL));
 				if (!val) {
 					json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_value\n", parserState);
 					json_parser_add_state(parserState, error_state);
@@ -310,7 +487,7 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 				}
 				json_null* nul = json_parser_parse_null(parserState, val);
 				if (!nul) {
-					parserState->JSON_Allocator->free(val);
+					json_factory_free_node(parserState->JSON_Factory, json_pool_value, val, sizeof(json_value));
 					return NULL;
 				}
 				val->value = nul;
@@ -340,11 +517,12 @@ json_value* json_parser_parse_value(json_parser_state* parserState, void* parent
 
 json_object* json_parser_parse_object(json_parser_state* parserState, json_value* parentValue) {
 	json_object* obj = NULL;
+	const size_t sizeHint = json_parser_next_container_size(parserState);
 	json_parser_skip_ws(parserState);
 
 	//Empty object case "{}"
 	if (parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_rbrace]) {
-		obj = parserState->JSON_Factory->new_json_object(parserState->JSON_Factory, parentValue);
+		JSON_TIME_PHASE(parserState, json_phase_allocation, obj = JSON_NEW_NODE(parserState, object, json_pool_object, parentValue));
 		if (!obj) {
 			json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_object\n", parserState);
 			json_parser_add_state(parserState, error_state);
@@ -354,13 +532,19 @@ json_object* json_parser_parse_object(json_parser_state* parserState, json_value
 		return obj;
 	}
 
-	obj = parserState->JSON_Factory->new_json_object(parserState->JSON_Factory, parentValue);
+	JSON_TIME_PHASE(parserState, json_phase_allocation, obj = JSON_NEW_NODE(parserState, object, json_pool_object, parentValue));
 	if (!obj) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_object\n", parserState);
 		json_parser_add_state(parserState, error_state);
 		return NULL;
 	}
 
+	if (sizeHint && json_object_reserve(parserState->JSON_Factory, obj, sizeHint)) {
+		json_error_lineno("json_parser:%u:%u Error: json_object_reserve()\n", parserState);
+		json_parser_add_state(parserState, error_state);
+		return obj;
+	}
+
 	do {
 		//Parse Pair: json_string ':' json_value
 		json_parser_skip_ws(parserState);
@@ -370,7 +554,9 @@ json_object* json_parser_parse_object(json_parser_state* parserState, json_value
 		}
 		parserState->jsonStrPos += 1;
 
-		json_string* str = json_parser_parse_string(parserState, NULL);
+		uint32_t hash = 0;
+		uint32_t flags = 0;
+		json_string* str = json_parser_parse_name(parserState, &hash, &flags);
 		if (!str) {
 			return obj;
 		}
@@ -378,7 +564,7 @@ json_object* json_parser_parse_object(json_parser_state* parserState, json_value
 		json_parser_skip_ws(parserState);
 		if (!json_parser_expect(parserState, ':', "json_parser:%u:%u Expecting ':'\n")) {
 			json_parser_add_state(parserState, error_state);
-			parserState->JSON_Allocator->free(str);
+			json_object_free_name(parserState->JSON_Factory, str, flags);
 			return obj;
 		}
 		parserState->jsonStrPos += 1;
@@ -387,12 +573,11 @@ json_object* json_parser_parse_object(json_parser_state* parserState, json_value
 		json_value* value = json_parser_parse_value(parserState, obj, object_value);
 		if (!value) {
 			json_parser_add_state(parserState, error_state);
-			parserState->JSON_Allocator->free((char*)str->value);
-			parserState->JSON_Allocator->free(str);
+			json_object_free_name(parserState->JSON_Factory, str, flags);
 			return obj;
 		}
 
-		int ret = json_object_add_pair(parserState->JSON_Factory, obj, str, value);
+		int ret = json_object_add_member(parserState->JSON_Factory, obj, str, value, hash, flags);
 		if (ret) {
 			json_error_lineno("json_parser:%u:%u Error: json_object_add_pair()\n", parserState);
 			json_parser_add_state(parserState, error_state);
@@ -413,16 +598,21 @@ json_object* json_parser_parse_object(json_parser_state* parserState, json_value
 	}
 	parserState->jsonStrPos += 1;
 
+	if (parserState->shareObjectShapes) {
+		json_parser_share_shape(parserState, obj);
+	}
+
 	return obj;
 }
 
 json_array* json_parser_parse_array(json_parser_state* parserState, json_value* parentValue) {
 	json_array* arr = NULL;
+	const size_t sizeHint = json_parser_next_container_size(parserState);
 	json_parser_skip_ws(parserState);
 
 	//Empty array case "[]"
 	if (parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_rbrack]) {
-		arr = parserState->JSON_Factory->new_json_array(parserState->JSON_Factory, parentValue);
+		JSON_TIME_PHASE(parserState, json_phase_allocation, arr = JSON_NEW_NODE(parserState, array, json_pool_array, parentValue));
 		if (!arr) {
 			json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_array\n", parserState);
 			json_parser_add_state(parserState, error_state);
@@ -432,37 +622,63 @@ json_array* json_parser_parse_array(json_parser_state* parserState, json_value*
 		return arr;
 	}
 
-	arr = parserState->JSON_Factory->new_json_array(parserState->JSON_Factory, parentValue);
+	JSON_TIME_PHASE(parserState, json_phase_allocation, arr = JSON_NEW_NODE(parserState, array, json_pool_array, parentValue));
 	if (!arr) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_array\n", parserState);
 		json_parser_add_state(parserState, error_state);
 		return NULL;
 	}
 
-	do {
-		//Parse List: json_value [',' json_value]
-		json_parser_skip_ws(parserState);
-
-		json_value* val = json_parser_parse_value(parserState, arr, array_value);
-		if (!val) {
-			json_error_lineno("json_parser:%u:%u Expecting value\n", parserState);
+	//Arrays starting with a number are parsed packed until a non-number is reached
+	const bool packed = parserState->packNumberArrays && json_parser_is_number_start(parserState->jsonStr[parserState->jsonStrPos]);
+	if (packed) {
+		if (sizeHint && json_array_reserve_numbers(parserState->JSON_Factory, arr, sizeHint)) {
+			json_error_lineno("json_parser:%u:%u Error: json_array_reserve_numbers()\n", parserState);
 			json_parser_add_state(parserState, error_state);
 			return arr;
 		}
+	} else if (sizeHint && json_array_reserve(parserState->JSON_Factory, arr, sizeHint)) {
+		json_error_lineno("json_parser:%u:%u Error: json_array_reserve()\n", parserState);
+		json_parser_add_state(parserState, error_state);
+		return arr;
+	}
 
-		int ret = json_array_add_element(parserState->JSON_Factory, arr, val);
-		if (ret) {
-			json_error_lineno("json_parser:%u:%u Error: json_array_add_element()\n", parserState);
+	int listState = 0;
+	if (packed) {
+		listState = json_parser_parse_number_list(parserState, arr);
+		if (listState < 0) {
 			json_parser_add_state(parserState, error_state);
 			return arr;
 		}
+	}
 
-		json_parser_skip_ws(parserState);
-	} while (
-		parserState->jsonStrPos < parserState->jsonStrLength
-		&& parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_comma]
-		&& parserState->jsonStrPos++
-	);
+	//Parse remaining elements if the array isn't packed
+	if (!listState) {
+		do {
+			//Parse List: json_value [',' json_value]
+			json_parser_skip_ws(parserState);
+
+			json_value* val = json_parser_parse_value(parserState, arr, array_value);
+			if (!val) {
+				json_error_lineno("json_parser:%u:%u Expecting value\n", parserState);
+				json_parser_add_state(parserState, error_state);
+				return arr;
+			}
+
+			int ret = json_array_add_element(parserState->JSON_Factory, arr, val);
+			if (ret) {
+				json_error_lineno("json_parser:%u:%u Error: json_array_add_element()\n", parserState);
+				json_parser_add_state(parserState, error_state);
+				return arr;
+			}
+
+			json_parser_skip_ws(parserState);
+		} while (
+			parserState->jsonStrPos < parserState->jsonStrLength
+			&& parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_comma]
+			&& parserState->jsonStrPos++
+		);
+	}
 
 	json_parser_skip_ws(parserState);
 	if (!json_parser_expect(parserState, ']', "json_parser:%u:%u Expecting ']'\n")) {
@@ -477,67 +693,91 @@ json_array* json_parser_parse_array(json_parser_state* parserState, json_value*
 json_number* json_parser_parse_number(json_parser_state* parserState, json_value* parentValue) {
 	json_number* num = NULL;
 	double d = 0.0;
-	char* endNum = NULL;
-	d = strtod(parserState->jsonStr + parserState->jsonStrPos, &endNum);
-	if (!d && (endNum == parserState->jsonStr + parserState->jsonStrPos)) {
+	bool scanned = false;
+	JSON_TIME_PHASE(parserState, json_phase_number, scanned = json_parser_scan_number(parserState, &d));
+	if (!scanned) {
 		json_error_lineno("json_parser:%u:%u Expecting number\n", parserState);
 		json_parser_add_state(parserState, error_state);
 		return NULL;
 	}
 
-	num = parserState->JSON_Factory->new_json_number(parserState->JSON_Factory, d, parentValue);
+	JSON_TIME_PHASE(parserState, json_phase_allocation, num = JSON_NEW_NODE(parserState, number, json_pool_number, d, parentValue));
 	if (!num) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_number\n", parserState);
 		json_parser_add_state(parserState, error_state);
 		return NULL;
 	}
 
-	parserState->jsonStrPos += endNum - (parserState->jsonStr + parserState->jsonStrPos);
 	return num;
 }
 
-json_string* json_parser_parse_string(json_parser_state* parserState, json_value* parentValue) {
-	json_string* str = NULL;
-	bool foundEndQuote = false;
-	size_t startPos = parserState->jsonStrPos;
+//Parse a list of numbers into packed array arr: number [',' number]
+//Returns 1 if the list only had numbers, 0 if an element after a comma is not a number,
+//in which case arr is unpacked and the position is at that element, or -1 on error
+static int json_parser_parse_number_list(json_parser_state* parserState, json_array* arr) {
+	do {
+		json_parser_skip_ws(parserState);
+		if (!json_parser_expect(parserState, 0, "json_parser:%u:%u Error: Expecting value\n")) {
+			return -1;
+		}
 
-	while (parserState->jsonStrPos < parserState->jsonStrLength) {
-		if (parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_quote]) {
-			if (parserState->jsonStrPos > startPos && parserState->jsonStr[parserState->jsonStrPos - 1] == JSON_TOKEN_NAMES[json_token_backslash]) {
-				//Escaped quote
-			} else {
-				foundEndQuote = true;
-				break;
+		if (!json_parser_is_number_start(parserState->jsonStr[parserState->jsonStrPos])) {
+			if (json_array_unpack(parserState->JSON_Factory, arr)) {
+				json_error_lineno("json_parser:%u:%u Error: json_array_unpack()\n", parserState);
+				return -1;
 			}
-		} else if ((uint8_t) parserState->jsonStr[parserState->jsonStrPos] <= 0x1F) {
-			json_error_lineno("json_parser:%u:%u Invalid control character in string\n", parserState);
-			json_parser_add_state(parserState, error_state);
-			return NULL;
+			return 0;
 		}
-		parserState->jsonStrPos += 1;
-	}
 
-	if (!foundEndQuote) {
-		json_error_lineno("json_parser:%u:%u Expecting '\"', reached eos\n", parserState);
-		json_parser_add_state(parserState, error_state);
+		double d = 0.0;
+		bool scanned = false;
+		JSON_TIME_PHASE(parserState, json_phase_number, scanned = json_parser_scan_number(parserState, &d));
+		if (!scanned) {
+			json_error_lineno("json_parser:%u:%u Expecting number\n", parserState);
+			return -1;
+		}
+		if (json_array_add_number(parserState->JSON_Factory, arr, d)) {
+			json_error_lineno("json_parser:%u:%u Error: json_array_add_number()\n", parserState);
+			return -1;
+		}
+
+		json_parser_skip_ws(parserState);
+	} while (
+		parserState->jsonStrPos < parserState->jsonStrLength
+		&& parserState->jsonStr[parserState->jsonStrPos] == JSON_TOKEN_NAMES[json_token_comma]
+		&& parserState->jsonStrPos++
+	);
+
+	return 1;
+}
+
+json_string* json_parser_parse_string(json_parser_state* parserState, json_value* parentValue) {
+	json_string* str = NULL;
+	size_t startPos = parserState->jsonStrPos;
+	bool hasEscape = false;
+
+	bool scanned = false;
+	JSON_TIME_PHASE(parserState, json_phase_string_scan, scanned = json_parser_scan_string(parserState, &hasEscape));
+	if (!scanned) {
 		return NULL;
 	}
 
 	size_t dataLen = parserState->jsonStrPos - startPos;
 	int ret = 0;
 	size_t unescapedLen = 0;
-	char* data = json_utils_unescape_string(parserState, parserState->jsonStr + startPos, dataLen, &ret, &unescapedLen);
+	char* data = NULL;
+	JSON_TIME_PHASE(parserState, json_phase_unescape, data = json_utils_unescape_string(parserState, parserState->jsonStr + startPos, dataLen, &ret, &unescapedLen));
 	if (!data || ret) {
-		json_error_lineno("json_parser:%u:%u Error: json_utils_unescape_string()", parserState);
+		json_error_lineno("json_parser:%u:%u Error: json_utils_unescape_string()\n", parserState);
 		json_parser_add_state(parserState, error_state);
 		return NULL;
 	}
 
-	str = parserState->JSON_Factory->new_json_string(parserState->JSON_Factory, data, unescapedLen, parentValue);
+	JSON_TIME_PHASE(parserState, json_phase_allocation, str = JSON_NEW_NODE(parserState, string, json_pool_string, data, unescapedLen, parentValue));
 	if (!str) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_string\n", parserState);
 		json_parser_add_state(parserState, error_state);
-		parserState->JSON_Allocator->free(data);
+		JSON_FREE(parserState->JSON_Allocator, json_alloc_string, data, unescapedLen + 1);
 		return NULL;
 	}
 
@@ -546,7 +786,8 @@ json_string* json_parser_parse_string(json_parser_state* parserState, json_value
 }
 
 json_true* json_parser_parse_true(json_parser_state* parserState, json_value* parentValue) {
-	json_true* tru = parserState->JSON_Factory->new_json_true(parserState->JSON_Factory, parentValue);
+	json_true* tru = NULL;
+	JSON_TIME_PHASE(parserState, json_phase_allocation, tru = JSON_NEW_LITERAL(parserState, true, parentValue));
 	if (!tru) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_true\n", parserState);
 		json_parser_add_state(parserState, error_state);
@@ -557,7 +798,8 @@ json_true* json_parser_parse_true(json_parser_state* parserState, json_value* pa
 }
 
 json_false* json_parser_parse_false(json_parser_state* parserState, json_value* parentValue) {
-	json_false* fals = parserState->JSON_Factory->new_json_false(parserState->JSON_Factory, parentValue);
+	json_false* fals = NULL;
+	JSON_TIME_PHASE(parserState, json_phase_allocation, fals = JSON_NEW_LITERAL(parserState, false, parentValue));
 	if (!fals) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_false\n", parserState);
 		json_parser_add_state(parserState, error_state);
@@ -568,7 +810,8 @@ json_false* json_parser_parse_false(json_parser_state* parserState, json_value*
 }
 
 json_null* json_parser_parse_null(json_parser_state* parserState, json_value* parentValue) {
-	json_null* nul = parserState->JSON_Factory->new_json_null(parserState->JSON_Factory, parentValue);
+	json_null* nul = NULL;
+	JSON_TIME_PHASE(parserState, json_phase_allocation, nul = JSON_NEW_LITERAL(parserState, null, parentValue));
 	if (!nul) {
 		json_error_lineno("json_parser:%u:%u Error: JSON_Factory::new_json_null\n", parserState);
 		json_parser_add_state(parserState, error_state);
@@ -579,9 +822,368 @@ json_null* json_parser_parse_null(json_parser_state* parserState, json_value* pa
 }
 
 static void json_parser_skip_ws(json_parser_state* parserState) {
-	while (parserState->jsonStrPos < parserState->jsonStrLength && isspace(parserState->jsonStr[parserState->jsonStrPos])) {
-		parserState->jsonStrPos += 1;
+	JSON_TIME_PHASE(parserState, json_phase_whitespace,
+		while (parserState->jsonStrPos < parserState->jsonStrLength && isspace(parserState->jsonStr[parserState->jsonStrPos])) {
+			parserState->jsonStrPos += 1;
+		}
+	);
+}
+
+//Scan the JSON text and record the number of elements of each container, in order of appearance
+//The counts are only used as hints; errors in the JSON text are left for the parser to report
+//Returns zero on success, nonzero on failure
+static int json_parser_index_containers(json_parser_state* parserState) {
+	int retVal = 1;
+	json_allocator* jsonAlloc = parserState->JSON_Allocator;
+	const char* jsonStr = parserState->jsonStr;
+	const size_t jsonStrLength = parserState->jsonStrLength;
+	const size_t maxLevel = parserState->maxNestedLevel;
+
+	//Stack of indices into containerSizes for the open containers
+	size_t* levels = (size_t*) json_allocator_malloc(jsonAlloc, sizeof(size_t) * maxLevel);
+	if (!levels) {
+		return retVal;
+	}
+	size_t level = 0;
+
+	uint32_t* sizes = parserState->containerSizes;
+	size_t sizesLen = 0;
+	size_t sizesCap = parserState->containerSizesCapacity;
+	bool stop = false;
+
+	for (size_t pos = 0; pos < jsonStrLength && !stop; pos += 1) {
+		switch (jsonStr[pos]) {
+			case '"': {
+				pos += 1;
+				while (pos < jsonStrLength && jsonStr[pos] != '"') {
+					pos += (jsonStr[pos] == '\\') ? 2 : 1;
+				}
+			}
+			break;
+			case '{':
+			case '[': {
+				if (level >= maxLevel) {//Parser reports the nesting error
+					stop = true;
+					break;
+				}
+				if (sizesLen == sizesCap) {
+					const size_t newCap = (sizesCap) ? align_offset(sizesCap * 2, 64) : 64;
+					uint32_t* tmp = (uint32_t*) json_allocator_grow(jsonAlloc, sizes, sizeof(uint32_t) * sizesCap, sizeof(uint32_t) * newCap);
+					if (!tmp) {
+						stop = true;
+						break;
+					}
+					sizes = tmp;
+					sizesCap = newCap;
+				}
+
+				//Empty containers have no elements, others have one more than their commas
+				size_t next = pos + 1;
+				while (next < jsonStrLength && isspace(jsonStr[next])) {
+					next += 1;
+				}
+				sizes[sizesLen] = (next < jsonStrLength && (jsonStr[next] == '}' || jsonStr[next] == ']')) ? 0 : 1;
+				levels[level] = sizesLen;
+				level += 1;
+				sizesLen += 1;
+			}
+			break;
+			case '}':
+			case ']': {
+				if (level) {
+					level -= 1;
+				}
+			}
+			break;
+			case ',': {
+				if (level && sizes[levels[level - 1]] < UINT32_MAX) {
+					sizes[levels[level - 1]] += 1;
+				}
+			}
+			break;
+			default:
+			break;
+		}
+	}
+
+	json_allocator_free_sized(jsonAlloc, levels, sizeof(size_t) * maxLevel);
+
+	parserState->containerSizes = sizes;
+	parserState->containerSizesCapacity = sizesCap;
+	parserState->containerSizesLen = sizesLen;
+
+	retVal = 0;
+	return retVal;
+}
+
+//Returns the element count of the next container from the pre-scan, or zero if unknown
+static inline size_t json_parser_next_container_size(json_parser_state* parserState) {
+	const size_t index = parserState->containerIndex;
+	parserState->containerIndex += 1;
+	return (index < parserState->containerSizesLen) ? parserState->containerSizes[index] : 0;
+}
+
+//Share the shape of a previous object with the same names with obj, or create a new shape
+//Objects that can't be shaped are left unchanged
+static void json_parser_share_shape(json_parser_state* parserState, json_object* obj) {
+	json_factory* jsonFact = parserState->JSON_Factory;
+	if (!obj->size) {
+		return;
+	}
+
+	//Keep the cache at most half full
+	if ((parserState->shapeCacheSize + 1) * 2 > parserState->shapeCacheCapacity) {
+		const size_t oldCap = parserState->shapeCacheCapacity;
+		const size_t newCap = (oldCap) ? oldCap * 2 : 64;
+		json_object_shape** cache = (json_object_shape**) json_allocator_malloc(parserState->JSON_Allocator, sizeof(json_object_shape*) * newCap);
+		if (!cache) {
+			return;
+		}
+		memset(cache, 0, sizeof(json_object_shape*) * newCap);
+		for (size_t k = 0; k < oldCap; k += 1) {
+			json_object_shape* shape = parserState->shapeCache[k];
+			if (shape) {
+				size_t slot = shape->hash & (newCap - 1);
+				while (cache[slot]) {
+					slot = (slot + 1) & (newCap - 1);
+				}
+				cache[slot] = shape;
+			}
+		}
+		json_allocator_free_sized(parserState->JSON_Allocator, parserState->shapeCache, sizeof(json_object_shape*) * oldCap);
+		parserState->shapeCache = cache;
+		parserState->shapeCacheCapacity = newCap;
+	}
+
+	json_object_shape** cache = parserState->shapeCache;
+	const size_t mask = parserState->shapeCacheCapacity - 1;
+	const size_t hash = json_object_shape_hash(obj);
+	size_t slot = hash & mask;
+	while (cache[slot]) {
+		if (cache[slot]->hash == hash && json_object_shape_matches(cache[slot], obj)) {
+			json_object_set_shape(jsonFact, obj, cache[slot]);
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	json_object_shape* shape = json_object_set_shape(jsonFact, obj, NULL);
+	if (shape) {
+		//The cache holds a reference until the end of json_parser_parse()
+		shape->refCount += 1;
+		cache[slot] = shape;
+		parserState->shapeCacheSize += 1;
+	}
+}
+
+//Drop the references held by the shape cache
+static void json_parser_release_shapes(json_parser_state* parserState) {
+	for (size_t k = 0, n = parserState->shapeCacheCapacity; k < n && parserState->shapeCacheSize; k += 1) {
+		if (parserState->shapeCache[k]) {
+			json_object_shape_release(parserState->JSON_Factory, parserState->shapeCache[k]);
+			parserState->shapeCache[k] = NULL;
+			parserState->shapeCacheSize -= 1;
+		}
+	}
+}
+
+//Advance past the text of a string to its closing quote, which is left unconsumed
+//Sets hasEscape if the text contains escape sequences
+//Returns true on success, false on error
+static bool json_parser_scan_string(json_parser_state* parserState, bool* hasEscape) {
+	const char* jsonStr = parserState->jsonStr;
+	const size_t jsonStrLength = parserState->jsonStrLength;
+	const json_scan_function scanString = parserState->kernels->scan_string;
+	size_t pos = parserState->jsonStrPos;
+
+	while (pos < jsonStrLength) {
+		//Skip to the next quote, backslash or control character
+		pos = scanString(jsonStr, jsonStrLength, pos);
+		if (pos >= jsonStrLength) {
+			break;
+		}
+		const char c = jsonStr[pos];
+		if (c == JSON_TOKEN_NAMES[json_token_quote]) {
+			parserState->jsonStrPos = pos;
+			return true;
+		} else if (c == JSON_TOKEN_NAMES[json_token_backslash]) {
+			//The escaped character can't end the string
+			*hasEscape = true;
+			pos += 1;
+			if (pos >= jsonStrLength) {
+				break;
+			}
+		}
+		if ((uint8_t) jsonStr[pos] <= 0x1F) {
+			parserState->jsonStrPos = pos;
+			json_error_lineno("json_parser:%u:%u Invalid control character in string\n", parserState);
+			json_parser_add_state(parserState, error_state);
+			return false;
+		}
+		pos += 1;
+	}
+
+	parserState->jsonStrPos = pos;
+	json_error_lineno("json_parser:%u:%u Expecting '\"', reached eos\n", parserState);
+	json_parser_add_state(parserState, error_state);
+	return false;
+}
+
+//Parse an object name after its opening quote, interning it with the json_intern_names option
+//Sets hash to the hash of the name and flags to its JSON_MEMBER_FLAGS
+//Returns the name, or NULL on error
+static json_string* json_parser_parse_name(json_parser_state* parserState, uint32_t* hash, uint32_t* flags) {
+	if (!parserState->internNames) {
+		json_string* str = json_parser_parse_string(parserState, NULL);
+		if (str) {
+			*hash = json_hash_string(str->value, str->valueLen);
+			*flags = 0;
+		}
+		return str;
+	}
+
+	const size_t startPos = parserState->jsonStrPos;
+	bool hasEscape = false;
+	bool scanned = false;
+	JSON_TIME_PHASE(parserState, json_phase_string_scan, scanned = json_parser_scan_string(parserState, &hasEscape));
+	if (!scanned) {
+		return NULL;
+	}
+
+	//Names without escapes are looked up straight from the JSON text
+	const char* name = parserState->jsonStr + startPos;
+	size_t nameLen = parserState->jsonStrPos - startPos;
+	char* data = NULL;
+	if (hasEscape) {
+		int ret = 0;
+		JSON_TIME_PHASE(parserState, json_phase_unescape, data = json_utils_unescape_string(parserState, name, nameLen, &ret, &nameLen));
+		if (!data || ret) {
+			json_error_lineno("json_parser:%u:%u Error: json_utils_unescape_string()\n", parserState);
+			json_parser_add_state(parserState, error_state);
+			return NULL;
+		}
+		name = data;
+	}
+
+	*hash = json_hash_string(name, nameLen);
+	*flags = json_member_interned_name;
+	json_string* str = json_parser_intern_name(parserState, name, nameLen, *hash);
+	if (data) {
+		JSON_FREE(parserState->JSON_Allocator, json_alloc_string, data, nameLen + 1);
+	}
+	if (!str) {
+		json_error_lineno("json_parser:%u:%u Error: json_parser_intern_name()\n", parserState);
+		json_parser_add_state(parserState, error_state);
+		return NULL;
+	}
+
+	parserState->jsonStrPos += 1;
+	return str;
+}
+
+//Returns the slot of the intern table holding name, or the empty slot to insert it into
+//The table must have been allocated
+static json_interned_string** json_parser_find_interned(json_parser_state* parserState, const char* name, const size_t nameLen, const uint32_t hash) {
+	json_interned_string** table = parserState->internTable;
+	const size_t mask = parserState->internTableCapacity - 1;
+	size_t slot = hash & mask;
+	while (table[slot]) {
+		const json_interned_string* interned = table[slot];
+		if (
+			interned->hash == hash
+			&& interned->string.valueLen == nameLen
+			&& !memcmp(interned->string.value, name, nameLen)
+		) {
+			break;
+		}
+		slot = (slot + 1) & mask;
 	}
+	return table + slot;
+}
+
+//Returns the interned name equal to name with a new reference for the caller, interning it if needed
+//Returns NULL on failure
+static json_string* json_parser_intern_name(json_parser_state* parserState, const char* name, const size_t nameLen, const uint32_t hash) {
+	//Keep the table at most half full
+	if ((parserState->internTableSize + 1) * 2 > parserState->internTableCapacity) {
+		const size_t oldCap = parserState->internTableCapacity;
+		const size_t newCap = (oldCap) ? oldCap * 2 : 64;
+		json_interned_string** table = (json_interned_string**) json_allocator_malloc(parserState->JSON_Allocator, sizeof(json_interned_string*) * newCap);
+		if (!table) {
+			return NULL;
+		}
+		memset(table, 0, sizeof(json_interned_string*) * newCap);
+		for (size_t k = 0; k < oldCap; k += 1) {
+			json_interned_string* interned = parserState->internTable[k];
+			if (interned) {
+				size_t slot = interned->hash & (newCap - 1);
+				while (table[slot]) {
+					slot = (slot + 1) & (newCap - 1);
+				}
+				table[slot] = interned;
+			}
+		}
+		json_allocator_free_sized(parserState->JSON_Allocator, parserState->internTable, sizeof(json_interned_string*) * oldCap);
+		parserState->internTable = table;
+		parserState->internTableCapacity = newCap;
+	}
+
+	json_interned_string** slot = json_parser_find_interned(parserState, name, nameLen, hash);
+	if (*slot) {
+		(*slot)->refCount += 1;
+		return &(*slot)->string;
+	}
+
+	//The table holds one reference and the caller another
+	json_string* str = json_interned_string_new(parserState->JSON_Factory, name, nameLen, hash);
+	if (!str) {
+		return NULL;
+	}
+	*slot = (json_interned_string*) str;
+	(*slot)->refCount += 1;
+	parserState->internTableSize += 1;
+
+	return str;
+}
+
+//Drop the references held by the intern table
+static void json_parser_release_names(json_parser_state* parserState) {
+	for (size_t k = 0, n = parserState->internTableCapacity; k < n && parserState->internTableSize; k += 1) {
+		if (parserState->internTable[k]) {
+			json_interned_string_release(parserState->JSON_Factory, &parserState->internTable[k]->string);
+			parserState->internTable[k] = NULL;
+			parserState->internTableSize -= 1;
+		}
+	}
+}
+
+const json_string* json_parser_find_name(json_parser_state* parserState, const char* name, size_t nameLen) {
+	if (!parserState || (!name && nameLen) || !parserState->internTableSize) {
+		return NULL;
+	}
+
+	json_interned_string** slot = json_parser_find_interned(parserState, name, nameLen, json_hash_string(name, nameLen));
+	return (*slot) ? &(*slot)->string : NULL;
+}
+
+//Returns true if c can start a JSON number
+static inline bool json_parser_is_number_start(const char c) {
+	return (c >= '0' && c <= '9') || c == '-';
+}
+
+//Convert the number at the current position and advance past it
+//Returns true on success, false if there is no number at the current position
+static inline bool json_parser_scan_number(json_parser_state* parserState, double* num) {
+	const char* start = parserState->jsonStr + parserState->jsonStrPos;
+	char* endNum = NULL;
+	const double d = strtod(start, &endNum);
+	if (!d && endNum == start) {
+		return false;
+	}
+
+	*num = d;
+	parserState->jsonStrPos += endNum - start;
+	return true;
 }
 
 //Pass nul byte for c to not check the char, just compare pos to len
@@ -606,6 +1208,40 @@ static inline int json_parser_remove_state(json_parser_state* parserState, int s
 	return parserState->state &= ~(1 << state);
 }
 
+//Copies the allocation counters of the parser's allocator, zeroed without JSON_ENABLE_STATS
+int json_parser_get_stats(json_parser_state* parserState, json_allocator_stats* stats) {
+	int retVal = 1;
+	if (!parserState || !stats) {
+		return retVal;
+	}
+
+#ifdef JSON_ENABLE_STATS
+	memcpy(stats, &parserState->JSON_Allocator->stats, sizeof(json_allocator_stats));
+	retVal = 0;
+#else
+	memset(stats, 0, sizeof(json_allocator_stats));
+#endif	//#ifdef JSON_ENABLE_STATS
+
+	return retVal;
+}
+
+//Copies the time spent in each phase of parsing, zeroed without JSON_ENABLE_STATS
+int json_parser_get_phase_stats(json_parser_state* parserState, json_parser_phase_stats* stats) {
+	int retVal = 1;
+	if (!parserState || !stats) {
+		return retVal;
+	}
+
+#ifdef JSON_ENABLE_STATS
+	memcpy(stats, &parserState->phaseStats, sizeof(json_parser_phase_stats));
+	retVal = 0;
+#else
+	memset(stats, 0, sizeof(json_parser_phase_stats));
+#endif	//#ifdef JSON_ENABLE_STATS
+
+	return retVal;
+}
+
 //Returns a string representing the parser state
 const char* json_parser_get_state_string(json_parser_state* parserState) {
 	if (parserState) {
@@ -34,6 +34,7 @@
 #include "json_types.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
 
 
 #ifdef __cplusplus
@@ -41,6 +42,71 @@ extern "C" {
 #endif	//#ifdef __cplusplus
 
 
+/**
+ *  @brief Phases of json_parser_parse() timed with the json_time_phases option
+ */
+typedef enum JSON_PARSER_PHASE {
+	/*! Skipping whitespace */
+	json_phase_whitespace = 0,
+	/*! Finding the end of strings */
+	json_phase_string_scan,
+	/*! Unescaping strings into their values */
+	json_phase_unescape,
+	/*! Converting numbers */
+	json_phase_number,
+	/*! Making values through the JSON_Factory functions */
+	json_phase_allocation,
+	/*! Counting container elements with the json_presize_containers option */
+	json_phase_index,
+	JSON_PARSER_PHASE_MAX
+} JSON_PARSER_PHASE;
+
+/**
+ *  @brief Time spent in each JSON_PARSER_PHASE
+ *
+ *  Ticks are cycles of the time stamp counter on x86, and nanoseconds
+ *  elsewhere. The phases don't cover all of the parse, so the sum of their ticks
+ *  is less than @p parseTicks.
+ *
+ *  @see json_parser_get_phase_stats()
+ */
+typedef struct json_parser_phase_stats {
+	/*@{ */
+	/*! Ticks spent in each phase */
+	uint64_t ticks[JSON_PARSER_PHASE_MAX];
+	/*! Number of times each phase was entered */
+	uint64_t calls[JSON_PARSER_PHASE_MAX];
+	/*! Ticks spent in json_parser_parse() */
+	uint64_t parseTicks;
+	/*! Number of calls to json_parser_parse() */
+	uint64_t parses;
+	/*@} */
+} json_parser_phase_stats;
+
+/**
+ *  @brief Instruction set levels of the byte scanning kernels
+ *
+ *  Each level includes the ones below it. SSE4.2 hosts without AVX2 use
+ *  json_cpu_sse2.
+ *
+ *  @see json_cpu_detect()
+ */
+typedef enum JSON_CPU_LEVEL {
+	/*! Portable C */
+	json_cpu_scalar = 0,
+	/*! 16 bytes at a time with SSE2 */
+	json_cpu_sse2,
+	/*! 32 bytes at a time with AVX2 */
+	json_cpu_avx2,
+	/*! 64 bytes at a time with AVX-512BW */
+	json_cpu_avx512,
+	JSON_CPU_LEVEL_MAX
+} JSON_CPU_LEVEL;
+
+struct json_simd_kernels;
+/*! Typedef for the kernels of a JSON_CPU_LEVEL */
+typedef struct json_simd_kernels json_simd_kernels;
+
 /**
  *  @brief Struct representing the parser instance
  *
@@ -64,6 +130,64 @@ typedef struct json_parser_state {
 	FILE* errorStream;
 	/*@} */
 
+	/*@{ */
+	/*! Whether to pre-scan the JSON text for container sizes */
+	int presizeContainers;
+	/*! Element counts of each container in the JSON text, in order of appearance */
+	uint32_t* containerSizes;
+	/*! Number of entries in @p containerSizes */
+	size_t containerSizesLen;
+	/*! Capacity of @p containerSizes */
+	size_t containerSizesCapacity;
+	/*! Index into @p containerSizes of the next container to parse */
+	size_t containerIndex;
+	/*! Whether to store arrays of only numbers packed */
+	int packNumberArrays;
+	/*! Value returned by json_value_query() for an element of a packed array */
+	json_value queryValue;
+	/*! Number referenced by @p queryValue */
+	json_number queryNumber;
+	/*@} */
+
+	/*@{ */
+	/*! Whether to share shapes between objects with the same names */
+	int shareObjectShapes;
+	/*! Open addressing table of the shapes created while parsing, by hash */
+	json_object_shape** shapeCache;
+	/*! Number of shapes in @p shapeCache */
+	size_t shapeCacheSize;
+	/*! Capacity of @p shapeCache */
+	size_t shapeCacheCapacity;
+	/*@} */
+
+	/*@{ */
+	/*! Whether to intern object names */
+	int internNames;
+	/*! Whether to keep interned names across parses */
+	int persistInternedNames;
+	/*! Open addressing table of interned names, by hash */
+	json_interned_string** internTable;
+	/*! Number of names in @p internTable */
+	size_t internTableSize;
+	/*! Capacity of @p internTable */
+	size_t internTableCapacity;
+	/*! Whether to record the source text of objects and arrays */
+	int recordSourceSpans;
+	/*@} */
+
+	/*@{ */
+	/*! Whether to time the phases of parsing */
+	int timePhases;
+	/*! Time spent in each phase since @p timePhases was set */
+	json_parser_phase_stats phaseStats;
+	/*! Whether the default factory and allocator are in use, so nodes are made inline; set by json_parser_parse() */
+	int defaultFactory;
+	/*! Level of the byte scanning kernels; set with the json_cpu_level option */
+	JSON_CPU_LEVEL cpuLevel;
+	/*! The kernels of @p cpuLevel */
+	const json_simd_kernels* kernels;
+	/*@} */
+
 	/*@{ */
 	/*! Pointer to this parser's json_allocator */
 	json_allocator* JSON_Allocator;
@@ -104,6 +228,10 @@ int json_parser_setopt(json_parser_state* parserState, JSON_PARSER_OPT opt, ...)
  *  Passing @c NULL for @p allocFunction and a valid function pointer for
  *  @p freeFunction, the library will default to using malloc and free.
  *
+ *  Containers are grown with realloc when the default functions are used. With a
+ *  custom @p allocFunction, containers are grown by allocating, copying and freeing
+ *  unless a realloc-like function is set with the json_realloc_function option.
+ *
  *  A pointer to the json_parser_state is returned on success, or @c NULL on failure.
  *  The returned pointer is used in subsequent calls to the library. The returned
  *  json_parser_state should be deallocated by calling json_parser_clear() when the
@@ -117,6 +245,41 @@ int json_parser_setopt(json_parser_state* parserState, JSON_PARSER_OPT opt, ...)
  */
 json_parser_state* json_parser_init(alloc_function allocFunction, free_function freeFunction);
 
+/**
+ *  @brief Initialize the library with an allocator carrying a context
+ *
+ *  Like json_parser_init(), but all memory of the parser and of the values it
+ *  creates comes from @p ctxAlloc, whose functions receive its @c ctx pointer.
+ *  This lets a parser allocate from an arena, a pool or a tracking allocator
+ *  without global state. The struct is copied, so it need not outlive the call.
+ *
+ *  If @c realloc is set it is used to grow containers and buffers, and is
+ *  passed their current size; otherwise they are grown by allocating, copying
+ *  and freeing. If @c freeSized is set it is called instead of @c free for the
+ *  memory whose size the library tracks, with the size it was allocated or last
+ *  grown with. The json_realloc_function option can't be set on the returned parser.
+ *
+ *  Strings returned by json_value_stringify() and similar functions are
+ *  allocated from @p ctxAlloc and must be freed through it.
+ *
+ *  @param ctxAlloc The allocator; its @c malloc and @c free functions must be set
+ *  @return Pointer to a json_parser_state for this parser instance, or NULL on failure
+ *
+ *  @see json_allocator_ctx json_parser_init() json_parser_clear()
+ */
+json_parser_state* json_parser_init_ex(const json_allocator_ctx* ctxAlloc);
+
+/**
+ *  @brief Detect the highest JSON_CPU_LEVEL the CPU and OS support
+ *
+ *  Uses cpuid on x86, and returns json_cpu_scalar elsewhere or when the
+ *  library was built by a compiler without x86 target attributes. Parsers use
+ *  this level unless another is set with the json_cpu_level option.
+ *
+ *  @return The detected level
+ */
+JSON_CPU_LEVEL json_cpu_detect(void);
+
 /**
  *  @brief Clear the json_parser_state and free its memory
  *
@@ -126,7 +289,7 @@ json_parser_state* json_parser_init(alloc_function allocFunction, free_function
  *  @param parserState Pointer to the json_parser_state to clear
  *  @return Zero on success, or nonzero on failure
  *
- *  @see json_parser_init() json_parser_state
+ *  @see json_parser_init() json_parser_init_ex() json_parser_state
  */
 int json_parser_clear(json_parser_state* parserState);
 
@@ -183,6 +346,57 @@ json_false* json_parser_parse_false(json_parser_state* parserState, json_value*
 json_null* json_parser_parse_null(json_parser_state* parserState, json_value* parentValue);
 /*@} */
 
+/**
+ *  @brief Find an interned object name
+ *
+ *  Looks up @p name in the names interned with the json_intern_names option.
+ *  Members with an interned name compare equal to it by pointer. Interned names
+ *  are kept until the end of json_parser_parse(), or until json_parser_clear()
+ *  with the json_persist_interned_names option.
+ *
+ *  @param parserState Pointer to parser state instance
+ *  @param name The name to look up, need not be @c NULL terminated
+ *  @param nameLen Length of @p name in bytes
+ *  @return The interned name, or NULL if @p name is not interned
+ *
+ *  @see JSON_PARSER_OPT
+ */
+const json_string* json_parser_find_name(json_parser_state* parserState, const char* name, size_t nameLen);
+
+/**
+ *  @brief Get the allocation counters of the parser
+ *
+ *  Copies the counters of the allocator of @p parserState into @p stats. The
+ *  counters cover the values, containers and shapes allocated by the parser and
+ *  the factory since json_parser_init(); memory allocated outside the library
+ *  and freed by it is not counted. Counting is compiled in with the
+ *  --enable-stats configure option; without it @p stats is zeroed and nonzero
+ *  is returned.
+ *
+ *  @param parserState Pointer to parser state instance
+ *  @param[out] stats Pointer to a json_allocator_stats to receive the counters
+ *  @return Zero on success, nonzero if the arguments are invalid or counting is disabled
+ *
+ *  @see json_allocator_stats JSON_ALLOC_CATEGORY
+ */
+int json_parser_get_stats(json_parser_state* parserState, json_allocator_stats* stats);
+
+/**
+ *  @brief Get the time spent in each phase of parsing
+ *
+ *  Copies into @p stats the time spent in each JSON_PARSER_PHASE by the calls
+ *  to json_parser_parse() since the json_time_phases option was set. Timing is
+ *  compiled in with the --enable-stats configure option; without it @p stats is
+ *  zeroed and nonzero is returned.
+ *
+ *  @param parserState Pointer to parser state instance
+ *  @param[out] stats Pointer to a json_parser_phase_stats to receive the times
+ *  @return Zero on success, nonzero if the arguments are invalid or timing is disabled
+ *
+ *  @see json_parser_phase_stats JSON_PARSER_PHASE
+ */
+int json_parser_get_phase_stats(json_parser_state* parserState, json_parser_phase_stats* stats);
+
 /**
  *  @brief Get a C-string representation of the parser state
  *
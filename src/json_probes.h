@@ -0,0 +1,61 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_probes.h
+ *  @brief USDT probes of the library
+ *
+ *  This header is internal to the library and is not installed. When
+ *  sys/sdt.h is found by configure, the JSON_PROBE macros place static probes
+ *  of the provider libjson, which are a nop instruction until a tracer attaches
+ *  to them. Otherwise they compile to nothing.
+ *
+ *  Probes and their arguments:
+ *  - parse__start: JSON text, length of the text
+ *  - parse__done: length of the text, parser state, top-level value or NULL
+ *  - parse__error: printf format of the message, position in the text
+ *  - query__start: JSON Pointer, length of the pointer
+ *  - query__done: JSON Pointer, length of the pointer, value found or NULL
+ *  - stringify__start: value, flags
+ *  - stringify__done: value, length of the string including the terminator, or 0 on failure
+ *
+ *  The time between a start probe and its done probe on the same thread is the
+ *  latency of the call.
+ */
+
+
+#ifndef JSON_PROBES_H
+#define JSON_PROBES_H
+
+
+/*! @cond */
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define JSON_PROBE2(name, arg1, arg2) DTRACE_PROBE2(libjson, name, arg1, arg2)
+#define JSON_PROBE3(name, arg1, arg2, arg3) DTRACE_PROBE3(libjson, name, arg1, arg2, arg3)
+
+#else
+
+#define JSON_PROBE2(name, arg1, arg2) do {} while (0)
+#define JSON_PROBE3(name, arg1, arg2, arg3) do {} while (0)
+
+#endif	//#ifdef HAVE_SYS_SDT_H
+/*! @endcond */
+
+
+#endif	//#ifndef JSON_PROBES_H
@@ -0,0 +1,295 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_SIMD_C
+#define JSON_SIMD_C
+
+
+#define JSON_TOP_LVL 1
+
+
+#include "json_simd.h"
+#include "json_parser.h"
+
+#include <stdint.h>
+
+//Kernels above scalar are compiled with target attributes, so one binary runs on any x86 CPU
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define JSON_SIMD_X86 1
+#include <immintrin.h>
+#endif	//#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+/* Scalar kernels */
+
+static size_t json_scan_string_scalar(const char* str, const size_t strLen, size_t pos) {
+	for (; pos < strLen; pos += 1) {
+		const uint8_t c = str[pos];
+		if (c == '"' || c == '\\' || c < 0x20) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+static size_t json_scan_string_ascii_scalar(const char* str, const size_t strLen, size_t pos) {
+	for (; pos < strLen; pos += 1) {
+		const uint8_t c = str[pos];
+		if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+static size_t json_scan_plain_scalar(const char* str, const size_t strLen, size_t pos) {
+	for (; pos < strLen; pos += 1) {
+		const uint8_t c = str[pos];
+		if (c <= ' ' || c == '"') {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+#ifdef JSON_SIMD_X86
+
+/* SSE2 kernels, finishing with the scalar ones */
+
+__attribute__((target("sse2")))
+static size_t json_scan_string_sse2(const char* str, const size_t strLen, size_t pos) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+	for (; pos + 16 <= strLen; pos += 16) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*) (str + pos));
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+		const int mask = _mm_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	return json_scan_string_scalar(str, strLen, pos);
+}
+
+__attribute__((target("sse2")))
+static size_t json_scan_string_ascii_sse2(const char* str, const size_t strLen, size_t pos) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(0x20);
+	for (; pos + 16 <= strLen; pos += 16) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*) (str + pos));
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+		//Signed comparison catches both control characters and bytes >= 0x80
+		special = _mm_or_si128(special, _mm_cmplt_epi8(chunk, space));
+		const int mask = _mm_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	return json_scan_string_ascii_scalar(str, strLen, pos);
+}
+
+__attribute__((target("sse2")))
+static size_t json_scan_plain_sse2(const char* str, const size_t strLen, size_t pos) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i space = _mm_set1_epi8(' ');
+	for (; pos + 16 <= strLen; pos += 16) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*) (str + pos));
+		const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(_mm_min_epu8(chunk, space), chunk));
+		const int mask = _mm_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	return json_scan_plain_scalar(str, strLen, pos);
+}
+
+/* AVX2 kernels, finishing with the SSE2 ones */
+
+__attribute__((target("avx2")))
+static size_t json_scan_string_avx2(const char* str, const size_t strLen, size_t pos) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1F);
+	for (; pos + 32 <= strLen; pos += 32) {
+		const __m256i chunk = _mm256_loadu_si256((const __m256i*) (str + pos));
+		__m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash));
+		special = _mm256_or_si256(special, _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+		const uint32_t mask = (uint32_t) _mm256_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	//Clear the upper halves of the registers, else the SSE2 code stalls on them
+	_mm256_zeroupper();
+	return json_scan_string_sse2(str, strLen, pos);
+}
+
+__attribute__((target("avx2")))
+static size_t json_scan_string_ascii_avx2(const char* str, const size_t strLen, size_t pos) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i space = _mm256_set1_epi8(0x20);
+	for (; pos + 32 <= strLen; pos += 32) {
+		const __m256i chunk = _mm256_loadu_si256((const __m256i*) (str + pos));
+		__m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash));
+		special = _mm256_or_si256(special, _mm256_cmpgt_epi8(space, chunk));
+		const uint32_t mask = (uint32_t) _mm256_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	//Clear the upper halves of the registers, else the SSE2 code stalls on them
+	_mm256_zeroupper();
+	return json_scan_string_ascii_sse2(str, strLen, pos);
+}
+
+__attribute__((target("avx2")))
+static size_t json_scan_plain_avx2(const char* str, const size_t strLen, size_t pos) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i space = _mm256_set1_epi8(' ');
+	for (; pos + 32 <= strLen; pos += 32) {
+		const __m256i chunk = _mm256_loadu_si256((const __m256i*) (str + pos));
+		const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, space), chunk));
+		const uint32_t mask = (uint32_t) _mm256_movemask_epi8(special);
+		if (mask) {
+			return pos + __builtin_ctz(mask);
+		}
+	}
+
+	//Clear the upper halves of the registers, else the SSE2 code stalls on them
+	_mm256_zeroupper();
+	return json_scan_plain_sse2(str, strLen, pos);
+}
+
+/* AVX-512BW kernels, finishing with the AVX2 ones */
+
+__attribute__((target("avx512bw")))
+static size_t json_scan_string_avx512(const char* str, const size_t strLen, size_t pos) {
+	const __m512i quote = _mm512_set1_epi8('"');
+	const __m512i backslash = _mm512_set1_epi8('\\');
+	const __m512i space = _mm512_set1_epi8(0x20);
+	for (; pos + 64 <= strLen; pos += 64) {
+		const __m512i chunk = _mm512_loadu_si512((const void*) (str + pos));
+		const __mmask64 mask = (
+			_mm512_cmpeq_epi8_mask(chunk, quote) |
+			_mm512_cmpeq_epi8_mask(chunk, backslash) |
+			_mm512_cmplt_epu8_mask(chunk, space)
+		);
+		if (mask) {
+			return pos + __builtin_ctzll(mask);
+		}
+	}
+
+	return json_scan_string_avx2(str, strLen, pos);
+}
+
+__attribute__((target("avx512bw")))
+static size_t json_scan_string_ascii_avx512(const char* str, const size_t strLen, size_t pos) {
+	const __m512i quote = _mm512_set1_epi8('"');
+	const __m512i backslash = _mm512_set1_epi8('\\');
+	const __m512i space = _mm512_set1_epi8(0x20);
+	for (; pos + 64 <= strLen; pos += 64) {
+		const __m512i chunk = _mm512_loadu_si512((const void*) (str + pos));
+		const __mmask64 mask = (
+			_mm512_cmpeq_epi8_mask(chunk, quote) |
+			_mm512_cmpeq_epi8_mask(chunk, backslash) |
+			_mm512_cmplt_epi8_mask(chunk, space)
+		);
+		if (mask) {
+			return pos + __builtin_ctzll(mask);
+		}
+	}
+
+	return json_scan_string_ascii_avx2(str, strLen, pos);
+}
+
+__attribute__((target("avx512bw")))
+static size_t json_scan_plain_avx512(const char* str, const size_t strLen, size_t pos) {
+	const __m512i quote = _mm512_set1_epi8('"');
+	const __m512i space = _mm512_set1_epi8(' ');
+	for (; pos + 64 <= strLen; pos += 64) {
+		const __m512i chunk = _mm512_loadu_si512((const void*) (str + pos));
+		const __mmask64 mask = _mm512_cmpeq_epi8_mask(chunk, quote) | _mm512_cmple_epu8_mask(chunk, space);
+		if (mask) {
+			return pos + __builtin_ctzll(mask);
+		}
+	}
+
+	return json_scan_plain_avx2(str, strLen, pos);
+}
+
+#endif	//#ifdef JSON_SIMD_X86
+
+//Kernels of each JSON_CPU_LEVEL; levels without SIMD kernels on this build use the scalar ones
+static const json_simd_kernels JSON_SIMD_KERNELS[JSON_CPU_LEVEL_MAX] = {
+	{json_scan_string_scalar, json_scan_string_ascii_scalar, json_scan_plain_scalar},
+#ifdef JSON_SIMD_X86
+	{json_scan_string_sse2, json_scan_string_ascii_sse2, json_scan_plain_sse2},
+	{json_scan_string_avx2, json_scan_string_ascii_avx2, json_scan_plain_avx2},
+	{json_scan_string_avx512, json_scan_string_ascii_avx512, json_scan_plain_avx512}
+#else
+	{json_scan_string_scalar, json_scan_string_ascii_scalar, json_scan_plain_scalar},
+	{json_scan_string_scalar, json_scan_string_ascii_scalar, json_scan_plain_scalar},
+	{json_scan_string_scalar, json_scan_string_ascii_scalar, json_scan_plain_scalar}
+#endif	//#ifdef JSON_SIMD_X86
+};
+
+JSON_CPU_LEVEL json_cpu_detect(void) {
+	JSON_CPU_LEVEL level = json_cpu_scalar;
+
+#ifdef JSON_SIMD_X86
+	//Runs cpuid, and xgetbv to check that the OS saves the AVX registers
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		level = json_cpu_sse2;
+	}
+	if (level == json_cpu_sse2 && __builtin_cpu_supports("avx2")) {
+		level = json_cpu_avx2;
+	}
+	if (level == json_cpu_avx2 && __builtin_cpu_supports("avx512bw")) {
+		level = json_cpu_avx512;
+	}
+#endif	//#ifdef JSON_SIMD_X86
+
+	return level;
+}
+
+const json_simd_kernels* json_simd_get_kernels(const JSON_CPU_LEVEL level) {
+	return JSON_SIMD_KERNELS + ((level < JSON_CPU_LEVEL_MAX) ? level : json_cpu_scalar);
+}
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_SIMD_C
@@ -0,0 +1,66 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_simd.h
+ *  @brief Byte scanning kernels selected by the features of the CPU
+ *
+ *  This header is internal to the library and is not installed. Each
+ *  JSON_CPU_LEVEL has a table of kernels; a parser picks the table of the
+ *  level detected by json_cpu_detect() when it is initialized, or the level
+ *  set with the json_cpu_level option. Every kernel has a scalar version, so
+ *  all levels are available on every CPU up to the detected one.
+ */
+
+
+#ifndef JSON_SIMD_H
+#define JSON_SIMD_H
+
+
+#include "json_parser.h"
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+/*! @cond */
+//Returns the position of the first byte at or after pos that the kernel stops at, or strLen
+typedef size_t (*json_scan_function)(const char* str, const size_t strLen, size_t pos);
+
+struct json_simd_kernels {
+	//Stops at quotes, backslashes and control characters
+	json_scan_function scan_string;
+	//Stops at quotes, backslashes, control characters and non-ASCII bytes
+	json_scan_function scan_string_ascii;
+	//Stops at quotes, whitespace and control characters
+	json_scan_function scan_plain;
+};
+
+//Returns the kernels of level, which must not be above json_cpu_detect()
+const json_simd_kernels* json_simd_get_kernels(const JSON_CPU_LEVEL level);
+/*! @endcond */
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_SIMD_H
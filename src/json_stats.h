@@ -0,0 +1,166 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_stats.h
+ *  @brief Allocation counters of json_allocator and phase timers of the parser
+ *
+ *  This header is internal to the library and is not installed. The
+ *  JSON_MALLOC(), JSON_FREE() and JSON_GROW() macros allocate from a
+ *  json_allocator and, when the library is built with JSON_ENABLE_STATS, count
+ *  the memory by JSON_ALLOC_CATEGORY. JSON_TIME_PHASE() runs a statement and,
+ *  with JSON_ENABLE_STATS and the json_time_phases option, adds its time to a
+ *  JSON_PARSER_PHASE. Without JSON_ENABLE_STATS they compile to the plain
+ *  allocator calls and statements.
+ */
+
+
+#ifndef JSON_STATS_H
+#define JSON_STATS_H
+
+
+#include "json_types.h"
+#include "json_parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef JSON_ENABLE_STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif	//#if defined(__x86_64__) || defined(__i386__)
+#endif	//#ifdef JSON_ENABLE_STATS
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+/*! @cond */
+#ifdef JSON_ENABLE_STATS
+
+static inline void json_stats_add(json_allocator_stats* stats, const JSON_ALLOC_CATEGORY category, const size_t size) {
+	stats->allocations += 1;
+	stats->bytesLive += size;
+	if (stats->bytesLive > stats->peakBytes) {
+		stats->peakBytes = stats->bytesLive;
+	}
+	stats->categories[category].allocations += 1;
+	stats->categories[category].bytes += size;
+}
+
+//Memory allocated outside the library may be freed by it; keep the counters from wrapping
+static inline void json_stats_remove(json_allocator_stats* stats, const JSON_ALLOC_CATEGORY category, const size_t size) {
+	json_alloc_category_stats* categoryStats = stats->categories + category;
+	stats->frees += 1;
+	stats->bytesLive -= (size < stats->bytesLive) ? size : stats->bytesLive;
+	categoryStats->frees += 1;
+	categoryStats->bytes -= (size < categoryStats->bytes) ? size : categoryStats->bytes;
+}
+
+static inline void* json_stats_malloc(json_allocator* jsonAlloc, const JSON_ALLOC_CATEGORY category, const size_t size) {
+	void* ptr = json_allocator_malloc(jsonAlloc, size);
+	if (ptr) {
+		json_stats_add(&jsonAlloc->stats, category, size);
+	}
+	return ptr;
+}
+
+static inline void json_stats_free(json_allocator* jsonAlloc, const JSON_ALLOC_CATEGORY category, void* ptr, const size_t size) {
+	if (ptr) {
+		json_stats_remove(&jsonAlloc->stats, category, size);
+	}
+	json_allocator_free_sized(jsonAlloc, ptr, size);
+}
+
+//Growing from nothing counts as an allocation
+static inline void* json_stats_grow(json_allocator* jsonAlloc, const JSON_ALLOC_CATEGORY category, void* ptr, const size_t oldSize, const size_t newSize) {
+	void* newPtr = json_allocator_grow(jsonAlloc, ptr, oldSize, newSize);
+	if (!newPtr) {
+		return newPtr;
+	} else if (!ptr) {
+		json_stats_add(&jsonAlloc->stats, category, newSize);
+		return newPtr;
+	}
+
+	json_allocator_stats* stats = &jsonAlloc->stats;
+	const size_t addSize = newSize - oldSize;
+	stats->growths += 1;
+	stats->growthBytes += addSize;
+	stats->bytesLive += addSize;
+	if (stats->bytesLive > stats->peakBytes) {
+		stats->peakBytes = stats->bytesLive;
+	}
+	stats->categories[category].bytes += addSize;
+	return newPtr;
+}
+
+#define JSON_MALLOC(jsonAlloc, category, size) json_stats_malloc((jsonAlloc), (category), (size))
+#define JSON_FREE(jsonAlloc, category, ptr, size) json_stats_free((jsonAlloc), (category), (ptr), (size))
+#define JSON_GROW(jsonAlloc, category, ptr, oldSize, newSize) json_stats_grow((jsonAlloc), (category), (ptr), (oldSize), (newSize))
+//Count memory allocated by a function that doesn't know its category
+#define JSON_STATS_ADD(jsonAlloc, category, size) json_stats_add(&(jsonAlloc)->stats, (category), (size))
+
+//Ticks of the time stamp counter on x86, nanoseconds elsewhere
+static inline uint64_t json_stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif	//#if defined(__x86_64__) || defined(__i386__)
+}
+
+static inline void json_stats_phase_end(json_parser_phase_stats* stats, const JSON_PARSER_PHASE phase, const uint64_t start) {
+	stats->ticks[phase] += json_stats_ticks() - start;
+	stats->calls[phase] += 1;
+}
+
+//Run stmt, adding its time to phase when the json_time_phases option is set
+#define JSON_TIME_PHASE(parserState, phase, stmt) do {\
+	if ((parserState)->timePhases) {\
+		const uint64_t phaseStart = json_stats_ticks();\
+		stmt;\
+		json_stats_phase_end(&(parserState)->phaseStats, (phase), phaseStart);\
+	} else {\
+		stmt;\
+	}\
+} while (0)
+
+#else
+
+#define JSON_MALLOC(jsonAlloc, category, size) json_allocator_malloc((jsonAlloc), (size))
+#define JSON_FREE(jsonAlloc, category, ptr, size) json_allocator_free_sized((jsonAlloc), (ptr), (size))
+#define JSON_GROW(jsonAlloc, category, ptr, oldSize, newSize) json_allocator_grow((jsonAlloc), (ptr), (oldSize), (newSize))
+#define JSON_STATS_ADD(jsonAlloc, category, size) ((void) 0)
+#define JSON_TIME_PHASE(parserState, phase, stmt) do {\
+	stmt;\
+} while (0)
+
+#endif	//#ifdef JSON_ENABLE_STATS
+/*! @endcond */
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_STATS_H
@@ -0,0 +1,456 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_STRING_BUFFER_C
+#define JSON_STRING_BUFFER_C
+
+
+#define JSON_TOP_LVL 1
+
+
+#include "json_string_buffer.h"
+#include "json_types.h"
+#include "json_parser.h"
+#include "json_utils.h"
+#include "json_simd.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+const size_t JSON_STR_BUFF_INIT_SIZE = 32;
+const double JSON_STR_BUFF_INCR_SIZE = 1.5;
+const size_t JSON_STR_BUFF_INDENT_LEVELS = 16;
+const size_t JSON_STR_BUFF_SINK_SIZE = 4096;
+const size_t JSON_STR_BUFF_IOV_MIN_REF = 128;
+const size_t JSON_STR_BUFF_IOV_INIT_SIZE = 16;
+
+//Classes of bytes when stringifying strings, see JSON_CHAR_CLASS
+//Classes from json_char_utf8_2 are non-ASCII, classes from json_char_escape are always escaped
+enum {
+	json_char_plain = 0,
+	json_char_utf8_2,
+	json_char_utf8_3,
+	json_char_utf8_4,
+	json_char_invalid,
+	json_char_escape,
+	json_char_control
+};
+
+//Maps bytes to their class when stringifying strings
+//Continuation bytes and the lead bytes C0, C1 and F5-FF, which only start overlong or out of range sequences, are invalid
+static const uint8_t JSON_CHAR_CLASS[256] = {
+	6, 6, 6, 6, 6, 6, 6, 6, 5, 5, 5, 6, 5, 5, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+};
+
+//Maps bytes of class json_char_escape to the character of their short escape
+static const char JSON_CHAR_SHORT_ESCAPE[0x60] = {
+	['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't',
+	['"'] = '"', ['\\'] = '\\'
+};
+
+//Maps nibbles to uppercase hexadecimal digits for \u escapes
+static const char JSON_HEX_DIGITS[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+//Maps nibbles to lowercase hexadecimal digits for \u escapes in canonical output
+static const char JSON_HEX_DIGITS_LOWER[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+//Initialize a buffer without any memory for the string
+void json_string_buffer_init(json_string_buffer* strBuff, const char* indent, const int flags) {
+	strBuff->mode = json_buffer_growable;
+	strBuff->string = NULL;
+	strBuff->size = 0;
+	strBuff->capacity = 0;
+	strBuff->indent = (indent) ? indent : "\t";
+	strBuff->indentLen = strlen(strBuff->indent);
+	strBuff->indentLevel = 0;
+	strBuff->indentBuffer = NULL;
+	strBuff->indentBufferLevels = 0;
+	//Canonical output has a single form, so it overrides the other flags
+	strBuff->flags = (flags & json_stringify_canonical) ? json_stringify_canonical : flags;
+	//Source spans are copied without escaping, so escapes override them
+	if (strBuff->flags & (json_stringify_escape_non_bmp | json_stringify_escape_non_ascii)) {
+		strBuff->flags &= ~json_stringify_source_spans;
+	}
+	strBuff->write = NULL;
+	strBuff->writeCtx = NULL;
+	strBuff->iov = NULL;
+	strBuff->iovLen = 0;
+	strBuff->iovCapacity = 0;
+	strBuff->iovMark = 0;
+}
+
+//Write the contents of a sink buffer to its callback and empty it
+int json_string_buffer_flush(json_string_buffer* strBuff) {
+	int retVal = 1;
+
+	if (strBuff->size && strBuff->write(strBuff->writeCtx, strBuff->string, strBuff->size)) {
+		return retVal;
+	}
+	strBuff->size = 0;
+
+	retVal = 0;
+	return retVal;
+}
+
+//Resize and copy contents over if necessary
+//addSize is the additional size needed for the string
+//A sink buffer is flushed instead, and can't make room for more than its capacity
+//A fixed buffer can't be resized
+int json_string_buffer_resize(json_parser_state* parserState, json_string_buffer* strBuff, const size_t addSize) {
+	int retVal = 1;
+	const size_t neededSize = strBuff->size + addSize;
+
+	if (neededSize <= strBuff->capacity || strBuff->mode == json_buffer_count) {
+		//There is enough space
+	} else if (strBuff->mode == json_buffer_fixed) {
+		return retVal;
+	} else if (strBuff->mode == json_buffer_sink) {
+		if (addSize > strBuff->capacity || json_string_buffer_flush(strBuff)) {
+			return retVal;
+		}
+	} else {
+		size_t newCap = align_offset(strBuff->capacity * JSON_STR_BUFF_INCR_SIZE, 16);
+
+		//Try to maintain constant growth of capacity
+		//If inadequate, grow from neededSize
+		if (newCap < neededSize) {
+			newCap = align_offset(neededSize * JSON_STR_BUFF_INCR_SIZE, 16);
+		}
+
+		char* tmpStr = json_allocator_grow(parserState->JSON_Allocator, strBuff->string, strBuff->capacity, newCap);
+		if (!tmpStr) {
+			return retVal;
+		}
+
+		strBuff->capacity = newCap;
+		strBuff->string = tmpStr;
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Add an iovec to the buffer; a NULL base refers to the next bytes of the string buffer
+int json_string_buffer_push_iov(json_parser_state* parserState, json_string_buffer* strBuff, const char* base, const size_t len) {
+	int retVal = 1;
+
+	if (strBuff->iovLen == strBuff->iovCapacity) {
+		const size_t capacity = (strBuff->iovCapacity) ? strBuff->iovCapacity * 2 : JSON_STR_BUFF_IOV_INIT_SIZE;
+		json_iovec* iov = json_allocator_grow(parserState->JSON_Allocator, strBuff->iov, sizeof(json_iovec) * strBuff->iovCapacity, sizeof(json_iovec) * capacity);
+		if (!iov) {
+			return retVal;
+		}
+		strBuff->iov = iov;
+		strBuff->iovCapacity = capacity;
+	}
+
+	strBuff->iov[strBuff->iovLen].iov_base = (void*) base;
+	strBuff->iov[strBuff->iovLen].iov_len = len;
+	strBuff->iovLen += 1;
+
+	retVal = 0;
+	return retVal;
+}
+
+//Add an iovec for the bytes appended to the string buffer since the last one
+int json_string_buffer_close_iov(json_parser_state* parserState, json_string_buffer* strBuff) {
+	int retVal = 0;
+
+	if (strBuff->size > strBuff->iovMark) {
+		retVal = json_string_buffer_push_iov(parserState, strBuff, NULL, strBuff->size - strBuff->iovMark);
+		strBuff->iovMark = strBuff->size;
+	}
+
+	return retVal;
+}
+
+//Write a \\u escape of a UTF-16 code unit to dst, which must have room for 6 bytes
+static inline void json_string_write_u16_escape(char* dst, const uint16_t unit, const char* hexDigits) {
+	dst[0] = '\\';
+	dst[1] = 'u';
+	dst[2] = hexDigits[(unit >> 12) & 0xF];
+	dst[3] = hexDigits[(unit >> 8) & 0xF];
+	dst[4] = hexDigits[(unit >> 4) & 0xF];
+	dst[5] = hexDigits[unit & 0xF];
+}
+
+//Returns whether the character of len bytes at str, starting with a valid lead byte, is well-formed UTF-8
+//Rejects bad continuation bytes, overlong forms, surrogates and code points above U+10FFFF
+static bool json_string_is_utf8_char(const char* str, const size_t len) {
+	const uint8_t* ptr = (const uint8_t*) str;
+	uint8_t low = 0x80;
+	uint8_t high = 0xBF;
+	switch (ptr[0]) {
+		case 0xE0:
+			low = 0xA0;
+		break;
+		case 0xED:
+			high = 0x9F;
+		break;
+		case 0xF0:
+			low = 0x90;
+		break;
+		case 0xF4:
+			high = 0x8F;
+		break;
+	}
+	if (ptr[1] < low || ptr[1] > high) {
+		return false;
+	}
+
+	for (size_t k = 2; k < len; k += 1) {
+		if ((ptr[k] & 0xC0) != 0x80) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Append the escaped form of the character of class charClass at str to the buffer
+//Characters outside the BMP are escaped as UTF-16 surrogate pairs
+static int json_string_buffer_append_escaped(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const uint8_t charClass) {
+	int retVal = 1;
+
+	//Longest escape is a surrogate pair
+	char buff[12];
+	size_t buffLen = 6;
+	const uint8_t* ptr = (const uint8_t*) str;
+	const char* hexDigits = (strBuff->flags & json_stringify_canonical) ? JSON_HEX_DIGITS_LOWER : JSON_HEX_DIGITS;
+	switch (charClass) {
+		case json_char_escape:
+			buff[0] = '\\';
+			buff[1] = JSON_CHAR_SHORT_ESCAPE[ptr[0]];
+			buffLen = 2;
+		break;
+		case json_char_control:
+			json_string_write_u16_escape(buff, ptr[0], hexDigits);
+		break;
+		case json_char_utf8_2:
+			json_string_write_u16_escape(buff, ((ptr[0] & 0x1F) << 6) + (ptr[1] & 0x3F), hexDigits);
+		break;
+		case json_char_utf8_3:
+			json_string_write_u16_escape(buff, ((ptr[0] & 0x0F) << 12) + ((ptr[1] & 0x3F) << 6) + (ptr[2] & 0x3F), hexDigits);
+		break;
+		case json_char_utf8_4: {
+			const uint32_t codePoint = ((ptr[0] & 0x07) << 18) + ((ptr[1] & 0x3F) << 12) + ((ptr[2] & 0x3F) << 6) + (ptr[3] & 0x3F);
+			const uint32_t cp = codePoint - 0x10000;
+			json_string_write_u16_escape(buff, 0xD800 + (cp >> 10), hexDigits);
+			json_string_write_u16_escape(buff + 6, 0xDC00 + (cp & 0x3FF), hexDigits);
+			buffLen = 12;
+		}
+		break;
+		default:
+			return retVal;
+		break;
+	}
+
+	return json_string_buffer_append(parserState, strBuff, buff, buffLen);
+}
+
+//Indent the buffer
+//The indent is copied from a buffer of the indent repeated, grown as deeper levels are reached
+int json_string_buffer_indent(json_parser_state* parserState, json_string_buffer* strBuff, const char* indent, const size_t indentLen, const size_t num) {
+	int retVal = 1;
+
+	if (!num || !indentLen) {
+		retVal = 0;
+		return retVal;
+	} else if (strBuff->mode == json_buffer_fixed || strBuff->mode == json_buffer_count) {
+		//Without allocating
+		for (size_t k = 0; k < num; k += 1) {
+			retVal = json_string_buffer_append(parserState, strBuff, indent, indentLen);
+			if (retVal) {
+				return retVal;
+			}
+		}
+		return retVal;
+	}
+
+	if (num > strBuff->indentBufferLevels) {
+		size_t levels = (strBuff->indentBufferLevels) ? strBuff->indentBufferLevels : JSON_STR_BUFF_INDENT_LEVELS;
+		while (levels < num) {
+			levels *= 2;
+		}
+		char* indentBuffer = json_allocator_grow(parserState->JSON_Allocator, strBuff->indentBuffer, indentLen * strBuff->indentBufferLevels, indentLen * levels);
+		if (!indentBuffer) {
+			return retVal;
+		}
+		for (size_t k = strBuff->indentBufferLevels; k < levels; k += 1) {
+			memcpy(indentBuffer + indentLen * k, indent, indentLen);
+		}
+		strBuff->indentBuffer = indentBuffer;
+		strBuff->indentBufferLevels = levels;
+	}
+
+	return json_string_buffer_append(parserState, strBuff, strBuff->indentBuffer, indentLen * num);
+}
+
+//Append a string as a quoted JSON string, escaped according to the buffer flags
+int json_string_buffer_append_string(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const size_t strLen) {
+	int retVal = 1;
+	const int flags = strBuff->flags;
+
+	const char* ptr = str;
+	const size_t ptrLen = strLen;
+	size_t pos = 0;
+	bool escapeNonAscii = flags & json_stringify_escape_non_ascii;
+	bool escapeNonBmp = flags & json_stringify_escape_non_bmp;
+	bool stopNonAscii = escapeNonAscii || escapeNonBmp;
+	//Finds the end of the run of bytes that can be copied without escaping
+	const json_scan_function scanUnescaped = (stopNonAscii) ? parserState->kernels->scan_string_ascii : parserState->kernels->scan_string;
+
+	//Reserve for the common case of a string without escapes
+	if (strBuff->mode == json_buffer_growable) {
+		retVal = json_string_buffer_resize(parserState, strBuff, ptrLen + 2);
+		if (retVal) {
+			return retVal;
+		}
+	}
+
+	retVal = json_string_buffer_append(parserState, strBuff, "\"", 1);
+	if (retVal) {
+		return retVal;
+	}
+
+	while (pos < ptrLen) {
+		//Copy the run of bytes that need no escaping at once
+		const size_t runLen = scanUnescaped(ptr, ptrLen, pos) - pos;
+		if (runLen) {
+			retVal = json_string_buffer_append_ref(parserState, strBuff, ptr + pos, runLen);
+			if (retVal) {
+				return retVal;
+			}
+			pos += runLen;
+			if (pos >= ptrLen) {
+				break;
+			}
+		}
+
+		const uint8_t charClass = JSON_CHAR_CLASS[(uint8_t) ptr[pos]];
+		bool needEscape = true;
+		size_t incr = 1;
+
+		switch (charClass) {
+			case json_char_escape:
+			case json_char_control:
+			break;
+			case json_char_utf8_2:
+				needEscape = escapeNonAscii;
+				incr = 2;
+			break;
+			case json_char_utf8_3:
+				needEscape = escapeNonAscii;
+				incr = 3;
+			break;
+			case json_char_utf8_4:
+				needEscape = escapeNonAscii || escapeNonBmp;
+				incr = 4;
+			break;
+			default://Invalid UTF-8
+				retVal = 1;
+				return retVal;
+			break;
+		}
+		if (pos + incr > ptrLen) {//Truncated UTF-8
+			retVal = 1;
+			return retVal;
+		} else if (incr > 1 && !json_string_is_utf8_char(ptr + pos, incr)) {//Invalid UTF-8
+			retVal = 1;
+			return retVal;
+		}
+
+		if (needEscape) {
+			retVal = json_string_buffer_append_escaped(parserState, strBuff, ptr + pos, charClass);
+			if (retVal) {
+				return retVal;
+			}
+		} else {
+			retVal = json_string_buffer_append(parserState, strBuff, ptr + pos, incr);
+			if (retVal) {
+				return retVal;
+			}
+		}
+
+		pos += incr;
+	}
+
+	retVal = json_string_buffer_append(parserState, strBuff, "\"", 1);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Append a formatted number to the buffer
+//Canonical output writes negative zero as 0 and has no form for NaN and infinities
+int json_string_buffer_append_number(json_parser_state* parserState, json_string_buffer* strBuff, const double num) {
+	int retVal = 1;
+	char buff[JSON_NUMBER_STRING_MAX];
+
+	if (strBuff->flags & json_stringify_canonical) {
+		if (!isfinite(num)) {
+			return retVal;
+		} else if (num == 0) {
+			return json_string_buffer_append(parserState, strBuff, "0", 1);
+		}
+	}
+
+	const size_t bytes = json_utils_format_number(num, buff);
+	retVal = json_string_buffer_append(parserState, strBuff, buff, bytes);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_STRING_BUFFER_C
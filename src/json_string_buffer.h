@@ -0,0 +1,139 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_string_buffer.h
+ *  @brief Output buffer shared by the stringify and writer functions
+ *
+ *  This header is internal to the library and is not installed. A
+ *  json_string_buffer collects JSON text into memory grown from the allocator,
+ *  a caller's buffer or a sink callback, and knows how to indent and escape it.
+ */
+
+
+#ifndef JSON_STRING_BUFFER_H
+#define JSON_STRING_BUFFER_H
+
+
+#include "json_types.h"
+#include "json_parser.h"
+#include "json_introspect.h"
+
+#include <string.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+/*! @cond */
+extern const size_t JSON_STR_BUFF_INIT_SIZE;
+extern const size_t JSON_STR_BUFF_SINK_SIZE;
+extern const size_t JSON_STR_BUFF_IOV_MIN_REF;
+
+//Where a json_string_buffer puts its output
+enum {
+	json_buffer_growable = 0,	//Allocated and grown from the allocator
+	json_buffer_sink,	//Fixed size and flushed to a callback when full
+	json_buffer_fixed,	//Supplied by the caller, fails when full
+	json_buffer_count,	//Only counts the size of the output
+	json_buffer_iov	//Grown like json_buffer_growable, with long strings referenced by iovecs
+};
+
+typedef struct json_string_buffer {
+	int mode;
+	char* string;
+	size_t size;
+	size_t capacity;
+	const char* indent;
+	size_t indentLen;
+	size_t indentLevel;
+	char* indentBuffer;
+	size_t indentBufferLevels;
+	int flags;
+	json_stringify_write_cb write;
+	void* writeCtx;
+	json_iovec* iov;
+	size_t iovLen;
+	size_t iovCapacity;
+	size_t iovMark;
+} json_string_buffer;
+
+void json_string_buffer_init(json_string_buffer* strBuff, const char* indent, const int flags);
+int json_string_buffer_flush(json_string_buffer* strBuff);
+int json_string_buffer_resize(json_parser_state* parserState, json_string_buffer* strBuff, const size_t addSize);
+int json_string_buffer_push_iov(json_parser_state* parserState, json_string_buffer* strBuff, const char* base, const size_t len);
+int json_string_buffer_close_iov(json_parser_state* parserState, json_string_buffer* strBuff);
+int json_string_buffer_indent(json_parser_state* parserState, json_string_buffer* strBuff, const char* indent, const size_t indentLen, const size_t num);
+int json_string_buffer_append_string(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const size_t strLen);
+int json_string_buffer_append_number(json_parser_state* parserState, json_string_buffer* strBuff, const double num);
+
+//Append to the buffer
+static inline int json_string_buffer_append(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const size_t strLen) {
+	int retVal = 1;
+
+	if (strBuff->size + strLen > strBuff->capacity) {
+		if (strBuff->mode == json_buffer_count) {
+			strBuff->size += strLen;
+			retVal = 0;
+			return retVal;
+		} else if (strBuff->mode == json_buffer_sink && strLen > strBuff->capacity) {
+			//Too large to buffer, write through
+			if (json_string_buffer_flush(strBuff) || strBuff->write(strBuff->writeCtx, str, strLen)) {
+				return retVal;
+			}
+			retVal = 0;
+			return retVal;
+		}
+		retVal = json_string_buffer_resize(parserState, strBuff, strLen);
+		if (retVal) {
+			return retVal;
+		}
+	}
+
+	memcpy(strBuff->string + strBuff->size, str, strLen);
+	strBuff->size += strLen;
+
+	retVal = 0;
+	return retVal;
+}
+
+//Append memory that outlives the buffer; in iov mode long runs are referenced instead of copied
+static inline int json_string_buffer_append_ref(json_parser_state* parserState, json_string_buffer* strBuff, const char* str, const size_t strLen) {
+	int retVal = 1;
+
+	if (strBuff->mode != json_buffer_iov || strLen < JSON_STR_BUFF_IOV_MIN_REF) {
+		return json_string_buffer_append(parserState, strBuff, str, strLen);
+	}
+
+	retVal = json_string_buffer_close_iov(parserState, strBuff);
+	if (retVal) {
+		return retVal;
+	}
+
+	return json_string_buffer_push_iov(parserState, strBuff, str, strLen);
+}
+/*! @endcond */
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_STRING_BUFFER_H
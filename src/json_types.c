@@ -21,9 +21,13 @@
 
 #include "json_types.h"
 #include "json_parser.h"
+#include "json_stats.h"
+#include "json_factory_inline.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 
 const size_t JSON_OBJ_INIT_SIZE = 8;
@@ -39,9 +43,13 @@ extern "C" {
 #endif	//#ifdef __cplusplus
 
 
-static void* json_allocator_alloc(size_t);
-static void json_allocator_free(void*);
+static void* json_allocator_default_alloc(size_t);
+static void json_allocator_default_free(void*);
 static void json_allocator_free_noop(void*);
+static void* json_allocator_default_realloc(void*, size_t);
+static void json_types_init_factory(json_allocator* jsonAlloc, json_factory* jsonFact);
+static json_object_shape* json_object_shape_new(json_factory* jsonFact, json_object* obj);
+static void json_container_clear_source(JSON_VALUE containerType, void* container);
 
 
 const char* const JSON_VALUE_NAMES[] = {
@@ -105,26 +113,76 @@ int json_types_init(alloc_function allocFunction, free_function freeFunction, js
 			return ret;
 		}
 		jsonAlloc->malloc = allocFunction;
-		jsonFact->allocator = jsonAlloc;
+		jsonAlloc->realloc = NULL;
 		if (freeFunction) {
 			jsonAlloc->free = freeFunction;
 		} else {
 			jsonAlloc->free = json_allocator_free_noop;
 		}
 	} else {
-		jsonAlloc = (json_allocator*) json_allocator_alloc(sizeof(json_allocator));
+		jsonAlloc = (json_allocator*) json_allocator_default_alloc(sizeof(json_allocator));
 		if (!jsonAlloc) {
 			return ret;
 		}
-		jsonFact = (json_factory*) json_allocator_alloc(sizeof(json_factory));
+		jsonFact = (json_factory*) json_allocator_default_alloc(sizeof(json_factory));
 		if (!jsonFact) {
-			json_allocator_free(jsonAlloc);
+			json_allocator_default_free(jsonAlloc);
 			return ret;
 		}
-		jsonAlloc->free = json_allocator_free;
-		jsonAlloc->malloc = json_allocator_alloc;
-		jsonFact->allocator = jsonAlloc;
+		jsonAlloc->free = json_allocator_default_free;
+		jsonAlloc->malloc = json_allocator_default_alloc;
+		jsonAlloc->realloc = json_allocator_default_realloc;
 	}
+	jsonAlloc->ctx = NULL;
+	jsonAlloc->ctxMalloc = NULL;
+	jsonAlloc->ctxFree = NULL;
+	jsonAlloc->ctxRealloc = NULL;
+	jsonAlloc->freeSized = NULL;
+	json_types_init_factory(jsonAlloc, jsonFact);
+
+	*jsAllocOut = jsonAlloc;
+	*jsFactoryOut = jsonFact;
+
+	ret = 0;
+	return ret;
+}
+
+int json_types_init_ex(const json_allocator_ctx* ctxAlloc, json_allocator** jsAllocOut, json_factory** jsFactoryOut) {
+	int ret = 1;
+	if (!ctxAlloc || !ctxAlloc->malloc || !ctxAlloc->free) {
+		return ret;
+	}
+
+	json_allocator* jsonAlloc = (json_allocator*) ctxAlloc->malloc(ctxAlloc->ctx, sizeof(json_allocator));
+	if (!jsonAlloc) {
+		return ret;
+	}
+	jsonAlloc->malloc = NULL;
+	jsonAlloc->free = NULL;
+	jsonAlloc->realloc = NULL;
+	jsonAlloc->ctx = ctxAlloc->ctx;
+	jsonAlloc->ctxMalloc = ctxAlloc->malloc;
+	jsonAlloc->ctxFree = ctxAlloc->free;
+	jsonAlloc->ctxRealloc = ctxAlloc->realloc;
+	jsonAlloc->freeSized = ctxAlloc->freeSized;
+
+	json_factory* jsonFact = (json_factory*) json_allocator_malloc(jsonAlloc, sizeof(json_factory));
+	if (!jsonFact) {
+		json_allocator_free_sized(jsonAlloc, jsonAlloc, sizeof(json_allocator));
+		return ret;
+	}
+	json_types_init_factory(jsonAlloc, jsonFact);
+
+	*jsAllocOut = jsonAlloc;
+	*jsFactoryOut = jsonFact;
+
+	ret = 0;
+	return ret;
+}
+
+static void json_types_init_factory(json_allocator* jsonAlloc, json_factory* jsonFact) {
+	memset(&jsonAlloc->stats, 0, sizeof(json_allocator_stats));
+	jsonFact->allocator = jsonAlloc;
 
 	jsonFact->new_json_object = json_factory_new_json_object;
 	jsonFact->new_json_value = json_factory_new_json_value;
@@ -135,124 +193,202 @@ int json_types_init(alloc_function allocFunction, free_function freeFunction, js
 	jsonFact->new_json_false = json_factory_new_json_false;
 	jsonFact->new_json_null = json_factory_new_json_null;
 
-	*jsAllocOut = jsonAlloc;
-	*jsFactoryOut = jsonFact;
-
-	ret = 0;
-	return ret;
+	memset(jsonFact->pools, 0, sizeof(jsonFact->pools));
+	jsonFact->poolLimit = 0;
 }
 
 /* Default JSON Alloc and Free functions */
 
-static void* json_allocator_alloc(size_t size) {
+static void* json_allocator_default_alloc(size_t size) {
 	return malloc(size);
 }
-static void json_allocator_free(void* ptr) {
+static void json_allocator_default_free(void* ptr) {
 	return free(ptr);
 }
 static void json_allocator_free_noop(void* ptr) {
 	//Do Nothing
 }
+static void* json_allocator_default_realloc(void* ptr, size_t size) {
+	return realloc(ptr, size);
+}
 
-/* JSON Factory functions */
+//Resize the memory at ptr from oldSize to newSize bytes, in place if the allocator has a realloc function
+//oldSize must be the size ptr was allocated or last grown with
+//Returns the resized memory, or NULL on failure in which case ptr is untouched
+void* json_allocator_grow(json_allocator* jsonAlloc, void* ptr, const size_t oldSize, const size_t newSize) {
+	if (jsonAlloc->ctxRealloc && ptr) {
+		return jsonAlloc->ctxRealloc(jsonAlloc->ctx, ptr, oldSize, newSize);
+	} else if (jsonAlloc->realloc) {
+		return jsonAlloc->realloc(ptr, newSize);
+	}
 
-json_object* json_factory_new_json_object(json_factory* jsonFact, json_value* objParentValue) {
-	json_object* obj = (json_object*) jsonFact->allocator->malloc( sizeof(json_object) );
-	if (!obj) {
+	void* newPtr = json_allocator_malloc(jsonAlloc, newSize);
+	if (!newPtr) {
 		return NULL;
 	}
+	if (ptr) {
+		memcpy(newPtr, ptr, (oldSize < newSize) ? oldSize : newSize);
+		json_allocator_free_sized(jsonAlloc, ptr, oldSize);
+	}
 
-	obj->names = NULL;
-	obj->values = NULL;
-	obj->size = 0;
-	obj->capacity = 0;
-	obj->parentValue = objParentValue;
-
-	return obj;
+	return newPtr;
 }
-json_value* json_factory_new_json_value(json_factory* jsonFact, JSON_VALUE valValueType, void* valValue, JSON_VALUE valParentValueType, void* valParentValue) {
-	json_value* value = (json_value*) jsonFact->allocator->malloc( sizeof(json_value) );
-	if (!value) {
-		return NULL;
-	}
 
-	value->valueType = valValueType;
-	value->value = valValue;
+/* JSON Factory node pools */
 
-	value->parentValueType = valParentValueType;
-	value->parentValue = valParentValue;
+//Returns a node of the given pool, reusing a freed one if there is one
+void* json_factory_alloc_node(json_factory* jsonFact, const JSON_NODE_POOL pool, const size_t size) {
+	json_node_pool* nodePool = jsonFact->pools + pool;
+	void* node = nodePool->head;
+	if (!node) {
+		return JSON_MALLOC(jsonFact->allocator, (JSON_ALLOC_CATEGORY) pool, size);
+	}
 
-	return value;
+	nodePool->head = *((void**) node);
+	nodePool->count -= 1;
+	return node;
 }
-json_string* json_factory_new_json_string(json_factory* jsonFact, const char* strValue, size_t strValueLen, json_value* strParentValue) {
-	json_string* str = (json_string*) jsonFact->allocator->malloc( sizeof(json_string) );
-	if (!str) {
-		return NULL;
-	}
 
-	str->value = strValue;
-	str->valueLen = strValueLen;
-	str->parentValue = strParentValue;
+//Keep node for reuse if its pool has room, else free it
+void json_factory_free_node(json_factory* jsonFact, const JSON_NODE_POOL pool, void* node, const size_t size) {
+	json_node_pool* nodePool = jsonFact->pools + pool;
+	if (!node) {
+		return;
+	} else if (nodePool->count >= jsonFact->poolLimit) {
+		JSON_FREE(jsonFact->allocator, (JSON_ALLOC_CATEGORY) pool, node, size);
+		return;
+	}
 
-	return str;
+	*((void**) node) = nodePool->head;
+	nodePool->head = node;
+	nodePool->count += 1;
 }
-json_number* json_factory_new_json_number(json_factory* jsonFact, double numValue, json_value* numParentValue) {
-	json_number* num = (json_number*) jsonFact->allocator->malloc( sizeof(json_number) );
-	if (!num) {
-		return NULL;
+
+//Free the nodes of each pool beyond limit
+void json_factory_trim_pools(json_factory* jsonFact, const size_t limit) {
+	static const size_t nodeSizes[JSON_NODE_POOL_MAX] = {
+		sizeof(json_value), sizeof(json_object), sizeof(json_array), sizeof(json_string), sizeof(json_number)
+	};
+
+	for (size_t pool = 0; pool < JSON_NODE_POOL_MAX; pool += 1) {
+		json_node_pool* nodePool = jsonFact->pools + pool;
+		while (nodePool->count > limit) {
+			void* node = nodePool->head;
+			nodePool->head = *((void**) node);
+			nodePool->count -= 1;
+			JSON_FREE(jsonFact->allocator, (JSON_ALLOC_CATEGORY) pool, node, nodeSizes[pool]);
+		}
 	}
+}
 
-	num->value = numValue;
-	num->parentValue = numParentValue;
+/* JSON Factory functions */
 
-	return num;
+json_object* json_factory_new_json_object(json_factory* jsonFact, json_value* objParentValue) {
+	json_object* obj = (json_object*) json_factory_alloc_node(jsonFact, json_pool_object, sizeof(json_object));
+	return json_factory_init_json_object(obj, objParentValue);
+}
+json_value* json_factory_new_json_value(json_factory* jsonFact, JSON_VALUE valValueType, void* valValue, JSON_VALUE valParentValueType, void* valParentValue) {
+	json_value* value = (json_value*) json_factory_alloc_node(jsonFact, json_pool_value, sizeof(json_value));
+	return json_factory_init_json_value(value, valValueType, valValue, valParentValueType, valParentValue);
+}
+json_string* json_factory_new_json_string(json_factory* jsonFact, const char* strValue, size_t strValueLen, json_value* strParentValue) {
+	json_string* str = (json_string*) json_factory_alloc_node(jsonFact, json_pool_string, sizeof(json_string));
+	return json_factory_init_json_string(str, strValue, strValueLen, strParentValue);
+}
+json_number* json_factory_new_json_number(json_factory* jsonFact, double numValue, json_value* numParentValue) {
+	json_number* num = (json_number*) json_factory_alloc_node(jsonFact, json_pool_number, sizeof(json_number));
+	return json_factory_init_json_number(num, numValue, numParentValue);
 }
 json_array* json_factory_new_json_array(json_factory* jsonFact, json_value* arrParentValue) {
-	json_array* arr = (json_array*) jsonFact->allocator->malloc( sizeof(json_array) );
-	if (!arr) {
-		return NULL;
-	}
+	json_array* arr = (json_array*) json_factory_alloc_node(jsonFact, json_pool_array, sizeof(json_array));
+	return json_factory_init_json_array(arr, arrParentValue);
+}
+json_true* json_factory_new_json_true(json_factory* jsonFact, json_value* truParentValue) {
+	json_true* tru = (json_true*) JSON_MALLOC(jsonFact->allocator, json_alloc_literal, sizeof(json_true));
+	return json_factory_init_json_true(tru, truParentValue);
+}
+json_false* json_factory_new_json_false(json_factory* jsonFact, json_value* falParentValue) {
+	json_false* fal = (json_false*) JSON_MALLOC(jsonFact->allocator, json_alloc_literal, sizeof(json_false));
+	return json_factory_init_json_false(fal, falParentValue);
+}
+json_null* json_factory_new_json_null(json_factory* jsonFact, json_value* nulParentValue) {
+	json_null* nul = (json_null*) JSON_MALLOC(jsonFact->allocator, json_alloc_literal, sizeof(json_null));
+	return json_factory_init_json_null(nul, nulParentValue);
+}
 
-	arr->values = NULL;
-	arr->size = 0;
-	arr->capacity = 0;
-	arr->parentValue = arrParentValue;
+//Returns nonzero if the factory makes nodes with the default functions from malloc, so they can be made inline
+int json_factory_is_default(json_factory* jsonFact) {
+	const json_allocator* jsonAlloc = jsonFact->allocator;
+	return (
+		jsonAlloc->malloc == json_allocator_default_alloc &&
+		jsonAlloc->free == json_allocator_default_free &&
+		!jsonAlloc->ctxMalloc &&
+		jsonFact->new_json_object == json_factory_new_json_object &&
+		jsonFact->new_json_value == json_factory_new_json_value &&
+		jsonFact->new_json_string == json_factory_new_json_string &&
+		jsonFact->new_json_number == json_factory_new_json_number &&
+		jsonFact->new_json_array == json_factory_new_json_array &&
+		jsonFact->new_json_true == json_factory_new_json_true &&
+		jsonFact->new_json_false == json_factory_new_json_false &&
+		jsonFact->new_json_null == json_factory_new_json_null
+	);
+}
+
+/* JSON Value manipulation functions */
 
-	return arr;
+//FNV-1a hash of the given string, used to compare object names
+uint32_t json_hash_string(const char* str, const size_t strLen) {
+	const uint8_t* ptr = (const uint8_t*) str;
+	uint32_t hash = 2166136261U;
+	for (size_t k = 0; k < strLen; k += 1) {
+		hash ^= ptr[k];
+		hash *= 16777619U;
+	}
+	return hash;
 }
-json_true* json_factory_new_json_true(json_factory* jsonFact, json_value* truParentValue) {
-	json_true* tru = (json_true*) jsonFact->allocator->malloc( sizeof(json_true) );
-	if (!tru) {
+
+//Create an interned name holding one reference, with the text stored after the struct
+//Returns the name, or NULL on failure
+json_string* json_interned_string_new(json_factory* jsonFact, const char* str, const size_t strLen, uint32_t hash) {
+	if (!jsonFact || (!str && strLen)) {
 		return NULL;
 	}
 
-	tru->parentValue = truParentValue;
-
-	return tru;
-}
-json_false* json_factory_new_json_false(json_factory* jsonFact, json_value* falParentValue) {
-	json_false* fal = (json_false*) jsonFact->allocator->malloc( sizeof(json_false) );
-	if (!fal) {
+	json_interned_string* interned = (json_interned_string*) JSON_MALLOC(jsonFact->allocator, json_alloc_string, sizeof(json_interned_string) + strLen + 1);
+	if (!interned) {
 		return NULL;
 	}
 
-	fal->parentValue = falParentValue;
+	char* data = (char*) (interned + 1);
+	if (strLen) {
+		memcpy(data, str, strLen);
+	}
+	data[strLen] = 0;
+
+	interned->string.value = data;
+	interned->string.valueLen = strLen;
+	interned->string.parentValue = NULL;
+	interned->hash = hash;
+	interned->refCount = 1;
 
-	return fal;
+	return &interned->string;
 }
-json_null* json_factory_new_json_null(json_factory* jsonFact, json_value* nulParentValue) {
-	json_null* nul = (json_null*) jsonFact->allocator->malloc( sizeof(json_null) );
-	if (!nul) {
-		return NULL;
+
+//Drop a reference to an interned name, freeing it with the last reference
+void json_interned_string_release(json_factory* jsonFact, json_string* str) {
+	if (!jsonFact || !str) {
+		return;
 	}
 
-	nul->parentValue = nulParentValue;
+	json_interned_string* interned = (json_interned_string*) str;
+	if (interned->refCount > 1) {
+		interned->refCount -= 1;
+		return;
+	}
 
-	return nul;
+	JSON_FREE(jsonFact->allocator, json_alloc_string, interned, sizeof(json_interned_string) + interned->string.valueLen + 1);
 }
 
-/* JSON Value manipulation functions */
-
 //Increase size of object; realloc if necessary
 //Returns zero on success, nonzero on error
 int json_object_resize(json_factory* jsonFact, json_object* obj, const size_t newSize) {
@@ -264,59 +400,348 @@ int json_object_resize(json_factory* jsonFact, json_object* obj, const size_t ne
 
 	if (!obj->capacity) {//Uninitialized
 		const size_t size = (newSize <= JSON_OBJ_INIT_SIZE) ? JSON_OBJ_INIT_SIZE : align_offset(newSize, JSON_ALIGN_SIZE);
-		obj->names = (json_string**) jsonFact->allocator->malloc( sizeof(json_string*) * size );
-		if (!obj->names) {
-			return retVal;
-		}
-		obj->values = (json_value**) jsonFact->allocator->malloc( sizeof(json_value*) * size );
-		if (!obj->values) {
-			return retVal;
-		}
-		obj->capacity = size;
-	} else if (obj->size < obj->capacity) {
+		return json_object_reserve(jsonFact, obj, size);
+	} else if (newSize <= obj->capacity) {
 		//There is enough space
 	} else {//Realloc
 		const size_t sizeIncr = align_offset(obj->capacity * JSON_OBJ_INCR_SIZE, JSON_ALIGN_SIZE);
 		const size_t size = (newSize <= sizeIncr) ? sizeIncr : align_offset(newSize, JSON_ALIGN_SIZE);
-		json_string** names = (json_string**) jsonFact->allocator->malloc( sizeof(json_string*) * size );
-		if (!names) {
-			return retVal;
-		}
-		json_value** values = (json_value**) jsonFact->allocator->malloc( sizeof(json_value*) * size );
-		if (!values) {
-			jsonFact->allocator->free(names);
-			return retVal;
-		}
-		memcpy(names, obj->names, sizeof(obj->names) * obj->capacity);
-		memcpy(values, obj->values, sizeof(obj->values) * obj->capacity);
-		jsonFact->allocator->free(obj->names);
-		jsonFact->allocator->free(obj->values);
-		obj->names = names;
-		obj->values = values;
-		obj->capacity = size;
+		return json_object_reserve(jsonFact, obj, size);
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Set capacity of object to exactly the given capacity if it is larger than the current one
+//Returns zero on success, nonzero on error
+int json_object_reserve(json_factory* jsonFact, json_object* obj, const size_t capacity) {
+	int retVal = 1;
+
+	if (!jsonFact || !obj || json_object_unshape(jsonFact, obj)) {
+		return retVal;
+	} else if (capacity <= obj->capacity) {
+		retVal = 0;
+		return retVal;
 	}
 
+	json_object_member* members = (json_object_member*) JSON_GROW(jsonFact->allocator, json_alloc_buffer, obj->members, sizeof(json_object_member) * obj->capacity, sizeof(json_object_member) * capacity);
+	if (!members) {
+		return retVal;
+	}
+	obj->members = members;
+	obj->capacity = capacity;
+
 	retVal = 0;
 	return retVal;
 }
 
+//Drop the source spans of a container and its ancestors
+//A container without a span has no ancestor with one, so the walk stops there
+static void json_container_clear_source(JSON_VALUE containerType, void* container) {
+	while (container) {
+		json_value* parentValue = NULL;
+		if (containerType == object_value) {
+			json_object* obj = (json_object*) container;
+			if (!obj->source) {
+				return;
+			}
+			obj->source = NULL;
+			obj->sourceLen = 0;
+			parentValue = obj->parentValue;
+		} else if (containerType == array_value) {
+			json_array* arr = (json_array*) container;
+			if (!arr->source) {
+				return;
+			}
+			arr->source = NULL;
+			arr->sourceLen = 0;
+			parentValue = arr->parentValue;
+		} else {
+			return;
+		}
+
+		if (!parentValue) {
+			return;
+		}
+		containerType = parentValue->parentValueType;
+		container = parentValue->parentValue;
+	}
+}
+
+void json_value_mark_modified(json_value* value) {
+	if (!value) {
+		return;
+	}
+
+	if (value->valueType == object_value || value->valueType == array_value) {
+		json_container_clear_source(value->valueType, value->value);
+	}
+	json_container_clear_source(value->parentValueType, value->parentValue);
+}
+
 //Returns zero on success, nonzero on error
 int json_object_add_pair(json_factory* jsonFact, json_object* obj, json_string* name, json_value* value) {
+	if (!name) {
+		return 1;
+	}
+
+	return json_object_add_member(jsonFact, obj, name, value, json_hash_string(name->value, name->valueLen), 0);
+}
+
+//Add a pair whose name hash is already known; flags are JSON_MEMBER_FLAGS
+//Returns zero on success, nonzero on error
+int json_object_add_member(json_factory* jsonFact, json_object* obj, json_string* name, json_value* value, uint32_t hash, uint32_t flags) {
 	int retVal = 1;
 
 	if (!jsonFact || !obj || !name || !value) {
 		return retVal;
 	}
 
+	retVal = json_object_unshape(jsonFact, obj);
+	if (retVal) {
+		return retVal;
+	}
+
 	const size_t size = obj->size;
 	retVal = json_object_resize(jsonFact, obj, size + 1);
 	if (retVal) {
 		return retVal;
 	}
 
-	obj->names[size] = name;
-	obj->values[size] = value;
+	json_object_member* member = obj->members + size;
+	member->name = name;
+	member->value = value;
+	member->hash = hash;
+	member->flags = flags;
 	obj->size += 1;
+	json_container_clear_source(object_value, obj);
+
+	retVal = 0;
+	return retVal;
+}
+
+//Free a name of an object member or shape; flags are JSON_MEMBER_FLAGS
+//Returns zero on success, nonzero on error
+int json_object_free_name(json_factory* jsonFact, json_string* name, uint32_t flags) {
+	if (flags & json_member_interned_name) {
+		json_interned_string_release(jsonFact, name);
+		return (name) ? 0 : 1;
+	}
+
+	return json_visitor_free_string(jsonFact, name);
+}
+
+/* JSON Object shape functions */
+
+//Hash of the sequence of names of an unshaped object
+size_t json_object_shape_hash(const json_object* obj) {
+	uint64_t hash = 14695981039346656037ULL ^ obj->size;
+	for (size_t k = 0, n = obj->size; k < n; k += 1) {
+		hash ^= obj->members[k].hash;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t) hash;
+}
+
+//Returns nonzero if the unshaped object has the names of the shape in the same order, zero otherwise
+int json_object_shape_matches(const json_object_shape* shape, const json_object* obj) {
+	if (!shape || !obj || !obj->members || shape->size != obj->size) {
+		return 0;
+	}
+
+	for (size_t k = 0, n = obj->size; k < n; k += 1) {
+		const json_object_member* member = obj->members + k;
+		const json_string* name = shape->names[k];
+		if (
+			member->hash != shape->hashes[k]
+			|| member->name->valueLen != name->valueLen
+			|| memcmp(member->name->value, name->value, name->valueLen)
+		) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+//Size of the block holding a shape of size names with a lookup table of tableSize slots
+static size_t json_object_shape_block_size(const size_t size, const size_t tableSize) {
+	const size_t namesOffset = align_offset(sizeof(json_object_shape), JSON_ALIGN_SIZE);
+	return namesOffset + (sizeof(json_string*) + sizeof(uint32_t)) * size + sizeof(uint32_t) * tableSize;
+}
+
+//Create a shape referencing the names of an unshaped object; only used by json_object_set_shape()
+//The shape, its names, hashes and lookup table are allocated in one block
+//Objects with both interned and uninterned names can't be shaped
+static json_object_shape* json_object_shape_new(json_factory* jsonFact, json_object* obj) {
+	const size_t size = obj->size;
+	if (!size || size >= UINT32_MAX / 2) {
+		return NULL;
+	}
+
+	const uint32_t flags = obj->members[0].flags;
+	for (size_t k = 1; k < size; k += 1) {
+		if (obj->members[k].flags != flags) {
+			return NULL;
+		}
+	}
+
+	size_t tableSize = 4;
+	while (tableSize < size * 2) {
+		tableSize *= 2;
+	}
+
+	const size_t namesOffset = align_offset(sizeof(json_object_shape), JSON_ALIGN_SIZE);
+	const size_t hashesOffset = namesOffset + sizeof(json_string*) * size;
+	const size_t tableOffset = hashesOffset + sizeof(uint32_t) * size;
+	char* block = (char*) JSON_MALLOC(jsonFact->allocator, json_alloc_shape, json_object_shape_block_size(size, tableSize));
+	if (!block) {
+		return NULL;
+	}
+
+	json_object_shape* shape = (json_object_shape*) block;
+	shape->names = (json_string**) (block + namesOffset);
+	shape->hashes = (uint32_t*) (block + hashesOffset);
+	shape->table = (uint32_t*) (block + tableOffset);
+	shape->tableMask = tableSize - 1;
+	shape->size = size;
+	shape->flags = flags;
+	shape->hash = json_object_shape_hash(obj);
+	shape->refCount = 0;
+	memset(shape->table, 0, sizeof(uint32_t) * tableSize);
+
+	for (size_t k = 0; k < size; k += 1) {
+		const uint32_t hash = obj->members[k].hash;
+		shape->names[k] = obj->members[k].name;
+		shape->hashes[k] = hash;
+
+		size_t slot = hash & shape->tableMask;
+		while (shape->table[slot]) {
+			slot = (slot + 1) & shape->tableMask;
+		}
+		shape->table[slot] = k + 1;
+	}
+
+	return shape;
+}
+
+//Drop a reference to the shape, freeing it and its names with the last reference
+void json_object_shape_release(json_factory* jsonFact, json_object_shape* shape) {
+	if (!jsonFact || !shape) {
+		return;
+	} else if (shape->refCount > 1) {
+		shape->refCount -= 1;
+		return;
+	}
+
+	for (size_t k = 0, n = shape->size; k < n; k += 1) {
+		json_object_free_name(jsonFact, shape->names[k], shape->flags);
+	}
+	JSON_FREE(jsonFact->allocator, json_alloc_shape, shape, json_object_shape_block_size(shape->size, shape->tableMask + 1));
+}
+
+//Convert an unshaped object to store only its values, with its names held by shape
+//The shape must match the object, see json_object_shape_matches()
+//If shape is NULL, a new shape is created taking the names of the object
+//Returns the shape of the object, or NULL on failure in which case the object is unchanged
+json_object_shape* json_object_set_shape(json_factory* jsonFact, json_object* obj, json_object_shape* shape) {
+	if (!jsonFact || !obj || !obj->members || obj->shape || !obj->size) {
+		return NULL;
+	}
+
+	const size_t size = obj->size;
+	json_value** values = (json_value**) JSON_MALLOC(jsonFact->allocator, json_alloc_buffer, sizeof(json_value*) * size);
+	if (!values) {
+		return NULL;
+	}
+
+	const bool ownNames = !shape;
+	if (ownNames) {
+		shape = json_object_shape_new(jsonFact, obj);
+		if (!shape) {
+			JSON_FREE(jsonFact->allocator, json_alloc_buffer, values, sizeof(json_value*) * size);
+			return NULL;
+		}
+	}
+
+	for (size_t k = 0; k < size; k += 1) {
+		values[k] = obj->members[k].value;
+		if (!ownNames) {
+			json_object_free_name(jsonFact, obj->members[k].name, obj->members[k].flags);
+		}
+	}
+
+	JSON_FREE(jsonFact->allocator, json_alloc_buffer, obj->members, sizeof(json_object_member) * obj->capacity);
+	obj->members = NULL;
+	obj->values = values;
+	obj->capacity = size;
+	obj->shape = shape;
+	shape->refCount += 1;
+
+	return shape;
+}
+
+//Convert a shaped object back to store name/value pairs, copying the names of its shape unless interned
+//Does nothing if the object is not shaped
+//Returns zero on success, nonzero on error
+int json_object_unshape(json_factory* jsonFact, json_object* obj) {
+	int retVal = 1;
+
+	if (!jsonFact || !obj) {
+		return retVal;
+	} else if (!obj->shape) {
+		retVal = 0;
+		return retVal;
+	}
+
+	json_object_shape* shape = obj->shape;
+	const size_t size = obj->size;
+	json_object_member* members = (json_object_member*) JSON_MALLOC(jsonFact->allocator, json_alloc_buffer, sizeof(json_object_member) * size);
+	if (!members) {
+		return retVal;
+	}
+
+	for (size_t k = 0; k < size; k += 1) {
+		if (shape->flags & json_member_interned_name) {
+			//Interned names are shared, not copied
+			json_interned_string* interned = (json_interned_string*) shape->names[k];
+			interned->refCount += 1;
+			members[k].name = shape->names[k];
+			members[k].value = obj->values[k];
+			members[k].hash = shape->hashes[k];
+			members[k].flags = shape->flags;
+			continue;
+		}
+
+		const json_string* name = shape->names[k];
+		char* data = (char*) JSON_MALLOC(jsonFact->allocator, json_alloc_string, sizeof(char) * (name->valueLen + 1));
+		json_string* str = (data) ? jsonFact->new_json_string(jsonFact, data, name->valueLen, NULL) : NULL;
+		if (!str) {
+			if (data) {
+				JSON_FREE(jsonFact->allocator, json_alloc_string, data, name->valueLen + 1);
+			}
+			for (size_t n = 0; n < k; n += 1) {
+				json_object_free_name(jsonFact, members[n].name, members[n].flags);
+			}
+			JSON_FREE(jsonFact->allocator, json_alloc_buffer, members, sizeof(json_object_member) * size);
+			return retVal;
+		}
+		memcpy(data, name->value, name->valueLen);
+		data[name->valueLen] = 0;
+
+		members[k].name = str;
+		members[k].value = obj->values[k];
+		members[k].hash = shape->hashes[k];
+		members[k].flags = 0;
+	}
+
+	JSON_FREE(jsonFact->allocator, json_alloc_buffer, obj->values, sizeof(json_value*) * obj->capacity);
+	obj->values = NULL;
+	obj->members = members;
+	obj->capacity = size;
+	obj->shape = NULL;
+	json_object_shape_release(jsonFact, shape);
 
 	retVal = 0;
 	return retVal;
@@ -336,26 +761,64 @@ int json_array_resize(json_factory* jsonFact, json_array* arr, const size_t newS
 
 	if (!arr->capacity) {//Uninitialized
 		const size_t size = (newSize <= JSON_ARRAY_INIT_SIZE) ? JSON_ARRAY_INIT_SIZE : align_offset(newSize, JSON_ALIGN_SIZE);
-		arr->values = (json_value**) jsonFact->allocator->malloc( sizeof(json_value*) * size );
-		if (!arr->values) {
-			return retVal;
-		}
-		arr->capacity = size;
-	} else if (newSize < arr->capacity ) {//Size < Capacity
+		return json_array_reserve(jsonFact, arr, size);
+	} else if (newSize <= arr->capacity) {//Size <= Capacity
 		//There is enough space
 	} else {//Realloc
 		const size_t sizeIncr = align_offset(arr->capacity * JSON_ARRAY_INCR_SIZE, JSON_ALIGN_SIZE);
 		const size_t size = (newSize <= sizeIncr) ? sizeIncr : align_offset(newSize, JSON_ALIGN_SIZE);
-		json_value** values = (json_value**) jsonFact->allocator->malloc( sizeof(json_value*) * size );
-		if (!values) {
-			return retVal;
-		}
+		return json_array_reserve(jsonFact, arr, size);
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Set capacity of array to exactly the given capacity if it is larger than the current one
+//Grows the numbers of a packed array, values otherwise
+//Returns zero on success, nonzero on error
+int json_array_reserve(json_factory* jsonFact, json_array* arr, const size_t capacity) {
+	int retVal = 1;
+
+	if (!jsonFact || !arr) {
+		return retVal;
+	} else if (arr->numbers) {
+		return json_array_reserve_numbers(jsonFact, arr, capacity);
+	} else if (capacity <= arr->capacity) {
+		retVal = 0;
+		return retVal;
+	}
+
+	json_value** values = (json_value**) JSON_GROW(jsonFact->allocator, json_alloc_buffer, arr->values, sizeof(json_value*) * arr->capacity, sizeof(json_value*) * capacity);
+	if (!values) {
+		return retVal;
+	}
+	arr->values = values;
+	arr->capacity = capacity;
+
+	retVal = 0;
+	return retVal;
+}
 
-		memcpy(values, arr->values, sizeof(arr->values) * arr->capacity);
-		jsonFact->allocator->free(arr->values);
-		arr->values = values;
-		arr->capacity = size;
+//Set capacity of packed array to exactly the given capacity if it is larger than the current one
+//The array must be empty or packed
+//Returns zero on success, nonzero on error
+int json_array_reserve_numbers(json_factory* jsonFact, json_array* arr, const size_t capacity) {
+	int retVal = 1;
+
+	if (!jsonFact || !arr || arr->values) {
+		return retVal;
+	} else if (arr->numbers && capacity <= arr->capacity) {
+		retVal = 0;
+		return retVal;
+	}
+
+	double* numbers = (double*) JSON_GROW(jsonFact->allocator, json_alloc_buffer, arr->numbers, sizeof(double) * arr->capacity, sizeof(double) * capacity);
+	if (!numbers) {
+		return retVal;
 	}
+	arr->numbers = numbers;
+	arr->capacity = capacity;
 
 	retVal = 0;
 	return retVal;
@@ -369,6 +832,11 @@ int json_array_add_element(json_factory* jsonFact, json_array* arr, json_value*
 		return retVal;
 	}
 
+	retVal = json_array_unpack(jsonFact, arr);
+	if (retVal) {
+		return retVal;
+	}
+
 	const size_t size = arr->size;
 	retVal = json_array_resize(jsonFact, arr, size + 1);
 	if (retVal) {
@@ -377,6 +845,80 @@ int json_array_add_element(json_factory* jsonFact, json_array* arr, json_value*
 
 	arr->values[size] = value;
 	arr->size += 1;
+	json_container_clear_source(array_value, arr);
+
+	retVal = 0;
+	return retVal;
+}
+
+//Append a number to a packed array; the array must be empty or packed
+//Returns zero on success, nonzero on error
+int json_array_add_number(json_factory* jsonFact, json_array* arr, double num) {
+	int retVal = 1;
+
+	if (!jsonFact || !arr || arr->values) {
+		return retVal;
+	}
+
+	const size_t size = arr->size;
+	if (!arr->numbers || size == arr->capacity) {
+		const size_t sizeIncr = align_offset(arr->capacity * JSON_ARRAY_INCR_SIZE, JSON_ALIGN_SIZE);
+		const size_t capacity = (!arr->numbers || sizeIncr < JSON_ARRAY_INIT_SIZE) ? JSON_ARRAY_INIT_SIZE : sizeIncr;
+		retVal = json_array_reserve_numbers(jsonFact, arr, capacity);
+		if (retVal) {
+			return retVal;
+		}
+	}
+
+	arr->numbers[size] = num;
+	arr->size += 1;
+	json_container_clear_source(array_value, arr);
+
+	retVal = 0;
+	return retVal;
+}
+
+//Convert a packed array to an array of json_value holding json_number
+//Does nothing if the array is not packed
+//Returns zero on success, nonzero on error
+int json_array_unpack(json_factory* jsonFact, json_array* arr) {
+	int retVal = 1;
+
+	if (!jsonFact || !arr) {
+		return retVal;
+	} else if (!arr->numbers) {
+		retVal = 0;
+		return retVal;
+	}
+
+	const size_t size = arr->size;
+	const size_t capacity = (arr->capacity > size) ? arr->capacity : ((size) ? size : 1);
+	json_value** values = (json_value**) JSON_MALLOC(jsonFact->allocator, json_alloc_buffer, sizeof(json_value*) * capacity);
+	if (!values) {
+		return retVal;
+	}
+
+	for (size_t k = 0; k < size; k += 1) {
+		json_value* val = jsonFact->new_json_value(jsonFact, number_value, NULL, array_value, arr);
+		json_number* num = (val) ? jsonFact->new_json_number(jsonFact, arr->numbers[k], val) : NULL;
+		if (!num) {
+			if (val) {
+				json_factory_free_node(jsonFact, json_pool_value, val, sizeof(json_value));
+			}
+			for (size_t n = 0; n < k; n += 1) {
+				json_visitor_free_value(jsonFact, values[n]);
+			}
+			JSON_FREE(jsonFact->allocator, json_alloc_buffer, values, sizeof(json_value*) * capacity);
+			return retVal;
+		}
+		val->value = num;
+		values[k] = val;
+	}
+
+	JSON_FREE(jsonFact->allocator, json_alloc_buffer, arr->numbers, sizeof(double) * arr->capacity);
+	arr->numbers = NULL;
+	arr->values = values;
+	arr->capacity = capacity;
 
 	retVal = 0;
 	return retVal;
@@ -448,21 +990,34 @@ int json_visitor_free_value(json_factory* jsonFact, json_value* value) {
 	}
 
 	if (!ret) {
-		jsonFact->allocator->free(value);
+		json_factory_free_node(jsonFact, json_pool_value, value, sizeof(json_value));
 	}
 
 	return ret;
 }
 int json_visitor_free_object(json_factory* jsonFact, json_object* obj) {
-	int ret = (!obj || (obj->size > 0 && (!obj->names || !obj->values))) ? 1 : 0;
+	int ret = (!obj || (obj->size > 0 && !obj->members && !obj->values)) ? 1 : 0;
 
-	if (!ret) {
+	if (!ret && obj->shape) {
 		for (size_t k = 0, n = obj->size; k < n; k += 1) {
 			ret = json_visitor_free_value(jsonFact, obj->values[k]);
+			if (ret) {
+				return ret;
+			}
+		}
+		JSON_FREE(jsonFact->allocator, json_alloc_buffer, obj->values, sizeof(json_value*) * obj->capacity);
+		json_object_shape_release(jsonFact, obj->shape);
+		json_factory_free_node(jsonFact, json_pool_object, obj, sizeof(json_object));
+		return ret;
+	}
+
+	if (!ret) {
+		for (size_t k = 0, n = obj->size; k < n; k += 1) {
+			ret = json_visitor_free_value(jsonFact, obj->members[k].value);
 			if (ret) {
 				break;
 			}
-			ret = json_visitor_free_string(jsonFact, obj->names[k]);
+			ret = json_object_free_name(jsonFact, obj->members[k].name, obj->members[k].flags);
 			if (ret) {
 				break;
 			}
@@ -470,15 +1025,20 @@ int json_visitor_free_object(json_factory* jsonFact, json_object* obj) {
 	}
 
 	if (!ret) {
-		jsonFact->allocator->free(obj->values);
-		jsonFact->allocator->free(obj->names);
-		jsonFact->allocator->free(obj);
+		JSON_FREE(jsonFact->allocator, json_alloc_buffer, obj->members, sizeof(json_object_member) * obj->capacity);
+		json_factory_free_node(jsonFact, json_pool_object, obj, sizeof(json_object));
 	}
 
 	return ret;
 }
 int json_visitor_free_array(json_factory* jsonFact, json_array* arr) {
-	int ret = (!arr || (arr->size > 0 && !arr->values)) ? 1 : 0;
+	int ret = (!arr || (arr->size > 0 && !arr->values && !arr->numbers)) ? 1 : 0;
+
+	if (!ret && arr->numbers) {
+		JSON_FREE(jsonFact->allocator, json_alloc_buffer, arr->numbers, sizeof(double) * arr->capacity);
+		json_factory_free_node(jsonFact, json_pool_array, arr, sizeof(json_array));
+		return ret;
+	}
 
 	if (!ret) {
 		for (size_t k = 0, n = arr->size; k < n; k += 1) {
@@ -490,8 +1050,8 @@ int json_visitor_free_array(json_factory* jsonFact, json_array* arr) {
 	}
 
 	if (!ret) {
-		jsonFact->allocator->free(arr->values);
-		jsonFact->allocator->free(arr);
+		JSON_FREE(jsonFact->allocator, json_alloc_buffer, arr->values, sizeof(json_value*) * arr->capacity);
+		json_factory_free_node(jsonFact, json_pool_array, arr, sizeof(json_array));
 	}
 
 	return ret;
@@ -500,8 +1060,8 @@ int json_visitor_free_string(json_factory* jsonFact, json_string* str) {
 	int ret = (str) ? 0 : 1;
 
 	if (!ret) {
-		jsonFact->allocator->free((void*) str->value);
-		jsonFact->allocator->free(str);
+		JSON_FREE(jsonFact->allocator, json_alloc_string, (void*) str->value, str->valueLen + 1);
+		json_factory_free_node(jsonFact, json_pool_string, str, sizeof(json_string));
 	}
 
 	return ret;
@@ -510,7 +1070,7 @@ int json_visitor_free_number(json_factory* jsonFact, json_number* num) {
 	int ret = (num) ? 0 : 1;
 
 	if (!ret) {
-		jsonFact->allocator->free(num);
+		json_factory_free_node(jsonFact, json_pool_number, num, sizeof(json_number));
 	}
 
 	return ret;
@@ -519,7 +1079,7 @@ int json_visitor_free_true(json_factory* jsonFact, json_true* tru) {
 	int ret = (tru) ? 0 : 1;
 
 	if (!ret) {
-		jsonFact->allocator->free(tru);
+		JSON_FREE(jsonFact->allocator, json_alloc_literal, tru, sizeof(json_true));
 	}
 
 	return ret;
@@ -528,7 +1088,7 @@ int json_visitor_free_false(json_factory* jsonFact, json_false* fals) {
 	int ret = (fals) ? 0 : 1;
 
 	if (!ret) {
-		jsonFact->allocator->free(fals);
+		JSON_FREE(jsonFact->allocator, json_alloc_literal, fals, sizeof(json_false));
 	}
 
 	return ret;
@@ -537,7 +1097,7 @@ int json_visitor_free_null(json_factory* jsonFact, json_null* nul) {
 	int ret = (nul) ? 0 : 1;
 
 	if (!ret) {
-		jsonFact->allocator->free(nul);
+		JSON_FREE(jsonFact->allocator, json_alloc_literal, nul, sizeof(json_null));
 	}
 
 	return ret;
@@ -33,6 +33,7 @@
 
 
 #include <stddef.h>
+#include <stdint.h>
 
 
 #ifdef __cplusplus
@@ -109,6 +110,26 @@ typedef enum JSON_PARSER_OPT {
 	json_max_nested_level = 0,
 	/*! The stream to write error messages to or NULL; FILE* (stderr) */
 	json_error_stream,
+	/*! A realloc-like function used to grow containers or NULL; realloc_function (realloc, or NULL with a custom alloc_function). Fails for a parser from json_parser_init_ex() */
+	json_realloc_function,
+	/*! Pre-scan the JSON text to allocate containers at their final size; int (1) */
+	json_presize_containers,
+	/*! Store arrays containing only numbers as packed arrays of double; int (0) */
+	json_pack_number_arrays,
+	/*! Share one json_object_shape between objects with the same names; int (0) */
+	json_share_object_shapes,
+	/*! Intern object names so that equal names share one json_string; int (0) */
+	json_intern_names,
+	/*! Keep interned names across parses until json_parser_clear(); int (0) */
+	json_persist_interned_names,
+	/*! Record the source text of each object and array; the parsed string must outlive them; int (0) */
+	json_record_source_spans,
+	/*! Time the phases of json_parser_parse(), see json_parser_get_phase_stats(); int (0) */
+	json_time_phases,
+	/*! Keep up to this many freed values, objects, arrays, strings and numbers of each type for reuse; int (0) */
+	json_node_pool_limit,
+	/*! Force the byte scanning kernels to a JSON_CPU_LEVEL no higher than json_cpu_detect(); int (json_cpu_detect()) */
+	json_cpu_level,
 	JSON_PARSER_OPT_MAX
 } JSON_PARSER_OPT;
 
@@ -117,6 +138,7 @@ extern const char* const JSON_EMPTY_STRING;
 /*! @endcond */
 
 /*! @cond */
+extern const size_t JSON_ALIGN_SIZE;
 extern size_t align_offset(size_t offset, size_t align);
 /*! @endcond */
 
@@ -134,6 +156,12 @@ typedef struct json_factory json_factory;
 struct json_object;
 /*! Typedef for json_object struct */
 typedef struct json_object json_object;
+struct json_object_member;
+/*! Typedef for json_object_member struct */
+typedef struct json_object_member json_object_member;
+struct json_object_shape;
+/*! Typedef for json_object_shape struct */
+typedef struct json_object_shape json_object_shape;
 struct json_value;
 /*! Typedef for json_value struct */
 typedef struct json_value json_value;
@@ -162,6 +190,37 @@ typedef struct json_null json_null;
 typedef void* (*alloc_function)(size_t);
 /*! Typedef for a free-like dealloc function */
 typedef void (*free_function)(void*);
+/*! Typedef for a realloc-like realloc function */
+typedef void* (*realloc_function)(void*, size_t);
+/*! Typedef for an alloc function taking the context of a json_allocator_ctx */
+typedef void* (*ctx_alloc_function)(void* ctx, size_t size);
+/*! Typedef for a dealloc function taking the context of a json_allocator_ctx */
+typedef void (*ctx_free_function)(void* ctx, void* ptr);
+/*! Typedef for a realloc function taking the context of a json_allocator_ctx and the current size of the memory */
+typedef void* (*ctx_realloc_function)(void* ctx, void* ptr, size_t oldSize, size_t newSize);
+/*! Typedef for a dealloc function taking the context of a json_allocator_ctx and the size of the memory */
+typedef void (*ctx_free_sized_function)(void* ctx, void* ptr, size_t size);
+
+/**
+ *  @brief Struct describing an allocator that carries a context pointer
+ *
+ *  Passed to json_parser_init_ex(). Each function receives @p ctx as its
+ *  first argument, so one set of functions can serve several arenas or
+ *  pools. The library never passes NULL to @p free, @p realloc or
+ *  @p freeSized.
+ */
+typedef struct json_allocator_ctx {
+	/*! Context passed to each function */
+	void* ctx;
+	/*! A malloc-like function, required */
+	ctx_alloc_function malloc;
+	/*! A free-like function, required */
+	ctx_free_function free;
+	/*! A function to grow or shrink memory in place, or NULL to allocate, copy and free */
+	ctx_realloc_function realloc;
+	/*! A function called instead of @p free when the size of the memory is known, or NULL */
+	ctx_free_sized_function freeSized;
+} json_allocator_ctx;
 
 /**
  *  @brief Initialize the types for this parser instance
@@ -178,6 +237,20 @@ typedef void (*free_function)(void*);
  */
 int json_types_init(alloc_function allocFunction, free_function freeFunction, json_allocator** jsAllocOut, json_factory** jsFactoryOut);
 
+/**
+ *  @brief Initialize the types for this parser instance from a context allocator
+ *
+ *  This function is called by json_parser_init_ex() and behaves like
+ *  json_types_init(), allocating the json_allocator and json_factory from
+ *  @p ctxAlloc.
+ *
+ *  @param[in] ctxAlloc The allocator to use; its malloc and free functions must be set
+ *  @param[out] jsAllocOut Pointer to created json_allocator for this parser instance
+ *  @param[out] jsFactoryOut Pointer to created json_factory for this parser instance
+ *  @return Zero on success, nonzero on failure
+ */
+int json_types_init_ex(const json_allocator_ctx* ctxAlloc, json_allocator** jsAllocOut, json_factory** jsFactoryOut);
+
 /*@{ */
 /*! Returns a new json_object */
 json_object* json_factory_new_json_object(json_factory* jsonFact, json_value* objParentValue);
@@ -197,11 +270,44 @@ json_false* json_factory_new_json_false(json_factory* jsonFact, json_value* falP
 json_null* json_factory_new_json_null(json_factory* jsonFact, json_value* nulParentValue);
 /*@} */
 
+/**
+ *  @brief Mark a value and its enclosing containers as modified
+ *
+ *  Drops the recorded source span of @p value and of every object and array
+ *  containing it, so that stringifying with json_stringify_source_spans
+ *  reproduces the current contents instead of the original text. The
+ *  json_object_* and json_array_* functions do this themselves; call it after
+ *  editing the fields of a value directly.
+ *
+ *  @param[in] value The modified value
+ */
+void json_value_mark_modified(json_value* value);
+
 /*! @cond */
+uint32_t json_hash_string(const char* str, const size_t strLen);
+
+void* json_allocator_grow(json_allocator* jsonAlloc, void* ptr, const size_t oldSize, const size_t newSize);
+
 int json_object_resize(json_factory* jsonFact, json_object* obj, const size_t newSize);
+int json_object_reserve(json_factory* jsonFact, json_object* obj, const size_t capacity);
 int json_object_add_pair(json_factory* jsonFact, json_object* obj, json_string* name, json_value* value);
+int json_object_add_member(json_factory* jsonFact, json_object* obj, json_string* name, json_value* value, uint32_t hash, uint32_t flags);
+int json_object_free_name(json_factory* jsonFact, json_string* name, uint32_t flags);
+
+json_string* json_interned_string_new(json_factory* jsonFact, const char* str, const size_t strLen, uint32_t hash);
+void json_interned_string_release(json_factory* jsonFact, json_string* str);
+
+int json_object_shape_matches(const json_object_shape* shape, const json_object* obj);
+size_t json_object_shape_hash(const json_object* obj);
+void json_object_shape_release(json_factory* jsonFact, json_object_shape* shape);
+json_object_shape* json_object_set_shape(json_factory* jsonFact, json_object* obj, json_object_shape* shape);
+int json_object_unshape(json_factory* jsonFact, json_object* obj);
 int json_array_resize(json_factory* jsonFact, json_array* arr, const size_t newSize);
+int json_array_reserve(json_factory* jsonFact, json_array* arr, const size_t capacity);
+int json_array_reserve_numbers(json_factory* jsonFact, json_array* arr, const size_t capacity);
 int json_array_add_element(json_factory* jsonFact, json_array* arr, json_value* value);
+int json_array_add_number(json_factory* jsonFact, json_array* arr, double num);
+int json_array_unpack(json_factory* jsonFact, json_array* arr);
 
 const char* json_value_get_type(json_value* value);
 /*! @endcond */
@@ -219,6 +325,69 @@ int json_visitor_free_null(json_factory* jsonFact, json_null* nul);
 /*@} */
 
 
+/**
+ *  @brief Kinds of memory counted by json_allocator_stats
+ */
+typedef enum JSON_ALLOC_CATEGORY {
+	/*! json_value structs */
+	json_alloc_value = 0,
+	/*! json_object structs */
+	json_alloc_object,
+	/*! json_array structs */
+	json_alloc_array,
+	/*! json_string structs, their text and interned names */
+	json_alloc_string,
+	/*! json_number structs */
+	json_alloc_number,
+	/*! json_true, json_false and json_null structs */
+	json_alloc_literal,
+	/*! Shapes shared by objects */
+	json_alloc_shape,
+	/*! Member, value and number arrays of objects and arrays */
+	json_alloc_buffer,
+	JSON_ALLOC_CATEGORY_MAX
+} JSON_ALLOC_CATEGORY;
+
+/**
+ *  @brief Counters of one JSON_ALLOC_CATEGORY
+ */
+typedef struct json_alloc_category_stats {
+	/*@{ */
+	/*! Number of allocations */
+	size_t allocations;
+	/*! Number of frees */
+	size_t frees;
+	/*! Bytes currently allocated */
+	size_t bytes;
+	/*@} */
+} json_alloc_category_stats;
+
+/**
+ *  @brief Allocation counters of a json_allocator
+ *
+ *  The counters are only kept when the library is configured with
+ *  --enable-stats, see json_parser_get_stats(). Bytes are those requested from
+ *  the allocator; the text of strings is counted at its unescaped length.
+ */
+typedef struct json_allocator_stats {
+	/*@{ */
+	/*! Number of allocations */
+	size_t allocations;
+	/*! Number of frees */
+	size_t frees;
+	/*! Number of times a buffer was grown */
+	size_t growths;
+	/*! Bytes added to buffers by growing them */
+	size_t growthBytes;
+	/*! Bytes currently allocated */
+	size_t bytesLive;
+	/*! Largest value of bytesLive */
+	size_t peakBytes;
+	/*! Counters of each JSON_ALLOC_CATEGORY */
+	json_alloc_category_stats categories[JSON_ALLOC_CATEGORY_MAX];
+	/*@} */
+} json_allocator_stats;
+
 /**
  *  @brief Struct representing an allocator
  */
@@ -227,8 +396,53 @@ typedef struct json_allocator {
 	alloc_function malloc;
 	/*! A free-like dealloc function */
 	free_function free;
+	/*! A realloc-like function to grow memory in place, or NULL to allocate, copy and free */
+	realloc_function realloc;
+	/*! Context passed to the ctx functions */
+	void* ctx;
+	/*! Alloc function used instead of @p malloc when set by json_parser_init_ex() */
+	ctx_alloc_function ctxMalloc;
+	/*! Dealloc function used instead of @p free when set by json_parser_init_ex() */
+	ctx_free_function ctxFree;
+	/*! Realloc function used instead of @p realloc when set by json_parser_init_ex() */
+	ctx_realloc_function ctxRealloc;
+	/*! Dealloc function used when the size of the memory is known, or NULL */
+	ctx_free_sized_function freeSized;
+	/*! Allocation counters, only kept when configured with --enable-stats */
+	json_allocator_stats stats;
 } json_allocator;
 
+/**
+ *  @brief Node types kept on the free lists of a json_factory
+ *
+ *  Each matches the JSON_ALLOC_CATEGORY its nodes are counted under.
+ */
+typedef enum JSON_NODE_POOL {
+	/*! json_value structs */
+	json_pool_value = json_alloc_value,
+	/*! json_object structs */
+	json_pool_object = json_alloc_object,
+	/*! json_array structs */
+	json_pool_array = json_alloc_array,
+	/*! json_string structs */
+	json_pool_string = json_alloc_string,
+	/*! json_number structs */
+	json_pool_number = json_alloc_number,
+	JSON_NODE_POOL_MAX
+} JSON_NODE_POOL;
+
+/**
+ *  @brief A free list of nodes of one JSON_NODE_POOL
+ *
+ *  Each free node stores the next one in its first bytes.
+ */
+typedef struct json_node_pool {
+	/*! The first free node, or NULL */
+	void* head;
+	/*! Number of free nodes */
+	size_t count;
+} json_node_pool;
+
 /**
  *  @brief Struct representing a factory to make new objects
  */
@@ -256,27 +470,98 @@ typedef struct json_factory {
 	/*! Returns a new json_null */
 	json_null* (*new_json_null)(json_factory* jsonFact, json_value* nulParentValue);
 	/*@} */
+
+	/*@{ */
+	/*! Freed nodes kept for reuse by the factory functions */
+	json_node_pool pools[JSON_NODE_POOL_MAX];
+	/*! Most nodes kept in each pool; set with the json_node_pool_limit option */
+	size_t poolLimit;
+	/*@} */
 } json_factory;
 
 
+/**
+ *  @brief Flags of a name/value pair of a JSON object
+ */
+typedef enum JSON_MEMBER_FLAGS {
+	/*! The name is an interned json_interned_string shared with other members */
+	json_member_interned_name = 1
+} JSON_MEMBER_FLAGS;
+
+/**
+ *  @brief Struct representing a name/value pair of a JSON object
+ *
+ *  Members are stored contiguously in json_object so that a name, its value
+ *  and the hash of the name are read together.
+ */
+typedef struct json_object_member {
+	/*! Property name */
+	json_string* name;
+	/*! Property value */
+	json_value* value;
+	/*! Hash of the property name, see json_hash_string() */
+	uint32_t hash;
+	/*! Flags of this member; see JSON_MEMBER_FLAGS */
+	uint32_t flags;
+} json_object_member;
+
+/**
+ *  @brief Struct representing the names shared by objects with the same keys
+ *
+ *  Objects parsed with the json_share_object_shapes option that have the same
+ *  names in the same order share one immutable shape. The shape holds the names
+ *  and a table to look them up by hash.
+ */
+typedef struct json_object_shape {
+	/*@{ */
+	/*! Array of property names */
+	json_string** names;
+	/*! Array of hashes of the property names, see json_hash_string() */
+	uint32_t* hashes;
+	/*! Number of names */
+	size_t size;
+	/*! Flags of all names; see JSON_MEMBER_FLAGS */
+	uint32_t flags;
+	/*! Hash of the sequence of names */
+	size_t hash;
+	/*! Number of references to this shape */
+	size_t refCount;
+	/*@} */
+
+	/*@{ */
+	/*! Open addressing table of indices into names plus one, by name hash */
+	uint32_t* table;
+	/*! Size of table minus one */
+	size_t tableMask;
+	/*@} */
+} json_object_shape;
+
 /**
  *  @brief Struct representing a JSON object
  *
  *  A JSON object represents pairs of names and values.
  *
+ *  An object either stores its name/value pairs in @p members, or it is shaped
+ *  and stores only its values in @p values with the names held by @p shape.
+ *
  *  @see https://tools.ietf.org/html/rfc7159#section-4
  */
 typedef struct json_object {
-	//TODO: Have json_object contain json_string in a json_value ??
 	/*@{ */
-	/*! Array of property names */
-	json_string** names;
-	/*! Array of property values */
+	/*! Array of name/value pairs, or NULL if the object is shaped */
+	json_object_member* members;
+	/*! Shape holding the names if the object is shaped, or NULL */
+	json_object_shape* shape;
+	/*! Array of values if the object is shaped, or NULL */
 	json_value** values;
-	/*! Current number of names and values occupied */
+	/*! Current number of members occupied */
 	size_t size;
-	/*! Capacity of names and values */
+	/*! Capacity of members or values */
 	size_t capacity;
+	/*! Original text of the object if it is unmodified, or NULL */
+	const char* source;
+	/*! Length of @p source */
+	size_t sourceLen;
 	/*@} */
 
 	/*@{ */
@@ -331,6 +616,21 @@ typedef struct json_string {
 	/*@} */
 } json_string;
 
+/**
+ *  @brief Struct representing an object name interned with the json_intern_names option
+ *
+ *  Members with the same name share one interned string. The text of the name
+ *  is stored in the same allocation, after the struct.
+ */
+typedef struct json_interned_string {
+	/*! The shared name; must be the first member */
+	json_string string;
+	/*! Hash of the name, see json_hash_string() */
+	uint32_t hash;
+	/*! Number of references to this name */
+	size_t refCount;
+} json_interned_string;
+
 /**
  *  @brief Struct representing a JSON number
  *
@@ -357,16 +657,26 @@ typedef struct json_number {
  *  A JSON array consists of zero or more JSON values surrounded by square
  *  brackets @c [].
  *
+ *  An array holding only numbers may be packed, see the json_pack_number_arrays
+ *  option. A packed array stores its elements in @p numbers and has @p values
+ *  set to @c NULL.
+ *
  *  @see https://tools.ietf.org/html/rfc7159#section-5
  */
 typedef struct json_array {
 	/*@{ */
-	/*! Array of values */
+	/*! Array of values, or NULL if the array is packed */
 	json_value** values;
+	/*! Array of numbers if the array is packed, or NULL */
+	double* numbers;
 	/*! Current number of values occupied */
 	size_t size;
-	/*! Capacity of names and values */
+	/*! Capacity of values or numbers */
 	size_t capacity;
+	/*! Original text of the array if it is unmodified, or NULL */
+	const char* source;
+	/*! Length of @p source */
+	size_t sourceLen;
 	/*@} */
 
 	/*@{ */
@@ -412,6 +722,37 @@ typedef struct json_null {
 } json_null;
 
 
+/*! @cond */
+void* json_factory_alloc_node(json_factory* jsonFact, const JSON_NODE_POOL pool, const size_t size);
+void json_factory_free_node(json_factory* jsonFact, const JSON_NODE_POOL pool, void* node, const size_t size);
+void json_factory_trim_pools(json_factory* jsonFact, const size_t limit);
+
+//Allocate and free through the ctx functions when set by json_parser_init_ex()
+static inline void* json_allocator_malloc(json_allocator* jsonAlloc, const size_t size) {
+	return (jsonAlloc->ctxMalloc) ? jsonAlloc->ctxMalloc(jsonAlloc->ctx, size) : jsonAlloc->malloc(size);
+}
+
+static inline void json_allocator_free(json_allocator* jsonAlloc, void* ptr) {
+	if (!ptr) {
+		return;
+	} else if (jsonAlloc->ctxFree) {
+		jsonAlloc->ctxFree(jsonAlloc->ctx, ptr);
+	} else {
+		jsonAlloc->free(ptr);
+	}
+}
+
+//size must be the size ptr was allocated or last grown with
+static inline void json_allocator_free_sized(json_allocator* jsonAlloc, void* ptr, const size_t size) {
+	if (ptr && jsonAlloc->freeSized) {
+		jsonAlloc->freeSized(jsonAlloc->ctx, ptr, size);
+	} else {
+		json_allocator_free(jsonAlloc, ptr);
+	}
+}
+/*! @endcond */
+
+
 #ifdef __cplusplus
 }
 #endif	//#ifdef __cplusplus
@@ -23,8 +23,12 @@
 #include "json_utils.h"
 #include "json_parser.h"
 #include "json_types.h"
+#include "json_stats.h"
+#include "json_probes.h"
+#include "json_dtoa_tables.h"
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdint.h>
@@ -47,13 +51,15 @@ static const uint8_t xascii_to_uint8_map[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-static char uni_buffer[16];
-
 
 static inline uint16_t uni_str_to_num(const char* str);
-static char* uni_num_to_utf8_str(uint32_t uni, size_t* numBytes);
+static size_t uni_num_to_utf8_str(uint32_t uni, char* buff);
 static inline int uni_is_valid_surrogate_pair(uint16_t uni1, uint16_t uni2);
-static inline char* uni_surrogate_pair_to_utf8_str(uint16_t uni1, uint16_t uni2, size_t* numBytes);
+static inline size_t uni_surrogate_pair_to_utf8_str(uint16_t uni1, uint16_t uni2, char* buff);
+
+static inline uint64_t dtoa_mul_shift(const uint64_t m, const uint64_t* mul, const int32_t j);
+static void dtoa_shortest(const uint64_t ieeeMantissa, const uint32_t ieeeExponent, uint64_t* digits, int32_t* exponent);
+static size_t dtoa_write_uint(uint64_t value, char* buff);
 
 
 void json_error(const char* err) {
@@ -61,6 +67,7 @@ void json_error(const char* err) {
 }
 
 void json_error_lineno(const char* err, json_parser_state* parserState) {
+	JSON_PROBE2(parse__error, err, parserState->jsonStrPos);
 	if (!parserState->errorStream) {
 		return;
 	}
@@ -83,15 +90,16 @@ char* json_utils_unescape_string(json_parser_state* parserState, const char* str
 	*ret = 1;
 	*unescapedLen = 0;
 	if (!str || !n) {
-		unescaped = (char*) parserState->JSON_Allocator->malloc( sizeof(char) );
+		unescaped = (char*) json_allocator_malloc(parserState->JSON_Allocator, sizeof(char));
 		if (unescaped) {
 			unescaped[0] = 0;
 			*ret = 0;
+			JSON_STATS_ADD(parserState->JSON_Allocator, json_alloc_string, 1);
 		}
 		return unescaped;
 	}
 	
-	unescaped = (char*) parserState->JSON_Allocator->malloc( sizeof(char) * n + 1 );
+	unescaped = (char*) json_allocator_malloc(parserState->JSON_Allocator, sizeof(char) * n + 1);
 	if (!unescaped) {
 		return unescaped;
 	}
@@ -129,7 +137,6 @@ char* json_utils_unescape_string(json_parser_state* parserState, const char* str
 				break;
 				case 'u': {
 					uint16_t uni1 = 0, uni2 = 0;
-					const char* uniBuff = NULL;
 					int isSurrogatePair = 0;
 					
 					if (//Reached eos, or bad unicode escape
@@ -142,7 +149,6 @@ char* json_utils_unescape_string(json_parser_state* parserState, const char* str
 						return unescaped;
 					}
 					
-					size_t numBytes = 0;
 					if (//This escape sequence and the following form a valid surrogate pair
 						(k + 11 <= n)
 						&& (str[k + 6] == '\\')
@@ -155,19 +161,13 @@ char* json_utils_unescape_string(json_parser_state* parserState, const char* str
 						&& (uni2 = uni_str_to_num(str + k + 8))
 						&& uni_is_valid_surrogate_pair(uni1, uni2)
 					) {
-						uniBuff = uni_surrogate_pair_to_utf8_str(uni1, uni2, &numBytes);
+						j += uni_surrogate_pair_to_utf8_str(uni1, uni2, unescaped + j);
 						isSurrogatePair = 1;
 					} else {//Single unicode escape sequence
 						uni1 = uni_str_to_num(str + k + 2);
-						uniBuff = uni_num_to_utf8_str(uni1, &numBytes);
+						j += uni_num_to_utf8_str(uni1, unescaped + j);
 					}
 					
-					size_t m = 0;
-					while (m < numBytes) {
-						unescaped[j] = uniBuff[m];
-						j += 1;
-						m += 1;
-					}
 					k += (isSurrogatePair) ? 12 : 6;
 					continue;
 				}
@@ -187,6 +187,19 @@ char* json_utils_unescape_string(json_parser_state* parserState, const char* str
 	}
 	unescaped[j] = 0;
 	
+	//A free_sized function is passed the length strings are freed with, so give back the rest
+	if (j < n && parserState->JSON_Allocator->freeSized) {
+		char* shrunk = (char*) json_allocator_grow(parserState->JSON_Allocator, unescaped, n + 1, j + 1);
+		if (!shrunk) {
+			json_allocator_free_sized(parserState->JSON_Allocator, unescaped, n + 1);
+			*unescapedLen = 0;
+			return NULL;
+		}
+		unescaped = shrunk;
+	}
+	
+	//Strings are counted at their unescaped length, the length they are freed with
+	JSON_STATS_ADD(parserState->JSON_Allocator, json_alloc_string, j + 1);
 	*ret = 0;
 	*unescapedLen = j;
 	return unescaped;
@@ -202,39 +215,293 @@ static inline uint16_t uni_str_to_num(const char* str) {
 	);
 }
 
-//Returns a UTF-8 encoded string from the given 32 bit integer
-static char* uni_num_to_utf8_str(uint32_t uni, size_t* numBytes) {
+//Writes the UTF-8 encoding of the given 32 bit integer to buff, which needs room for 4 bytes
+//Returns the number of bytes written
+static size_t uni_num_to_utf8_str(uint32_t uni, char* buff) {
 	size_t pos = 0;
 	if (uni < 0x80) {
-		uni_buffer[pos] = uni;
+		buff[pos] = uni;
 		pos += 1;
 	} else if (uni < 0x800) {
-		uni_buffer[pos] = 0xC0 | ( (uni & 0x1F00) >> 8);
+		buff[pos] = 0xC0 | ( (uni & 0x7C0) >> 6);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | (uni & 0x3F);
+		buff[pos] = 0x80 | (uni & 0x3F);
 		pos += 1;
-	} else if (uni < 0xFFFF) {
-		uni_buffer[pos] = 0xE0 | ( (uni & 0xF000) >> 12);
+	} else if (uni <= 0xFFFF) {
+		buff[pos] = 0xE0 | ( (uni & 0xF000) >> 12);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | ( (uni & 0xFC0) >> 6);
+		buff[pos] = 0x80 | ( (uni & 0xFC0) >> 6);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | (uni & 0x3F);
+		buff[pos] = 0x80 | (uni & 0x3F);
 		pos += 1;
 	} else {
-		uni_buffer[pos] = 0xF0 | ( (uni & 0x1C0000) >> 18);
+		buff[pos] = 0xF0 | ( (uni & 0x1C0000) >> 18);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | ( (uni & 0x3F000) >> 12);
+		buff[pos] = 0x80 | ( (uni & 0x3F000) >> 12);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | ( (uni & 0xFC0) >> 6);
+		buff[pos] = 0x80 | ( (uni & 0xFC0) >> 6);
 		pos += 1;
-		uni_buffer[pos] = 0x80 | (uni & 0x3F);
+		buff[pos] = 0x80 | (uni & 0x3F);
 		pos += 1;
 	}
-	uni_buffer[pos] = 0;
-	if (numBytes) {
-		*numBytes = pos;
+	return pos;
+}
+
+size_t json_utils_format_number(double num, char* buff) {
+	uint64_t bits = 0;
+	memcpy(&bits, &num, sizeof(double));
+	const bool sign = bits >> 63;
+	const uint64_t ieeeMantissa = bits & ((1ULL << 52) - 1);
+	const uint32_t ieeeExponent = (uint32_t) ((bits >> 52) & 0x7FF);
+
+	if (ieeeExponent == 0x7FF) {//NaN and infinities
+		memcpy(buff, "null", 5);
+		return 4;
+	}
+
+	char* ptr = buff;
+	if (sign) {
+		*ptr++ = '-';
+		num = -num;
+	}
+
+	//Integral values below 2^53 are written directly
+	if (num < 9007199254740992.0 && num == (double) (uint64_t) num) {
+		ptr += dtoa_write_uint((uint64_t) num, ptr);
+		*ptr = 0;
+		return ptr - buff;
+	}
+
+	uint64_t output = 0;
+	int32_t exponent = 0;
+	dtoa_shortest(ieeeMantissa, ieeeExponent, &output, &exponent);
+
+	char digits[20];
+	const int32_t numDigits = (int32_t) dtoa_write_uint(output, digits);
+	const int32_t point = numDigits + exponent;	//Position of the decimal point in digits
+
+	//Formatted like Number.prototype.toString() in ECMAScript
+	if (numDigits <= point && point <= 21) {
+		memcpy(ptr, digits, numDigits);
+		ptr += numDigits;
+		memset(ptr, '0', point - numDigits);
+		ptr += point - numDigits;
+	} else if (0 < point && point <= 21) {
+		memcpy(ptr, digits, point);
+		ptr += point;
+		*ptr++ = '.';
+		memcpy(ptr, digits + point, numDigits - point);
+		ptr += numDigits - point;
+	} else if (-6 < point && point <= 0) {
+		*ptr++ = '0';
+		*ptr++ = '.';
+		memset(ptr, '0', -point);
+		ptr += -point;
+		memcpy(ptr, digits, numDigits);
+		ptr += numDigits;
+	} else {
+		*ptr++ = digits[0];
+		if (numDigits > 1) {
+			*ptr++ = '.';
+			memcpy(ptr, digits + 1, numDigits - 1);
+			ptr += numDigits - 1;
+		}
+		const int32_t exp = point - 1;
+		*ptr++ = 'e';
+		*ptr++ = (exp < 0) ? '-' : '+';
+		ptr += dtoa_write_uint((exp < 0) ? -exp : exp, ptr);
+	}
+
+	*ptr = 0;
+	return ptr - buff;
+}
+
+//Writes the decimal digits of value to buff without a null terminator
+//Returns the number of digits written
+static size_t dtoa_write_uint(uint64_t value, char* buff) {
+	char tmp[20];
+	size_t len = 0;
+	do {
+		tmp[len++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value);
+	for (size_t k = 0; k < len; k += 1) {
+		buff[k] = tmp[len - 1 - k];
 	}
-	return uni_buffer;
+	return len;
+}
+
+//Returns the number of bits of 5^e, for 0 <= e <= 3528
+static inline int32_t dtoa_pow5_bits(const int32_t e) {
+	return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+//Returns floor(log10(2^e)), for 0 <= e <= 1650
+static inline uint32_t dtoa_log10_pow2(const int32_t e) {
+	return ((uint32_t) e * 78913) >> 18;
+}
+//Returns floor(log10(5^e)), for 0 <= e <= 2620
+static inline uint32_t dtoa_log10_pow5(const int32_t e) {
+	return ((uint32_t) e * 732923) >> 20;
+}
+//Returns true if value is divisible by 5^p
+static inline bool dtoa_multiple_of_pow5(uint64_t value, const uint32_t p) {
+	uint32_t count = 0;
+	while (value % 5 == 0) {
+		value /= 5;
+		count += 1;
+	}
+	return count >= p;
+}
+//Returns true if value is divisible by 2^p
+static inline bool dtoa_multiple_of_pow2(const uint64_t value, const uint32_t p) {
+	return (value & ((1ULL << p) - 1)) == 0;
+}
+
+//Returns the high 64 bits of the 128-bit product of a and b, and stores the low 64 bits in lo
+static inline uint64_t dtoa_umul128(const uint64_t a, const uint64_t b, uint64_t* lo) {
+	const uint64_t aLo = (uint32_t) a;
+	const uint64_t aHi = a >> 32;
+	const uint64_t bLo = (uint32_t) b;
+	const uint64_t bHi = b >> 32;
+
+	const uint64_t b00 = aLo * bLo;
+	const uint64_t b01 = aLo * bHi;
+	const uint64_t b10 = aHi * bLo;
+	const uint64_t b11 = aHi * bHi;
+
+	const uint64_t mid1 = b10 + (b00 >> 32);
+	const uint64_t mid2 = b01 + (uint32_t) mid1;
+
+	*lo = (mid2 << 32) | (uint32_t) b00;
+	return b11 + (mid1 >> 32) + (mid2 >> 32);
+}
+
+//Returns (m * mul) >> j where mul is a 128-bit multiplier from the dtoa tables and 64 < j < 128
+static inline uint64_t dtoa_mul_shift(const uint64_t m, const uint64_t* mul, const int32_t j) {
+	uint64_t lo0 = 0;
+	uint64_t lo2 = 0;
+	const uint64_t hi0 = dtoa_umul128(m, mul[0], &lo0);
+	const uint64_t hi2 = dtoa_umul128(m, mul[1], &lo2);
+	const uint64_t sumLo = hi0 + lo2;
+	const uint64_t sumHi = hi2 + (sumLo < hi0);
+	const int32_t shift = j - 64;
+	return (sumHi << (64 - shift)) | (sumLo >> shift);
+}
+
+//Computes the shortest decimal digits and exponent that round-trip to the given finite nonzero double
+//This is the Ryu algorithm, see Ulf Adams, "Ryu: Fast Float-to-String Conversion" (PLDI 2018)
+static void dtoa_shortest(const uint64_t ieeeMantissa, const uint32_t ieeeExponent, uint64_t* digits, int32_t* exponent) {
+	int32_t e2 = 0;
+	uint64_t m2 = 0;
+	if (ieeeExponent == 0) {
+		e2 = 1 - 1023 - 52 - 2;
+		m2 = ieeeMantissa;
+	} else {
+		e2 = (int32_t) ieeeExponent - 1023 - 52 - 2;
+		m2 = (1ULL << 52) | ieeeMantissa;
+	}
+	const bool acceptBounds = (m2 & 1) == 0;
+
+	//Bounds of the interval of decimals that round to the double, scaled by 4
+	const uint64_t mv = 4 * m2;
+	const uint32_t mmShift = (ieeeMantissa != 0 || ieeeExponent <= 1);
+
+	uint64_t vr = 0;
+	uint64_t vp = 0;
+	uint64_t vm = 0;
+	int32_t e10 = 0;
+	bool vmIsTrailingZeros = false;
+	bool vrIsTrailingZeros = false;
+	if (e2 >= 0) {
+		const uint32_t q = dtoa_log10_pow2(e2) - (e2 > 3);
+		e10 = (int32_t) q;
+		const int32_t k = JSON_DTOA_POW5_INV_BITCOUNT + dtoa_pow5_bits((int32_t) q) - 1;
+		const int32_t i = -e2 + (int32_t) q + k;
+		vr = dtoa_mul_shift(mv, JSON_DTOA_POW5_INV_SPLIT[q], i);
+		vp = dtoa_mul_shift(mv + 2, JSON_DTOA_POW5_INV_SPLIT[q], i);
+		vm = dtoa_mul_shift(mv - 1 - mmShift, JSON_DTOA_POW5_INV_SPLIT[q], i);
+		if (q <= 21) {
+			//Only one of mp, mv and mm can be a multiple of 5, if any
+			if (mv % 5 == 0) {
+				vrIsTrailingZeros = dtoa_multiple_of_pow5(mv, q);
+			} else if (acceptBounds) {
+				vmIsTrailingZeros = dtoa_multiple_of_pow5(mv - 1 - mmShift, q);
+			} else {
+				vp -= dtoa_multiple_of_pow5(mv + 2, q);
+			}
+		}
+	} else {
+		const uint32_t q = dtoa_log10_pow5(-e2) - (-e2 > 1);
+		e10 = (int32_t) q + e2;
+		const int32_t i = -e2 - (int32_t) q;
+		const int32_t k = dtoa_pow5_bits(i) - JSON_DTOA_POW5_BITCOUNT;
+		const int32_t j = (int32_t) q - k;
+		vr = dtoa_mul_shift(mv, JSON_DTOA_POW5_SPLIT[i], j);
+		vp = dtoa_mul_shift(mv + 2, JSON_DTOA_POW5_SPLIT[i], j);
+		vm = dtoa_mul_shift(mv - 1 - mmShift, JSON_DTOA_POW5_SPLIT[i], j);
+		if (q <= 1) {
+			//mv has at least q trailing zero bits
+			vrIsTrailingZeros = true;
+			if (acceptBounds) {
+				vmIsTrailingZeros = mmShift == 1;
+			} else {
+				vp -= 1;
+			}
+		} else if (q < 63) {
+			vrIsTrailingZeros = dtoa_multiple_of_pow2(mv, q);
+		}
+	}
+
+	//Remove digits while the bounds still differ, rounding the last removed digit
+	int32_t removed = 0;
+	uint8_t lastRemovedDigit = 0;
+	uint64_t output = 0;
+	if (vmIsTrailingZeros || vrIsTrailingZeros) {
+		while (vp / 10 > vm / 10) {
+			vmIsTrailingZeros &= vm % 10 == 0;
+			vrIsTrailingZeros &= lastRemovedDigit == 0;
+			lastRemovedDigit = (uint8_t) (vr % 10);
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed += 1;
+		}
+		if (vmIsTrailingZeros) {
+			while (vm % 10 == 0) {
+				vrIsTrailingZeros &= lastRemovedDigit == 0;
+				lastRemovedDigit = (uint8_t) (vr % 10);
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed += 1;
+			}
+		}
+		if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+			//Round half to even
+			lastRemovedDigit = 4;
+		}
+		output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+	} else {
+		bool roundUp = false;
+		if (vp / 100 > vm / 100) {
+			roundUp = vr % 100 >= 50;
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+		while (vp / 10 > vm / 10) {
+			roundUp = vr % 10 >= 5;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed += 1;
+		}
+		output = vr + (vr == vm || roundUp);
+	}
+
+	*digits = output;
+	*exponent = e10 + removed;
 }
 
 //Checks if the two given 16 bit integers form a valid UTF-16 surrogate pair
@@ -244,13 +511,14 @@ static inline int uni_is_valid_surrogate_pair(uint16_t uni1, uint16_t uni2) {
 		&& (uni2 >= 0xDC00 && uni2 <= 0xDFFF)
 	);
 }
-//Returns a UTF-8 encoded string from the surrogate pair in the two given 16 bit integers
-static inline char* uni_surrogate_pair_to_utf8_str(uint16_t uni1, uint16_t uni2, size_t* numBytes) {
+//Writes the UTF-8 encoding of the surrogate pair in the two given 16 bit integers to buff
+//Returns the number of bytes written
+static inline size_t uni_surrogate_pair_to_utf8_str(uint16_t uni1, uint16_t uni2, char* buff) {
 	return uni_num_to_utf8_str(
 		((uni1 & 0x3FF) << 10)
 		+ (uni2 & 0x3FF)
 		+ 0x10000,
-		numBytes
+		buff
 	);
 }
 
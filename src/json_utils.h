@@ -41,6 +41,9 @@
 extern "C" {
 #endif	//#ifdef __cplusplus
 
+/*! Size of a buffer large enough for any number formatted by json_utils_format_number() */
+#define JSON_NUMBER_STRING_MAX 32
+
 /**
  *  @brief Report an error message
  *
@@ -104,6 +107,24 @@ void json_error_lineno(const char* err, json_parser_state* parserState);
  */
 char* json_utils_unescape_string(json_parser_state* parserState, const char* str, size_t n, int* state, size_t* unescapedLen);
 
+/**
+ *  @brief Format a number as JSON text
+ *
+ *  This function writes the shortest decimal representation of @p num that parses
+ *  back to exactly the same double, using the format of @c Number.prototype.toString()
+ *  in ECMAScript: integers below 10^21 are written in full, other numbers between
+ *  10^-7 and 10^21 are written with a decimal point and the rest with an exponent,
+ *  e.g. @c 1e+21 or @c 1.5e-7. The output doesn't depend on the locale.
+ *
+ *  Negative zero is written as @c -0. JSON has no representation for NaN and
+ *  infinities, so @c null is written for them.
+ *
+ *  @param num The number to format
+ *  @param[out] buff A buffer of at least JSON_NUMBER_STRING_MAX bytes to receive the @c null terminated text
+ *  @return The length of the text written to @p buff, not including the @c null terminator
+ */
+size_t json_utils_format_number(double num, char* buff);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,772 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_WRITER_C
+#define JSON_WRITER_C
+
+
+#define JSON_TOP_LVL 1
+
+
+#include "json_writer.h"
+#include "json_types.h"
+#include "json_parser.h"
+#include "json_introspect.h"
+#include "json_string_buffer.h"
+#include "json_simd.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+const size_t JSON_WRITER_INIT_DEPTH = 16;
+
+//What a writer accepts next
+enum {
+	json_writer_expect_value = 0,	//A value, or the end of an array
+	json_writer_expect_key,	//A key, or the end of an object
+	json_writer_done,	//Nothing, the toplevel value is complete
+	json_writer_failed	//Nothing, a call failed or the text was handed out
+};
+
+//Bits of the entries of the stack of open containers
+enum {
+	json_writer_in_object = 1,	//The container is an object
+	json_writer_has_items = 2	//The container has a member or element
+};
+
+struct json_writer {
+	json_parser_state* parserState;
+	json_string_buffer strBuff;
+	int state;
+	uint8_t* stack;
+	size_t depth;
+	size_t stackCapacity;
+};
+
+//Allocate a writer around an initialized buffer
+static json_writer* json_writer_new(json_parser_state* parserState, const json_string_buffer* strBuff, const size_t buffSize) {
+	json_writer* writer = json_allocator_malloc(parserState->JSON_Allocator, sizeof(json_writer));
+	if (!writer) {
+		return NULL;
+	}
+
+	writer->parserState = parserState;
+	writer->strBuff = *strBuff;
+	writer->state = json_writer_expect_value;
+	writer->stack = NULL;
+	writer->depth = 0;
+	writer->stackCapacity = 0;
+
+	writer->strBuff.string = json_allocator_malloc(parserState->JSON_Allocator, sizeof(char) * buffSize);
+	if (!writer->strBuff.string) {
+		json_allocator_free_sized(parserState->JSON_Allocator, writer, sizeof(json_writer));
+		return NULL;
+	}
+	writer->strBuff.capacity = buffSize;
+
+	return writer;
+}
+
+json_writer* json_writer_init(json_parser_state* parserState, const char* indent, int flags) {
+	if (!parserState) {
+		return NULL;
+	}
+
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+
+	return json_writer_new(parserState, &strBuff, JSON_STR_BUFF_INIT_SIZE);
+}
+
+json_writer* json_writer_init_sink(json_parser_state* parserState, const char* indent, int flags, json_stringify_write_cb writeCb, void* ctx) {
+	if (!parserState || !writeCb) {
+		return NULL;
+	}
+
+	json_string_buffer strBuff;
+	json_string_buffer_init(&strBuff, indent, flags);
+	strBuff.mode = json_buffer_sink;
+	strBuff.write = writeCb;
+	strBuff.writeCtx = ctx;
+
+	return json_writer_new(parserState, &strBuff, JSON_STR_BUFF_SINK_SIZE);
+}
+
+int json_writer_clear(json_writer* writer) {
+	if (!writer) {
+		return 1;
+	}
+
+	json_allocator* jsonAlloc = writer->parserState->JSON_Allocator;
+	if (writer->strBuff.string) {
+		json_allocator_free(jsonAlloc, writer->strBuff.string);
+	}
+	if (writer->strBuff.indentBuffer) {
+		json_allocator_free(jsonAlloc, writer->strBuff.indentBuffer);
+	}
+	if (writer->stack) {
+		json_allocator_free(jsonAlloc, writer->stack);
+	}
+	json_allocator_free_sized(jsonAlloc, writer, sizeof(json_writer));
+
+	return 0;
+}
+
+//Append to the output, entering the failed state on error
+static inline int json_writer_append(json_writer* writer, const char* str, const size_t strLen) {
+	int retVal = json_string_buffer_append(writer->parserState, &writer->strBuff, str, strLen);
+	if (retVal) {
+		writer->state = json_writer_failed;
+	}
+	return retVal;
+}
+
+//Write the separator and indent before the next member or element of the innermost container
+static int json_writer_next_item(json_writer* writer) {
+	int retVal = 1;
+	json_string_buffer* strBuff = &writer->strBuff;
+	const int flags = strBuff->flags;
+	uint8_t* top = writer->stack + writer->depth - 1;
+
+	if (*top & json_writer_has_items) {
+		if (flags & json_stringify_spaces && !(flags & json_stringify_indent)) {
+			retVal = json_writer_append(writer, ", ", 2);
+		} else if (flags & json_stringify_indent) {
+			retVal = json_writer_append(writer, ",\n", 2);
+		} else {
+			retVal = json_writer_append(writer, ",", 1);
+		}
+		if (retVal) {
+			return retVal;
+		}
+	}
+	*top |= json_writer_has_items;
+
+	if (flags & json_stringify_indent) {
+		retVal = json_string_buffer_indent(writer->parserState, strBuff, strBuff->indent, strBuff->indentLen, strBuff->indentLevel);
+		if (retVal) {
+			writer->state = json_writer_failed;
+			return retVal;
+		}
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Check that a value may be written and write what precedes it
+static int json_writer_begin_value(json_writer* writer) {
+	int retVal = 1;
+
+	if (!writer || writer->state != json_writer_expect_value) {
+		if (writer) {
+			writer->state = json_writer_failed;
+		}
+		return retVal;
+	}
+
+	//Values in objects are preceded by their key instead
+	if (writer->depth && !(writer->stack[writer->depth - 1] & json_writer_in_object)) {
+		return json_writer_next_item(writer);
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Update the state after a complete value
+static void json_writer_end_value(json_writer* writer) {
+	if (!writer->depth) {
+		writer->state = json_writer_done;
+	} else if (writer->stack[writer->depth - 1] & json_writer_in_object) {
+		writer->state = json_writer_expect_key;
+	} else {
+		writer->state = json_writer_expect_value;
+	}
+}
+
+//Open an object or array
+static int json_writer_begin_container(json_writer* writer, const uint8_t type, const char* token) {
+	int retVal = json_writer_begin_value(writer);
+	if (retVal) {
+		return retVal;
+	}
+	retVal = 1;
+
+	if (writer->depth == writer->stackCapacity) {
+		const size_t capacity = (writer->stackCapacity) ? writer->stackCapacity * 2 : JSON_WRITER_INIT_DEPTH;
+		uint8_t* stack = json_allocator_grow(writer->parserState->JSON_Allocator, writer->stack, writer->stackCapacity, capacity);
+		if (!stack) {
+			writer->state = json_writer_failed;
+			return retVal;
+		}
+		writer->stack = stack;
+		writer->stackCapacity = capacity;
+	}
+
+	retVal = json_writer_append(writer, token, 1);
+	if (retVal) {
+		return retVal;
+	}
+	if (writer->strBuff.flags & json_stringify_indent) {
+		retVal = json_writer_append(writer, "\n", 1);
+		if (retVal) {
+			return retVal;
+		}
+	}
+
+	writer->stack[writer->depth] = type;
+	writer->depth += 1;
+	writer->strBuff.indentLevel += 1;
+	writer->state = (type & json_writer_in_object) ? json_writer_expect_key : json_writer_expect_value;
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_begin_object(json_writer* writer) {
+	return json_writer_begin_container(writer, json_writer_in_object, &JSON_TOKEN_NAMES[json_token_lbrace]);
+}
+
+int json_writer_begin_array(json_writer* writer) {
+	return json_writer_begin_container(writer, 0, &JSON_TOKEN_NAMES[json_token_lbrack]);
+}
+
+int json_writer_end(json_writer* writer) {
+	int retVal = 1;
+	if (!writer || !writer->depth) {
+		if (writer) {
+			writer->state = json_writer_failed;
+		}
+		return retVal;
+	}
+
+	//An object can't end after a key without its value
+	const bool inObject = writer->stack[writer->depth - 1] & json_writer_in_object;
+	if (writer->state != ((inObject) ? json_writer_expect_key : json_writer_expect_value)) {
+		writer->state = json_writer_failed;
+		return retVal;
+	}
+
+	json_string_buffer* strBuff = &writer->strBuff;
+	strBuff->indentLevel -= 1;
+	if (strBuff->flags & json_stringify_indent) {
+		retVal = json_writer_append(writer, "\n", 1);
+		if (retVal) {
+			return retVal;
+		}
+		retVal = json_string_buffer_indent(writer->parserState, strBuff, strBuff->indent, strBuff->indentLen, strBuff->indentLevel);
+		if (retVal) {
+			writer->state = json_writer_failed;
+			return retVal;
+		}
+	}
+
+	retVal = json_writer_append(writer, &JSON_TOKEN_NAMES[(inObject) ? json_token_rbrace : json_token_rbrack], 1);
+	if (retVal) {
+		return retVal;
+	}
+
+	writer->depth -= 1;
+	json_writer_end_value(writer);
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_key(json_writer* writer, const char* name, size_t nameLen) {
+	int retVal = 1;
+	if (!writer || writer->state != json_writer_expect_key || (!name && nameLen)) {
+		if (writer) {
+			writer->state = json_writer_failed;
+		}
+		return retVal;
+	}
+
+	retVal = json_writer_next_item(writer);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = json_string_buffer_append_string(writer->parserState, &writer->strBuff, name, nameLen);
+	if (retVal) {
+		writer->state = json_writer_failed;
+		return retVal;
+	}
+
+	if (writer->strBuff.flags & json_stringify_spaces) {
+		retVal = json_writer_append(writer, ": ", 2);
+	} else {
+		retVal = json_writer_append(writer, ":", 1);
+	}
+	if (retVal) {
+		return retVal;
+	}
+
+	writer->state = json_writer_expect_value;
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_string(json_writer* writer, const char* str, size_t strLen) {
+	int retVal = 1;
+	if (writer && !str && strLen) {
+		writer->state = json_writer_failed;
+		return retVal;
+	}
+
+	retVal = json_writer_begin_value(writer);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = json_string_buffer_append_string(writer->parserState, &writer->strBuff, str, strLen);
+	if (retVal) {
+		writer->state = json_writer_failed;
+		return retVal;
+	}
+
+	json_writer_end_value(writer);
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_number(json_writer* writer, double num) {
+	int retVal = json_writer_begin_value(writer);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = json_string_buffer_append_number(writer->parserState, &writer->strBuff, num);
+	if (retVal) {
+		writer->state = json_writer_failed;
+		return retVal;
+	}
+
+	json_writer_end_value(writer);
+
+	retVal = 0;
+	return retVal;
+}
+
+//Write a literal value
+static int json_writer_literal(json_writer* writer, const char* literal, const size_t literalLen) {
+	int retVal = json_writer_begin_value(writer);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = json_writer_append(writer, literal, literalLen);
+	if (retVal) {
+		return retVal;
+	}
+
+	json_writer_end_value(writer);
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_bool(json_writer* writer, int value) {
+	return (value) ? json_writer_literal(writer, "true", 4) : json_writer_literal(writer, "false", 5);
+}
+
+int json_writer_null(json_writer* writer) {
+	return json_writer_literal(writer, "null", 4);
+}
+
+//Write text that is already JSON, as a key if the writer expects one or as a value otherwise
+static int json_writer_raw(json_writer* writer, const char* text, const size_t textLen) {
+	int retVal = 1;
+
+	if (writer->state == json_writer_expect_key) {
+		if (text[0] != '"') {
+			writer->state = json_writer_failed;
+			return retVal;
+		}
+		retVal = json_writer_next_item(writer);
+		if (!retVal) {
+			retVal = json_writer_append(writer, text, textLen);
+		}
+		if (!retVal) {
+			retVal = (writer->strBuff.flags & json_stringify_spaces) ? json_writer_append(writer, ": ", 2) : json_writer_append(writer, ":", 1);
+		}
+		if (retVal) {
+			return retVal;
+		}
+		writer->state = json_writer_expect_value;
+		return retVal;
+	}
+
+	retVal = json_writer_begin_value(writer);
+	if (retVal) {
+		return retVal;
+	}
+
+	retVal = json_writer_append(writer, text, textLen);
+	if (retVal) {
+		return retVal;
+	}
+
+	json_writer_end_value(writer);
+
+	retVal = 0;
+	return retVal;
+}
+
+int json_writer_finish(json_writer* writer, char** str, size_t* strLen) {
+	int retVal = 1;
+	if (!writer || writer->state != json_writer_done) {
+		return retVal;
+	}
+
+	json_string_buffer* strBuff = &writer->strBuff;
+	if (strBuff->mode == json_buffer_sink) {
+		retVal = json_string_buffer_flush(strBuff);
+		if (retVal) {
+			writer->state = json_writer_failed;
+			return retVal;
+		}
+		if (str) {
+			*str = NULL;
+		}
+		if (strLen) {
+			*strLen = 0;
+		}
+		return retVal;
+	}
+
+	if (!str) {
+		return retVal;
+	}
+
+	retVal = json_writer_append(writer, "\0", 1);
+	if (retVal) {
+		return retVal;
+	}
+
+	//The caller owns the text now
+	*str = strBuff->string;
+	if (strLen) {
+		*strLen = strBuff->size;
+	}
+	strBuff->string = NULL;
+	strBuff->size = 0;
+	strBuff->capacity = 0;
+	writer->state = json_writer_failed;
+
+	retVal = 0;
+	return retVal;
+}
+
+/* JSON text reformatting */
+
+//Returns the length of the escape sequence whose backslash is at pos, or zero if it is malformed
+static size_t json_text_escape_len(const char* text, const size_t textLen, const size_t pos) {
+	if (pos + 1 >= textLen) {
+		return 0;
+	}
+
+	switch (text[pos + 1]) {
+		case '"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			return 2;
+		break;
+		case 'u':
+			if (
+				pos + 5 < textLen
+				&& isxdigit((unsigned char) text[pos + 2])
+				&& isxdigit((unsigned char) text[pos + 3])
+				&& isxdigit((unsigned char) text[pos + 4])
+				&& isxdigit((unsigned char) text[pos + 5])
+			) {
+				return 6;
+			}
+		break;
+	}
+
+	return 0;
+}
+
+//Returns the position after the closing quote of the string whose opening quote is at pos, or zero if it is malformed
+//Escape sequences are only checked when strict is set
+static size_t json_text_skip_string(const json_simd_kernels* kernels, const char* text, const size_t textLen, size_t pos, const bool strict) {
+	pos += 1;
+	while (pos < textLen) {
+		pos = kernels->scan_string(text, textLen, pos);
+		if (pos >= textLen || (uint8_t) text[pos] < 0x20) {
+			break;
+		} else if (text[pos] == '"') {
+			return pos + 1;
+		} else if (!strict) {
+			//Skip the escaped char
+			pos += 2;
+		} else {
+			const size_t escapeLen = json_text_escape_len(text, textLen, pos);
+			if (!escapeLen) {
+				break;
+			}
+			pos += escapeLen;
+		}
+	}
+
+	return 0;
+}
+
+static inline bool json_text_is_ws(const char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+//Returns true if c can be part of a number or literal, so two of them must be separated
+static inline bool json_text_is_scalar_char(const char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+int json_minify(const char* json, size_t jsonLen, char* out, size_t* outLen) {
+	int retVal = 1;
+	if (!json || !out) {
+		return retVal;
+	}
+
+	//Without a parser, use the kernels of the CPU
+	const json_simd_kernels* kernels = json_simd_get_kernels(json_cpu_detect());
+	size_t pos = 0;
+	size_t outPos = 0;
+	while (pos < jsonLen) {
+		//Copy the run up to the next whitespace or string
+		const size_t runEnd = kernels->scan_plain(json, jsonLen, pos);
+		if (runEnd > pos) {
+			memmove(out + outPos, json + pos, runEnd - pos);
+			outPos += runEnd - pos;
+			pos = runEnd;
+		}
+		if (pos >= jsonLen) {
+			break;
+		}
+
+		if (json[pos] == '"') {
+			const size_t strEnd = json_text_skip_string(kernels, json, jsonLen, pos, false);
+			if (!strEnd) {
+				return retVal;
+			}
+			memmove(out + outPos, json + pos, strEnd - pos);
+			outPos += strEnd - pos;
+			pos = strEnd;
+		} else if (json_text_is_ws(json[pos])) {
+			while (pos < jsonLen && json_text_is_ws(json[pos])) {
+				pos += 1;
+			}
+			//Keep one space between numbers or literals so they aren't merged, as in [1 2]
+			if (pos < jsonLen && outPos && json_text_is_scalar_char(out[outPos - 1]) && json_text_is_scalar_char(json[pos])) {
+				out[outPos] = ' ';
+				outPos += 1;
+			}
+		} else {//Control character
+			return retVal;
+		}
+	}
+
+	if (outLen) {
+		*outLen = outPos;
+	}
+
+	retVal = 0;
+	return retVal;
+}
+
+//Returns the position after the run of digits at pos
+static inline size_t json_text_skip_digits(const char* text, const size_t textLen, size_t pos) {
+	while (pos < textLen && text[pos] >= '0' && text[pos] <= '9') {
+		pos += 1;
+	}
+	return pos;
+}
+
+//Returns the length of the number at pos, or zero if it doesn't match the grammar of RFC 8259:
+//-? (0 | [1-9][0-9]*) (.[0-9]+)? ([eE][+-]?[0-9]+)?
+static size_t json_text_number_len(const char* text, const size_t textLen, const size_t pos) {
+	size_t end = pos;
+	if (end < textLen && text[end] == '-') {
+		end += 1;
+	}
+
+	if (end < textLen && text[end] == '0') {
+		end += 1;
+	} else if (end < textLen && text[end] >= '1' && text[end] <= '9') {
+		end = json_text_skip_digits(text, textLen, end + 1);
+	} else {
+		return 0;
+	}
+
+	if (end < textLen && text[end] == '.') {
+		const size_t fracEnd = json_text_skip_digits(text, textLen, end + 1);
+		if (fracEnd == end + 1) {
+			return 0;
+		}
+		end = fracEnd;
+	}
+
+	if (end < textLen && (text[end] == 'e' || text[end] == 'E')) {
+		end += 1;
+		if (end < textLen && (text[end] == '+' || text[end] == '-')) {
+			end += 1;
+		}
+		const size_t expEnd = json_text_skip_digits(text, textLen, end);
+		if (expEnd == end) {
+			return 0;
+		}
+		end = expEnd;
+	}
+
+	return end - pos;
+}
+
+//Returns the length of the number or literal at pos, or zero if it is malformed
+static size_t json_text_scalar_len(const char* text, const size_t textLen, const size_t pos) {
+	const size_t remaining = textLen - pos;
+	size_t len = 0;
+	if (text[pos] == '-' || (text[pos] >= '0' && text[pos] <= '9')) {
+		len = json_text_number_len(text, textLen, pos);
+	} else if (remaining >= 4 && (!memcmp(text + pos, "true", 4) || !memcmp(text + pos, "null", 4))) {
+		len = 4;
+	} else if (remaining >= 5 && !memcmp(text + pos, "false", 5)) {
+		len = 5;
+	}
+
+	//The token must end here, as in 01 or truex
+	if (!len || (pos + len < textLen && json_text_is_scalar_char(text[pos + len]))) {
+		return 0;
+	}
+
+	return len;
+}
+
+int json_reformat(
+	json_parser_state* parserState,
+	const char* json,
+	size_t jsonLen,
+	const char* indent,
+	int flags,
+	json_stringify_write_cb writeCb,
+	void* ctx
+) {
+	int retVal = 1;
+	if (!parserState || !json || !writeCb) {
+		return retVal;
+	}
+
+	json_writer* writer = json_writer_init_sink(parserState, indent, flags, writeCb, ctx);
+	if (!writer) {
+		return retVal;
+	}
+
+	//The writer checks the order of keys, values and brackets; separators are checked here
+	bool afterItem = false;
+	bool afterComma = false;
+	bool expectColon = false;
+	size_t pos = 0;
+	retVal = 0;
+	while (!retVal) {
+		while (pos < jsonLen && json_text_is_ws(json[pos])) {
+			pos += 1;
+		}
+		if (pos >= jsonLen) {
+			break;
+		}
+
+		const char c = json[pos];
+		if (expectColon && c != ':') {
+			retVal = 1;
+			break;
+		}
+
+		switch (c) {
+			case '{':
+			case '[':
+				retVal = (afterItem) ? 1 : (c == '{') ? json_writer_begin_object(writer) : json_writer_begin_array(writer);
+				afterComma = false;
+				pos += 1;
+			break;
+			case '}':
+			case ']': {
+				const bool inObject = writer->depth && (writer->stack[writer->depth - 1] & json_writer_in_object);
+				retVal = (afterComma || inObject != (c == '}')) ? 1 : json_writer_end(writer);
+				afterItem = true;
+				pos += 1;
+			}
+			break;
+			case ',':
+				retVal = (!afterItem || !writer->depth) ? 1 : 0;
+				afterItem = false;
+				afterComma = true;
+				pos += 1;
+			break;
+			case ':':
+				retVal = (expectColon) ? 0 : 1;
+				expectColon = false;
+				pos += 1;
+			break;
+			case '"': {
+				const size_t strEnd = json_text_skip_string(parserState->kernels, json, jsonLen, pos, true);
+				const bool isKey = writer->state == json_writer_expect_key;
+				retVal = (!strEnd || afterItem) ? 1 : json_writer_raw(writer, json + pos, strEnd - pos);
+				afterItem = !isKey;
+				afterComma = false;
+				expectColon = isKey;
+				pos = strEnd;
+			}
+			break;
+			default: {
+				const size_t len = json_text_scalar_len(json, jsonLen, pos);
+				retVal = (!len || afterItem) ? 1 : json_writer_raw(writer, json + pos, len);
+				afterItem = true;
+				afterComma = false;
+				pos += len;
+			}
+			break;
+		}
+	}
+
+	if (!retVal) {
+		retVal = json_writer_finish(writer, NULL, NULL);
+	}
+	json_writer_clear(writer);
+
+	return retVal;
+}
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_WRITER_C
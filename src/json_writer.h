@@ -0,0 +1,197 @@
+/* Copyright (C) 2015-2016 Chase
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ *  @file json_writer.h
+ *  @brief JSON parser library streaming writer
+ *
+ *  This header declares functions to write JSON text directly, without building
+ *  json_value trees first.
+ */
+
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+
+#ifndef JSON_TOP_LVL
+#error "The file json_writer.h must not be included directly. Include 'json.h' instead."
+#endif	//#ifndef JSON_TOP_LVL
+
+
+#include "json_types.h"
+#include "json_parser.h"
+#include "json_introspect.h"
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif	//#ifdef __cplusplus
+
+
+struct json_writer;
+/*! Typedef for json_writer struct */
+typedef struct json_writer json_writer;
+
+/**
+ *  @brief Create a writer producing a string
+ *
+ *  A writer produces one JSON text from a sequence of calls: begin and end calls
+ *  for objects and arrays, a key before each value of an object and calls for
+ *  the values themselves. Each call checks that it is valid where it is made, so
+ *  the writer can't produce malformed JSON. After a call fails the writer stays
+ *  in an error state and every further call fails.
+ *
+ *  The output is the same as json_value_stringify() of the equivalent value with
+ *  the same @p indent and @p flags. It is collected in memory allocated from the
+ *  allocator of @p parserState and returned by json_writer_finish(). With
+ *  json_stringify_canonical, members are written in the order of the calls, so
+ *  the caller provides them sorted.
+ *
+ *  @param parserState A pointer to the parser instance to allocate from
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @return Pointer to the writer, or @c NULL on failure
+ *
+ *  @see json_writer_init_sink() json_writer_clear()
+ */
+json_writer* json_writer_init(json_parser_state* parserState, const char* indent, int flags);
+
+/**
+ *  @brief Create a writer producing output through a callback
+ *
+ *  Like json_writer_init(), but the output is written through @p writeCb in
+ *  chunks, as with json_value_stringify_to_sink(). Memory stays bounded by a
+ *  fixed buffer and the nesting depth.
+ *
+ *  @param parserState A pointer to the parser instance to allocate from
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param writeCb Callback function receiving the output
+ *  @param ctx Pointer passed to @p writeCb
+ *  @return Pointer to the writer, or @c NULL on failure
+ */
+json_writer* json_writer_init_sink(json_parser_state* parserState, const char* indent, int flags, json_stringify_write_cb writeCb, void* ctx);
+
+/**
+ *  @brief Free a writer and any output it holds
+ *
+ *  @param writer Pointer to the writer to clear
+ *  @return Zero on success, or nonzero on failure
+ */
+int json_writer_clear(json_writer* writer);
+
+/*@{ */
+/*! Begin an object; returns zero on success, nonzero on failure */
+int json_writer_begin_object(json_writer* writer);
+/*! Begin an array; returns zero on success, nonzero on failure */
+int json_writer_begin_array(json_writer* writer);
+/*! End the innermost object or array; returns zero on success, nonzero on failure */
+int json_writer_end(json_writer* writer);
+/*! Write the name of the next member of an object; returns zero on success, nonzero on failure */
+int json_writer_key(json_writer* writer, const char* name, size_t nameLen);
+/*! Write a UTF-8 encoded string value; returns zero on success, nonzero on failure */
+int json_writer_string(json_writer* writer, const char* str, size_t strLen);
+/*! Write a number value; returns zero on success, nonzero on failure */
+int json_writer_number(json_writer* writer, double num);
+/*! Write @c true if @p value is nonzero or @c false otherwise; returns zero on success, nonzero on failure */
+int json_writer_bool(json_writer* writer, int value);
+/*! Write a @c null value; returns zero on success, nonzero on failure */
+int json_writer_null(json_writer* writer);
+/*@} */
+
+/**
+ *  @brief Finish the JSON text of a writer
+ *
+ *  This function fails unless exactly one complete value has been written.
+ *
+ *  For a writer from json_writer_init(), the @c null terminated text is
+ *  returned in @p str and its length, including the terminator as with
+ *  json_value_stringify(), in @p strLen. The string must be <b>freed manually</b>
+ *  by the free-like function passed to json_parser_init(), or with @c free() if
+ *  default alloc is used. For a writer from json_writer_init_sink(), the
+ *  remaining output is flushed to the callback and @p str and @p strLen may be
+ *  @c NULL.
+ *
+ *  @param writer Pointer to the writer
+ *  @param[out] str Pointer to receive the text, or @c NULL
+ *  @param[out] strLen Pointer to receive the length of the text, or @c NULL
+ *  @return Zero on success, nonzero on failure
+ */
+int json_writer_finish(json_writer* writer, char** str, size_t* strLen);
+
+/**
+ *  @brief Remove the whitespace from a JSON text
+ *
+ *  This function copies @p json to @p out without the structural whitespace,
+ *  without parsing it into values. Whitespace inside strings is kept, and a
+ *  single space is kept between two adjacent numbers or literals, as in
+ *  <tt>[1 2]</tt>, so that they are not merged into one token. Strings are
+ *  checked to be terminated and free of control characters, but the rest of
+ *  the text isn't validated; see json_reformat() for that.
+ *
+ *  The output is never longer than the input, so @p out needs room for
+ *  @p jsonLen bytes. It may be the same as @p json to minify in place. No
+ *  @c null terminator is written.
+ *
+ *  @param json The JSON text
+ *  @param jsonLen Length of @p json
+ *  @param[out] out Buffer of at least @p jsonLen bytes to receive the output
+ *  @param[out] outLen Pointer to a @c size_t to receive the length of the output, or @c NULL
+ *  @return Zero on success, nonzero on failure
+ */
+int json_minify(const char* json, size_t jsonLen, char* out, size_t* outLen);
+
+/**
+ *  @brief Reformat a JSON text
+ *
+ *  This function writes @p json through @p writeCb with the whitespace given by
+ *  @p indent and the json_stringify_spaces and json_stringify_indent @p flags,
+ *  without parsing it into values. The layout is the same as
+ *  json_value_stringify() with the same @p indent and @p flags. Strings and
+ *  numbers are copied as they are written in @p json, so the flags that change
+ *  escapes or numbers have no effect. The text is checked to be a single valid
+ *  JSON value as it is written, and the function fails at the first error,
+ *  after writing the output up to it.
+ *
+ *  @param parserState A pointer to the parser instance to allocate from
+ *  @param json The JSON text
+ *  @param jsonLen Length of @p json
+ *  @param indent A C string with the chars to use for indentation, or @c NULL for default
+ *  @param flags A bitmask of JSON_STRINGIFY_FLAGS
+ *  @param writeCb Callback function receiving the output
+ *  @param ctx Pointer passed to @p writeCb
+ *  @return Zero on success, nonzero on failure
+ */
+int json_reformat(
+	json_parser_state* parserState,
+	const char* json,
+	size_t jsonLen,
+	const char* indent,
+	int flags,
+	json_stringify_write_cb writeCb,
+	void* ctx
+);
+
+
+#ifdef __cplusplus
+}
+#endif	//#ifdef __cplusplus
+
+
+#endif	//#ifndef JSON_WRITER_H
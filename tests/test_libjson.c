@@ -210,6 +210,322 @@ static int test_json_stringify(json_parser_state* parserState) {
 	return retVal;
 }
 
+static int test_json_stringify_escapes(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	/* Special characters inside and at the edges of runs longer than a vector */
+	const char* jsonStr = "[\"\\\"quoted\\\" and \\\\backslashed\\\\ text\\u0001 with a long clean run after it\", \"\\b\\f\\n\\r\\t\\u001F\", \"café 中文 😀\"]";
+	const char* jsonAscii = "[\"\\\"quoted\\\" and \\\\backslashed\\\\ text\\u0001 with a long clean run after it\",\"\\b\\f\\n\\r\\t\\u001F\",\"caf\\u00E9 \\u4E2D\\u6587 \\uD83D\\uDE00\"]";
+	
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with escapes\n");
+		exit_failure(retVal);
+	}
+	
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_escape_non_ascii, &stringifyLen);
+	if (!stringify || strcmp(jsonAscii, stringify) || stringifyLen != strlen(jsonAscii) + 1) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify() with escapes: unexpected output\n");
+		fprintf(stdout, "expected:\n%s\n\nhave:\n%s", jsonAscii, stringify);
+		exit_failure(retVal);
+	}
+	free(stringify);
+	json_visitor_free_all(parserState, topVal);
+	
+	/* Ill-formed UTF-8 fails when escaping instead of being decoded */
+	const char* badUtf8[] = {
+		"a\xC3zz", "\xF5\x80\x80\x80", "\xC0\xAFzz", "\xC1\xBFzz", "\xE2\x28\xA1z",
+		"\xED\xA0\x80z", "\xE0\x80\xAFz", "\xF0\x80\x80\xAF", "\xF4\x90\x80\x80", "\xF0\x9F\x98z", "\x80zzz"
+	};
+	for (size_t k = 0; k < sizeof(badUtf8) / sizeof(badUtf8[0]); k += 1) {
+		json_parser_reset(parserState);
+		topVal = json_parser_parse(parserState, "[\"zzzz\"]", 8);
+		if (!topVal) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_parse()\n");
+			exit_failure(retVal);
+		}
+		json_array* arr = topVal->value;
+		json_string* str = arr->values[0]->value;
+		memcpy((char*) str->value, badUtf8[k], 4);
+		stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_escape_non_ascii, &stringifyLen);
+		if (stringify) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_value_stringify() with ill-formed UTF-8 (%zu): have %s\n", k, stringify);
+			exit_failure(retVal);
+		}
+		json_visitor_free_all(parserState, topVal);
+	}
+	
+	/* Nesting deeper than the precomputed indent */
+	char nested[64];
+	char expected[1024];
+	size_t depth = 20;
+	size_t pos = 0;
+	for (size_t k = 0; k < depth; k += 1) {
+		nested[k] = '[';
+		nested[depth + 1 + k] = ']';
+	}
+	nested[depth] = '1';
+	nested[depth * 2 + 1] = 0;
+	for (size_t k = 0; k < depth; k += 1) {
+		memset(expected + pos, ' ', k * 2);
+		pos += k * 2;
+		memcpy(expected + pos, "[\n", 2);
+		pos += 2;
+	}
+	memset(expected + pos, ' ', depth * 2);
+	pos += depth * 2;
+	expected[pos++] = '1';
+	for (size_t k = depth; k > 0; k -= 1) {
+		expected[pos++] = '\n';
+		memset(expected + pos, ' ', (k - 1) * 2);
+		pos += (k - 1) * 2;
+		expected[pos++] = ']';
+	}
+	expected[pos] = 0;
+	
+	json_parser_reset(parserState);
+	topVal = json_parser_parse(parserState, nested, depth * 2 + 1);
+	stringify = (topVal) ? json_value_stringify(parserState, topVal, "  ", json_stringify_indent, &stringifyLen) : NULL;
+	if (!stringify || strcmp(expected, stringify)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify() with deep indent: unexpected output\n");
+		fprintf(stdout, "expected:\n%s\n\nhave:\n%s", expected, stringify);
+		exit_failure(retVal);
+	}
+	free(stringify);
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
+typedef struct test_sink_buffer {
+	char* data;
+	size_t size;
+	size_t writes;
+} test_sink_buffer;
+
+static int test_sink_write(void* ctx, const char* data, size_t dataLen) {
+	test_sink_buffer* sink = ctx;
+	char* tmp = realloc(sink->data, sink->size + dataLen + 1);
+	if (!tmp) {
+		return 1;
+	}
+	memcpy(tmp + sink->size, data, dataLen);
+	sink->data = tmp;
+	sink->size += dataLen;
+	sink->data[sink->size] = 0;
+	sink->writes += 1;
+	return 0;
+}
+
+static int test_sink_fail(void* ctx, const char* data, size_t dataLen) {
+	(void) ctx;
+	(void) data;
+	(void) dataLen;
+	return 1;
+}
+
+static int test_json_stringify_sink(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	/* Output several times larger than the sink buffer, with a string larger than it */
+	const size_t numStrs = 64;
+	const size_t strLen = 300;
+	const size_t longStrLen = 10000;
+	size_t jsonStrLen = 0;
+	char* jsonStr = malloc(numStrs * (strLen + 3) + longStrLen + 8);
+	if (!jsonStr) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tmalloc()\n");
+		exit_failure(retVal);
+	}
+	jsonStr[jsonStrLen++] = '[';
+	for (size_t k = 0; k < numStrs; k += 1) {
+		jsonStr[jsonStrLen++] = '"';
+		memset(jsonStr + jsonStrLen, 'a' + (k % 26), strLen);
+		jsonStrLen += strLen;
+		jsonStr[jsonStrLen++] = '"';
+		jsonStr[jsonStrLen++] = ',';
+	}
+	jsonStr[jsonStrLen++] = '"';
+	memset(jsonStr + jsonStrLen, 'z', longStrLen);
+	jsonStrLen += longStrLen;
+	jsonStr[jsonStrLen++] = '"';
+	jsonStr[jsonStrLen++] = ']';
+	jsonStr[jsonStrLen] = 0;
+	
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, jsonStrLen);
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() for sink\n");
+		exit_failure(retVal);
+	}
+	
+	test_sink_buffer sink = {NULL, 0, 0};
+	retVal = json_value_stringify_to_sink(parserState, topVal, NULL, 0, test_sink_write, &sink);
+	if (retVal || !sink.data || strcmp(jsonStr, sink.data) || sink.writes < 3) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_to_sink(): unexpected output\n");
+		exit_failure(retVal);
+	}
+	free(sink.data);
+	
+	if (!json_value_stringify_to_sink(parserState, topVal, NULL, 0, test_sink_fail, NULL)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_to_sink(): error of callback not returned\n");
+		exit_failure(retVal);
+	}
+	
+	FILE* file = tmpfile();
+	char* fileData = malloc(jsonStrLen * 2 + 1);
+	if (!file || !fileData) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\ttmpfile()\n");
+		exit_failure(retVal);
+	}
+	retVal = json_value_stringify_to_file(parserState, topVal, NULL, 0, file);
+	if (!retVal) {
+		fflush(file);
+		retVal = json_value_stringify_to_fd(parserState, topVal, NULL, 0, fileno(file));
+	}
+	rewind(file);
+	size_t fileLen = fread(fileData, sizeof(char), jsonStrLen * 2 + 1, file);
+	if (retVal || fileLen != jsonStrLen * 2 || memcmp(fileData, jsonStr, jsonStrLen) || memcmp(fileData + jsonStrLen, jsonStr, jsonStrLen)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_to_file() and json_value_stringify_to_fd(): unexpected output\n");
+		exit_failure(retVal);
+	}
+	fclose(file);
+	free(fileData);
+	free(jsonStr);
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_stringify_into(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"arr\": [1, 2.5, -3e-9, \"a\\nb\"], \"obj\": {\"café\": null, \"t\": true}, \"e\": []}";
+	const int flagSets[] = {
+		json_stringify_default,
+		json_stringify_spaces,
+		json_stringify_indent,
+		json_stringify_spaces | json_stringify_indent | json_stringify_escape_non_ascii
+	};
+	char buff[512];
+	
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() for stringify into\n");
+		exit_failure(retVal);
+	}
+	
+	for (size_t k = 0, n = sizeof(flagSets) / sizeof(flagSets[0]); k < n; k += 1) {
+		size_t stringifyLen = 0;
+		char* stringify = json_value_stringify(parserState, topVal, "  ", flagSets[k], &stringifyLen);
+		size_t size = json_value_stringify_size(parserState, topVal, "  ", flagSets[k]);
+		if (!stringify || size != stringifyLen) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_value_stringify_size(): have %zu, expected %zu\n", size, stringifyLen);
+			exit_failure(retVal);
+		}
+		
+		size_t intoLen = 0;
+		retVal = json_value_stringify_into(parserState, topVal, "  ", flagSets[k], buff, size, &intoLen);
+		if (retVal || intoLen != size || strcmp(buff, stringify)) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_into(): unexpected output\n");
+			fprintf(stdout, "expected:\n%s\n\nhave:\n%s", stringify, buff);
+			exit_failure(retVal);
+		} else if (!json_value_stringify_into(parserState, topVal, "  ", flagSets[k], buff, size - 1, &intoLen)) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_into(): succeeded with buffer too small\n");
+			exit_failure(retVal);
+		}
+		free(stringify);
+	}
+	
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_stringify_iov(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const size_t longStrLen = 2000;
+	char* jsonStr = malloc(longStrLen + 64);
+	if (!jsonStr) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tmalloc()\n");
+		exit_failure(retVal);
+	}
+	strcpy(jsonStr, "{\"short\": \"a\\tb\", \"blob\": \"");
+	size_t jsonStrLen = strlen(jsonStr);
+	memset(jsonStr + jsonStrLen, 'x', longStrLen);
+	jsonStrLen += longStrLen;
+	strcpy(jsonStr + jsonStrLen, "\", \"n\": 42}");
+	jsonStrLen += strlen(jsonStr + jsonStrLen);
+	
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, jsonStrLen);
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() for stringify iov\n");
+		exit_failure(retVal);
+	}
+	
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_spaces, &stringifyLen);
+	json_stringify_iov result = {NULL, 0, NULL, 0};
+	retVal = json_value_stringify_iov(parserState, topVal, NULL, json_stringify_spaces, &result);
+	if (retVal || !stringify || result.size != stringifyLen - 1) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_iov()\n");
+		exit_failure(retVal);
+	}
+	
+	json_object* obj = topVal->value;
+	const char* blob = obj->members[1].value ? ((json_string*) obj->members[1].value->value)->value : NULL;
+	int referenced = 0;
+	size_t pos = 0;
+	for (size_t k = 0; k < result.iovLen; k += 1) {
+		if (memcmp(stringify + pos, result.iov[k].iov_base, result.iov[k].iov_len)) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_iov(): unexpected output\n");
+			exit_failure(retVal);
+		}
+		referenced = referenced || result.iov[k].iov_base == blob;
+		pos += result.iov[k].iov_len;
+	}
+	if (!referenced) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify_iov(): long string copied\n");
+		exit_failure(retVal);
+	}
+	
+	json_stringify_iov_clear(parserState, &result);
+	free(stringify);
+	free(jsonStr);
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
 static int test_json_pointer(json_parser_state* parserState) {
 	int retVal = 1;
 	
@@ -260,176 +576,1398 @@ static int test_json_pointer(json_parser_state* parserState) {
 	json_number* num = val->value;
 	if (num->value != 1.0) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (1)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (1)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	num = NULL;
+	
+	query = "/obj/arr/1";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (2)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != number_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (2)\n");
+		exit_failure(retVal);
+	}
+	num = val->value;
+	if (num->value != 2.0) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (2)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	num = NULL;
+	
+	query = "/obj/arr/2";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (3)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != number_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (3)\n");
+		exit_failure(retVal);
+	}
+	num = val->value;
+	if (num->value != 3.0) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (3)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	num = NULL;
+	
+	query = "/obj/str";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	if (val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (4)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	
+	query = "/str";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (5)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != string_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (5)\n");
+		exit_failure(retVal);
+	}
+	json_string* str = val->value;
+	if (strncmp(str->value, "Some string here.", 17)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (5)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	str = NULL;
+	
+	query = "/num";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (6)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != number_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (6)\n");
+		exit_failure(retVal);
+	}
+	num = val->value;
+	if (num->value != 3.1415926535897932) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (6)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	num = NULL;
+	
+	query = "/tru";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (7)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != true_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (7)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	
+	query = "/fals";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (8)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != false_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (8)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	
+	query = "/nul";
+	queryLen = strlen(query);
+	val = json_value_query(parserState, topVal, query, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (9)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != null_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (9)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	
+	const char query2[] = {'/', 'b', 'a', 'd', '\0', 'w', 'o', 'l', 'f'};
+	queryLen = 9;
+	val = json_value_query(parserState, topVal, query2, queryLen);
+	 if (!val) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (10)\n");
+		exit_failure(retVal);
+	} else if (val->valueType != number_value) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (10)\n");
+		exit_failure(retVal);
+	}
+	num = val->value;
+	if (num->value != 1.0) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (10)\n");
+		exit_failure(retVal);
+	}
+	val = NULL;
+	num = NULL;
+	
+	retVal = json_visitor_free_all(parserState, topVal);
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all()\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_stringify_canonical(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	/* Members sort by UTF-16 code units, so U+FB33 follows the surrogate pair of U+1F600 */
+	const char* jsonStr = "{\"\\u20ac\": \"Euro\", \"\\r\": \"CR\", \"\\ufb33\": \"Dalet\", \"1\": [-0, 1e21, 1e-7, 0.000001, 333333333.33333329, 4.50],"
+		" \"\\ud83d\\ude00\": {\"b\": true, \"a\": \"\\u001f\"}, \"\\u0080\": null, \"\\u00f6\": \"o\"}";
+	const char* expected = "{\"\\r\":\"CR\",\"1\":[0,1e+21,1e-7,0.000001,333333333.3333333,4.5],\"\xc2\x80\":null,\"\xc3\xb6\":\"o\","
+		"\"\xe2\x82\xac\":\"Euro\",\"\xf0\x9f\x98\x80\":{\"a\":\"\\u001f\",\"b\":true},\"\xef\xac\xb3\":\"Dalet\"}";
+	
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() for canonical stringify\n");
+		exit_failure(retVal);
+	}
+	
+	/* Other flags are overridden */
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_canonical | json_stringify_indent | json_stringify_escape_non_ascii, &stringifyLen);
+	if (!stringify || strcmp(stringify, expected)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify(): unexpected canonical output\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_writer_document(json_writer* writer) {
+	int retVal = 0;
+	
+	retVal |= json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "name", 4);
+	retVal |= json_writer_string(writer, "a\"b\n", 4);
+	retVal |= json_writer_key(writer, "list", 4);
+	retVal |= json_writer_begin_array(writer);
+	retVal |= json_writer_number(writer, 1);
+	retVal |= json_writer_number(writer, 2.5);
+	retVal |= json_writer_bool(writer, 1);
+	retVal |= json_writer_bool(writer, 0);
+	retVal |= json_writer_null(writer);
+	retVal |= json_writer_begin_array(writer);
+	retVal |= json_writer_end(writer);
+	retVal |= json_writer_end(writer);
+	retVal |= json_writer_key(writer, "obj", 3);
+	retVal |= json_writer_begin_object(writer);
+	retVal |= json_writer_key(writer, "x", 1);
+	retVal |= json_writer_number(writer, -0.125);
+	retVal |= json_writer_end(writer);
+	retVal |= json_writer_end(writer);
+	
+	return retVal;
+}
+
+static int test_json_writer(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"name\":\"a\\\"b\\n\",\"list\":[1,2.5,true,false,null,[]],\"obj\":{\"x\":-0.125}}";
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() for writer\n");
+		exit_failure(retVal);
+	}
+	
+	/* The writer matches json_value_stringify() for each set of flags */
+	const int flagSets[] = {json_stringify_default, json_stringify_spaces, json_stringify_indent, json_stringify_indent | json_stringify_spaces};
+	for (size_t k = 0; k < sizeof(flagSets) / sizeof(flagSets[0]); k += 1) {
+		size_t expectedLen = 0;
+		char* expected = json_value_stringify(parserState, topVal, "  ", flagSets[k], &expectedLen);
+		json_writer* writer = json_writer_init(parserState, "  ", flagSets[k]);
+		char* str = NULL;
+		size_t strLen = 0;
+		retVal = (!expected || !writer) ? 1 : test_writer_document(writer);
+		if (!retVal) {
+			retVal = json_writer_finish(writer, &str, &strLen);
+		}
+		if (retVal || !str || strLen != expectedLen || strcmp(str, expected)) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_writer: unexpected output\n");
+			exit_failure(retVal);
+		}
+		free(str);
+		free(expected);
+		json_writer_clear(writer);
+	}
+	
+	/* Output through a sink */
+	test_sink_buffer sink = {NULL, 0, 0};
+	json_writer* writer = json_writer_init_sink(parserState, NULL, 0, test_sink_write, &sink);
+	retVal = (writer) ? test_writer_document(writer) : 1;
+	if (!retVal) {
+		retVal = json_writer_finish(writer, NULL, NULL);
+	}
+	if (retVal || !sink.data || strcmp(sink.data, jsonStr)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_writer_init_sink(): unexpected output\n");
+		exit_failure(retVal);
+	}
+	free(sink.data);
+	json_writer_clear(writer);
+	json_visitor_free_all(parserState, topVal);
+	
+	/* Invalid sequences fail and leave the writer failed */
+	writer = json_writer_init(parserState, NULL, 0);
+	char* str = NULL;
+	int invalid = !writer
+		|| !json_writer_end(writer)
+		|| !json_writer_finish(writer, &str, NULL);
+	json_writer_clear(writer);
+	writer = json_writer_init(parserState, NULL, 0);
+	invalid = invalid || !writer
+		|| json_writer_begin_array(writer)
+		|| !json_writer_key(writer, "a", 1)
+		|| !json_writer_end(writer);
+	json_writer_clear(writer);
+	writer = json_writer_init(parserState, NULL, 0);
+	invalid = invalid || !writer
+		|| json_writer_begin_object(writer)
+		|| json_writer_key(writer, "a", 1)
+		|| !json_writer_end(writer);
+	json_writer_clear(writer);
+	writer = json_writer_init(parserState, NULL, 0);
+	invalid = invalid || !writer
+		|| json_writer_number(writer, 1)
+		|| !json_writer_number(writer, 2)
+		|| !json_writer_finish(writer, &str, NULL);
+	json_writer_clear(writer);
+	writer = json_writer_init(parserState, NULL, 0);
+	invalid = invalid || !writer
+		|| json_writer_begin_array(writer)
+		|| !json_writer_finish(writer, &str, NULL);
+	json_writer_clear(writer);
+	if (invalid || str) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_writer: invalid sequence accepted\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_minify_reformat(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = " {\n\t\"long string with spaces and an \\\"escape\\\" \" : [ 1 , -2.5e+3 , true , false , null , [ ] , { } ] ,\r\n  \"b\" : { \"c\" : \"x y\" } }\n";
+	const char* minified = "{\"long string with spaces and an \\\"escape\\\" \":[1,-2.5e+3,true,false,null,[],{}],\"b\":{\"c\":\"x y\"}}";
+	
+	/* Minify in place */
+	const size_t jsonStrLen = strlen(jsonStr);
+	char* buff = malloc(jsonStrLen + 1);
+	if (!buff) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tmalloc()\n");
+		exit_failure(retVal);
+	}
+	memcpy(buff, jsonStr, jsonStrLen + 1);
+	size_t buffLen = 0;
+	retVal = json_minify(buff, jsonStrLen, buff, &buffLen);
+	if (retVal || buffLen != strlen(minified) || memcmp(buff, minified, buffLen)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_minify(): unexpected output\n");
+		exit_failure(retVal);
+	}
+	if (!json_minify("[\"abc", 5, buff, NULL) || !json_minify("[\"a\nb\"]", 7, buff, NULL)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_minify(): malformed string accepted\n");
+		exit_failure(retVal);
+	}
+	//Adjacent numbers and literals are not merged
+	const char* adjacent[][2] = {{"[1 2]", "[1 2]"}, {"[true \n\t false]", "[true false]"}, {"[ -1 ,2e3\tnull ]", "[-1,2e3 null]"}};
+	for (size_t k = 0; k < sizeof(adjacent) / sizeof(adjacent[0]); k += 1) {
+		retVal = json_minify(adjacent[k][0], strlen(adjacent[k][0]), buff, &buffLen);
+		if (retVal || buffLen != strlen(adjacent[k][1]) || memcmp(buff, adjacent[k][1], buffLen)) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_minify(): %s merged tokens\n", adjacent[k][0]);
+			exit_failure(retVal);
+		}
+	}
+	free(buff);
+	
+	/* Reformat matches the layout of json_value_stringify() */
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, minified, strlen(minified));
+	size_t expectedLen = 0;
+	char* expected = (topVal) ? json_value_stringify(parserState, topVal, "  ", json_stringify_indent | json_stringify_spaces, &expectedLen) : NULL;
+	if (retVal || !expected) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify() for reformat\n");
+		exit_failure(retVal);
+	}
+	//Numbers are copied as written
+	const char* number = strstr(expected, "-2500");
+	test_sink_buffer sink = {NULL, 0, 0};
+	retVal = json_reformat(parserState, jsonStr, jsonStrLen, "  ", json_stringify_indent | json_stringify_spaces, test_sink_write, &sink);
+	if (retVal || !number || !sink.data || strncmp(sink.data, expected, number - expected) || strcmp(sink.data + (number - expected) + 7, number + 5)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_reformat(): unexpected output\n");
+		exit_failure(retVal);
+	}
+	free(sink.data);
+	free(expected);
+	json_visitor_free_all(parserState, topVal);
+	
+	/* Reformat rejects invalid text */
+	const char* invalid[] = {"[1,]", "{\"a\" 1}", "[1 2]", "{\"a\":1]", "[\"abc", "[tru]", "{,}", "1 2", "{\"a\":}", "[1]]", "{1:2}", "",
+		"[1..2]", "[--3]", "[01]", "[1e]", "[-]", "[1.]", "[1E+]", "[.5]", "[+1]", "[1.5e+2.0]", "[-01]", "[truex]", "[nulls]", "[1true]",
+		"[\"\\q\"]", "[\"\\x\"]", "[\"\\u00zz\"]", "[\"\\u12\"]", "[\"\\\"]"
+	};
+	for (size_t k = 0; k < sizeof(invalid) / sizeof(invalid[0]); k += 1) {
+		sink.data = NULL;
+		sink.size = 0;
+		retVal = json_reformat(parserState, invalid[k], strlen(invalid[k]), NULL, 0, test_sink_write, &sink);
+		free(sink.data);
+		if (!retVal) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_reformat(): accepted %s\n", invalid[k]);
+			exit_failure(retVal);
+		}
+	}
+	
+	/* Reformat accepts every form of number and escape in the grammar */
+	const char* numbers = "[0,-0,10,-1.25,0.5e10,1E+2,1e-2,-0.0E0,\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\uABCD\"]";
+	sink.data = NULL;
+	sink.size = 0;
+	retVal = json_reformat(parserState, numbers, strlen(numbers), NULL, 0, test_sink_write, &sink);
+	if (retVal || !sink.data || strcmp(sink.data, numbers)) {
+		retVal = 1;
+		fprintf(stdout, "FAIL:\tjson_reformat(): rejected %s\n", numbers);
+		exit_failure(retVal);
+	}
+	free(sink.data);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_source_spans(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"a\": [1, 2 ,3], \"b\": {\"c\" : \"\\u0041\"}}";
+	retVal = json_parser_reset(parserState);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_record_source_spans, 1);
+	}
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with source spans\n");
+		exit_failure(retVal);
+	}
+	
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_source_spans, &stringifyLen);
+	if (!stringify || strcmp(stringify, jsonStr)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify(): source span not copied\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	
+	//Editing a string directly drops the spans of its enclosing containers only
+	json_object* obj = topVal->value;
+	json_object* objB = obj->members[1].value->value;
+	json_value* valC = objB->members[0].value;
+	json_string* strC = valC->value;
+	((char*) strC->value)[0] = 'B';
+	json_value_mark_modified(valC);
+	stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_source_spans, &stringifyLen);
+	if (!stringify || strcmp(stringify, "{\"a\":[1, 2 ,3],\"b\":{\"c\":\"B\"}}")) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_mark_modified()\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	
+	//Adding an element drops the span of the array
+	json_array* arrA = obj->members[0].value->value;
+	json_value* val = parserState->JSON_Factory->new_json_value(parserState->JSON_Factory, null_value, NULL, array_value, arrA);
+	json_null* nul = val ? parserState->JSON_Factory->new_json_null(parserState->JSON_Factory, val) : NULL;
+	if (!nul) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tJSON_Factory::new_json_null\n");
+		exit_failure(retVal);
+	}
+	val->value = nul;
+	retVal = json_array_add_element(parserState->JSON_Factory, arrA, val);
+	stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_source_spans, &stringifyLen);
+	if (retVal || !stringify || strcmp(stringify, "{\"a\":[1,2,3,null],\"b\":{\"c\":\"B\"}}")) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_array_add_element(): source span kept\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	json_visitor_free_all(parserState, topVal);
+	
+	//Escaping non-ASCII chars overrides the spans
+	const char* jsonUtf8 = "{\"a\": [\"caf\xC3\xA9\", \"\xF0\x9F\x98\x80\"]}";
+	retVal = json_parser_reset(parserState);
+	topVal = json_parser_parse(parserState, jsonUtf8, strlen(jsonUtf8));
+	if (retVal || !topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with source spans\n");
+		exit_failure(retVal);
+	}
+	const char* escapeFlags[] = {"{\"a\":[\"caf\\u00E9\",\"\\uD83D\\uDE00\"]}", "{\"a\":[\"caf\xC3\xA9\",\"\\uD83D\\uDE00\"]}"};
+	stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_source_spans | json_stringify_escape_non_ascii, &stringifyLen);
+	if (!stringify || strcmp(stringify, escapeFlags[0])) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify(): source span copied with json_stringify_escape_non_ascii\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	stringify = json_value_stringify(parserState, topVal, NULL, json_stringify_source_spans | json_stringify_escape_non_bmp, &stringifyLen);
+	if (!stringify || strcmp(stringify, escapeFlags[1])) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify(): source span copied with json_stringify_escape_non_bmp\n");
+		exit_failure(retVal);
+	}
+	free(stringify);
+	
+	json_visitor_free_all(parserState, topVal);
+	json_parser_setopt(parserState, json_record_source_spans, 0);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_memory_usage(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"a\": [1, 2, 3], \"b\": \"xy\", \"c\": true, \"d\": null}";
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tjson_parser_parse()\n");
+		exit_failure(retVal);
+	}
+	
+	json_memory_usage usage;
+	retVal = json_value_memory_usage(topVal, &usage);
+	if (retVal) {
+		fprintf(stdout, "%s", "FAIL:\tjson_value_memory_usage()\n");
+		exit_failure(retVal);
+	}
+	
+	json_object* obj = topVal->value;
+	json_array* arr = obj->members[0].value->value;
+	size_t total = usage.values + usage.objects + usage.objectMembers + usage.shapes + usage.arrays;
+	total += usage.arrayElements + usage.strings + usage.stringBytes + usage.numbers + usage.literals;
+	if (
+		usage.valueCount != 8 ||
+		usage.values != 8 * sizeof(json_value) ||
+		usage.objects != sizeof(json_object) ||
+		usage.objectMembers != obj->capacity * sizeof(json_object_member) ||
+		usage.shapes != 0 ||
+		usage.arrays != sizeof(json_array) ||
+		usage.arrayElements != arr->capacity * sizeof(json_value*) ||
+		usage.strings != 5 * sizeof(json_string) ||
+		usage.stringBytes != 4 * 2 + 3 ||
+		usage.numbers != 3 * sizeof(json_number) ||
+		usage.literals != sizeof(json_true) + sizeof(json_null) ||
+		usage.total != total
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_memory_usage(): wrong sizes\n");
+		exit_failure(retVal);
+	}
+	json_visitor_free_all(parserState, topVal);
+	
+	//Packed number arrays count their doubles instead of values
+	retVal = json_parser_reset(parserState);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_pack_number_arrays, 1);
+	}
+	topVal = json_parser_parse(parserState, "[1, 2, 3]", 9);
+	if (retVal || !topVal) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tjson_parser_parse() with packed number arrays\n");
+		exit_failure(retVal);
+	}
+	arr = topVal->value;
+	retVal = json_value_memory_usage(topVal, &usage);
+	if (
+		retVal || usage.valueCount != 1 || usage.numbers != 0 ||
+		usage.arrayElements != arr->capacity * sizeof(double) ||
+		usage.total != sizeof(json_value) + sizeof(json_array) + usage.arrayElements
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_memory_usage(): packed number array\n");
+		exit_failure(retVal);
+	}
+	json_visitor_free_all(parserState, topVal);
+	json_parser_setopt(parserState, json_pack_number_arrays, 0);
+	
+	if (!json_value_memory_usage(NULL, &usage)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_value_memory_usage(): accepted NULL value\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_stats(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	json_allocator_stats before, after;
+	if (json_parser_get_stats(parserState, &before)) {
+		//Built without --enable-stats; the counters must read as zero
+		if (before.allocations || before.bytesLive || before.categories[json_alloc_value].allocations) {
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_get_stats(): counters without --enable-stats\n");
+			exit_failure(retVal);
+		}
+		retVal = 0;
+		return retVal;
+	}
+	
+	const char* jsonStr = "{\"a\": [1, 2, 3, 4, 5, 6, 7, 8, 9], \"b\": \"x\\u0041\"}";
+	retVal = json_parser_reset(parserState);
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	if (retVal || !topVal) {
+		retVal = 99;
+		fprintf(stdout, "%s", "ERROR:\tjson_parser_parse()\n");
+		exit_failure(retVal);
+	}
+	
+	//Growing a buffer counts the bytes added
+	json_object* obj = topVal->value;
+	json_array* arr = obj->members[0].value->value;
+	json_allocator_stats grown;
+	retVal = json_parser_get_stats(parserState, &grown);
+	retVal = retVal || json_array_reserve(parserState->JSON_Factory, arr, arr->capacity + 8);
+	retVal = retVal || json_parser_get_stats(parserState, &after);
+	if (retVal || after.growths - grown.growths != 1 || after.growthBytes - grown.growthBytes != 8 * sizeof(json_value*)) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_get_stats(): wrong growth counts\n");
+		exit_failure(retVal);
+	}
+	
+	const json_alloc_category_stats* values = after.categories + json_alloc_value;
+	const json_alloc_category_stats* strings = after.categories + json_alloc_string;
+	const json_alloc_category_stats* numbers = after.categories + json_alloc_number;
+	if (
+		retVal ||
+		values->allocations - before.categories[json_alloc_value].allocations != 12 ||
+		numbers->allocations - before.categories[json_alloc_number].allocations != 9 ||
+		strings->allocations - before.categories[json_alloc_string].allocations != 6 ||
+		strings->bytes - before.categories[json_alloc_string].bytes != 3 * sizeof(json_string) + 2 + 2 + 3 ||
+		after.bytesLive <= before.bytesLive ||
+		after.peakBytes < after.bytesLive
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_get_stats(): wrong counts after parse\n");
+		exit_failure(retVal);
+	}
+	
+	json_visitor_free_all(parserState, topVal);
+	retVal = json_parser_get_stats(parserState, &after);
+	if (
+		retVal ||
+		after.bytesLive != before.bytesLive ||
+		after.frees - before.frees != after.allocations - before.allocations
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_get_stats(): memory not returned after free\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_phase_stats(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	json_parser_phase_stats stats;
+	retVal = json_parser_reset(parserState);
+	if (!retVal && json_parser_setopt(parserState, json_time_phases, 1)) {
+		//Built without --enable-stats; timing can't be turned on
+		if (!json_parser_get_phase_stats(parserState, &stats) || stats.parses) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_get_phase_stats(): stats without --enable-stats\n");
+			exit_failure(retVal);
+		}
+		retVal = 0;
+		return retVal;
+	}
+	
+	const char* jsonStr = "{\"a\": [1, 2.5, -3], \"b\": \"x\\u0041\", \"c\": null}";
+	json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	retVal = retVal || !topVal || json_parser_get_phase_stats(parserState, &stats);
+	if (
+		retVal ||
+		stats.parses != 1 ||
+		stats.calls[json_phase_number] != 3 ||
+		stats.calls[json_phase_unescape] != 4 ||
+		stats.calls[json_phase_string_scan] != 4 ||
+		stats.calls[json_phase_allocation] != 17 ||
+		!stats.calls[json_phase_whitespace]
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_get_phase_stats(): wrong counts\n");
+		exit_failure(retVal);
+	}
+	json_visitor_free_all(parserState, topVal);
+	
+	//Turning timing off keeps the totals
+	json_parser_setopt(parserState, json_time_phases, 0);
+	retVal = json_parser_reset(parserState);
+	topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+	retVal = retVal || !topVal || json_parser_get_phase_stats(parserState, &stats);
+	if (retVal || stats.parses != 1 || stats.calls[json_phase_number] != 3) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_get_phase_stats(): timed with option off\n");
+		exit_failure(retVal);
+	}
+	json_visitor_free_all(parserState, topVal);
+	
+	retVal = 0;
+	return retVal;
+}
+
+typedef struct test_arena {
+	size_t allocations;
+	size_t liveBytes;
+	size_t sizedFrees;
+	size_t reallocs;
+	size_t wrongSizes;
+} test_arena;
+
+/* Each block carries its size in a header so free_sized and realloc can be checked */
+#define TEST_ARENA_HEADER 16
+
+static void* test_arena_alloc(void* ctx, size_t size) {
+	test_arena* arena = ctx;
+	char* block = malloc(size + TEST_ARENA_HEADER);
+	if (!block) {
+		return NULL;
+	}
+	*((size_t*) block) = size;
+	arena->allocations += 1;
+	arena->liveBytes += size;
+	return block + TEST_ARENA_HEADER;
+}
+
+static void test_arena_free(void* ctx, void* ptr) {
+	test_arena* arena = ctx;
+	char* block = (char*) ptr - TEST_ARENA_HEADER;
+	arena->liveBytes -= *((size_t*) block);
+	free(block);
+}
+
+static void test_arena_free_sized(void* ctx, void* ptr, size_t size) {
+	test_arena* arena = ctx;
+	char* block = (char*) ptr - TEST_ARENA_HEADER;
+	arena->sizedFrees += 1;
+	arena->wrongSizes += (*((size_t*) block) != size);
+	test_arena_free(ctx, ptr);
+}
+
+static void* test_arena_realloc(void* ctx, void* ptr, size_t oldSize, size_t newSize) {
+	test_arena* arena = ctx;
+	char* block = (char*) ptr - TEST_ARENA_HEADER;
+	arena->reallocs += 1;
+	arena->wrongSizes += (*((size_t*) block) != oldSize);
+	block = realloc(block, newSize + TEST_ARENA_HEADER);
+	if (!block) {
+		return NULL;
+	}
+	*((size_t*) block) = newSize;
+	arena->liveBytes += newSize - oldSize;
+	return block + TEST_ARENA_HEADER;
+}
+
+static int test_json_allocator_ctx(json_parser_state* parserState) {
+	int retVal = 1;
+	(void) parserState;
+	
+	json_allocator_ctx ctxAlloc = {NULL, test_arena_alloc, NULL, NULL, NULL};
+	if (json_parser_init_ex(NULL) || json_parser_init_ex(&ctxAlloc)) {
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_init_ex(): accepted an allocator without free\n");
+		exit_failure(retVal);
+	}
+	
+	const char* jsonStr = (
+		"[{\"name\": \"a\\tb\\u00e9\", \"nums\": [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]},"
+		"{\"name\": \"\\\"c\\\"\", \"nums\": []},"
+		"{\"name\": \"d\", \"nums\": [0.5]}]"
+	);
+	
+	//Run once growing with realloc and once by allocating, copying and freeing
+	for (int withRealloc = 0; withRealloc < 2; withRealloc += 1) {
+		test_arena arena = {0, 0, 0, 0, 0};
+		ctxAlloc.ctx = &arena;
+		ctxAlloc.free = test_arena_free;
+		ctxAlloc.realloc = (withRealloc) ? test_arena_realloc : NULL;
+		ctxAlloc.freeSized = test_arena_free_sized;
+		
+		json_parser_state* ctxState = json_parser_init_ex(&ctxAlloc);
+		if (!ctxState) {
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_init_ex()\n");
+			exit_failure(retVal);
+		}
+		retVal = !json_parser_setopt(ctxState, json_realloc_function, realloc);
+		retVal = retVal || json_parser_setopt(ctxState, json_pack_number_arrays, 1);
+		retVal = retVal || json_parser_setopt(ctxState, json_share_object_shapes, 1);
+		retVal = retVal || json_parser_setopt(ctxState, json_intern_names, 1);
+		if (retVal) {
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt(): options of a json_parser_init_ex() parser\n");
+			exit_failure(retVal);
+		}
+		
+		json_value* topVal = json_parser_parse(ctxState, jsonStr, strlen(jsonStr));
+		size_t strLen = 0;
+		char* str = (topVal) ? json_value_stringify(ctxState, topVal, "  ", json_stringify_indent | json_stringify_spaces, &strLen) : NULL;
+		if (!str || !arena.allocations) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_init_ex(): parse or stringify\n");
+			exit_failure(retVal);
+		}
+		test_arena_free(&arena, str);
+		json_visitor_free_all(ctxState, topVal);
+		json_parser_clear(ctxState);
+		
+		if (arena.liveBytes || arena.wrongSizes || !arena.sizedFrees || (withRealloc && !arena.reallocs)) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_parser_init_ex(): %zu bytes live, %zu wrong sizes\n", arena.liveBytes, arena.wrongSizes);
+			exit_failure(retVal);
+		}
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_node_pools(json_parser_state* parserState) {
+	int retVal = 1;
+	(void) parserState;
+	
+	char jsonStr[1024] = "[";
+	for (int k = 0; k < 20; k += 1) {
+		char member[64];
+		snprintf(member, sizeof(member), "%s{\"a\": %d, \"b\": \"x%d\"}", (k) ? ", " : "", k, k);
+		strcat(jsonStr, member);
+	}
+	strcat(jsonStr, "]");
+	
+	test_arena arena = {0, 0, 0, 0, 0};
+	json_allocator_ctx ctxAlloc = {&arena, test_arena_alloc, test_arena_free, NULL, test_arena_free_sized};
+	json_parser_state* ctxState = json_parser_init_ex(&ctxAlloc);
+	if (
+		!ctxState ||
+		!json_parser_setopt(ctxState, json_node_pool_limit, -1) ||
+		json_parser_setopt(ctxState, json_node_pool_limit, 64) ||
+		json_parser_setopt(ctxState, json_presize_containers, 0)
+	) {
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt(): json_node_pool_limit\n");
+		exit_failure(retVal);
+	}
+	//Without pre-sizing the parser keeps no memory between parses
+	const size_t baseBytes = arena.liveBytes;
+	
+	size_t parseAllocations[2] = {0, 0};
+	for (int k = 0; k < 2; k += 1) {
+		const size_t allocations = arena.allocations;
+		json_parser_reset(ctxState);
+		json_value* topVal = json_parser_parse(ctxState, jsonStr, strlen(jsonStr));
+		json_value* member = (topVal) ? json_value_query(ctxState, topVal, "/19/b", 5) : NULL;
+		if (!member || member->valueType != string_value || strcmp(((json_string*) member->value)->value, "x19")) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): with node pools\n");
+			exit_failure(retVal);
+		}
+		json_visitor_free_all(ctxState, topVal);
+		parseAllocations[k] = arena.allocations - allocations;
+	}
+	
+	//The second parse reuses the nodes of the first, and lowering the limit frees them
+	if (parseAllocations[1] * 2 > parseAllocations[0] || arena.liveBytes == baseBytes) {
+		retVal = 1;
+		fprintf(stdout, "FAIL:\tjson_node_pool_limit: %zu then %zu allocations\n", parseAllocations[0], parseAllocations[1]);
+		exit_failure(retVal);
+	}
+	json_parser_setopt(ctxState, json_node_pool_limit, 0);
+	if (arena.liveBytes != baseBytes) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_node_pool_limit: pools not trimmed\n");
+		exit_failure(retVal);
+	}
+	
+	json_parser_setopt(ctxState, json_node_pool_limit, 64);
+	json_parser_reset(ctxState);
+	json_visitor_free_all(ctxState, json_parser_parse(ctxState, jsonStr, strlen(jsonStr)));
+	json_parser_clear(ctxState);
+	if (arena.liveBytes || arena.wrongSizes) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_clear(): pooled nodes not freed\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = 0;
+	return retVal;
+}
+
+static size_t factoryNumbers = 0;
+static json_number* test_new_json_number(json_factory* jsonFact, double numValue, json_value* numParentValue) {
+	factoryNumbers += 1;
+	return json_factory_new_json_number(jsonFact, numValue, numParentValue);
+}
+
+static int test_json_factory_override(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"a\": [1, 2, true, null], \"b\": {\"c\": 3.5, \"d\": false}}";
+	json_factory* jsonFact = parserState->JSON_Factory;
+	
+	//Nodes made inline by the default factory and through a replaced function must match
+	for (int override = 0; override < 2; override += 1) {
+		factoryNumbers = 0;
+		jsonFact->new_json_number = (override) ? test_new_json_number : json_factory_new_json_number;
+		retVal = json_parser_reset(parserState);
+		json_value* topVal = json_parser_parse(parserState, jsonStr, strlen(jsonStr));
+		json_value* num = (topVal) ? json_value_query(parserState, topVal, "/b/c", 4) : NULL;
+		json_value* lit = (topVal) ? json_value_query(parserState, topVal, "/a/3", 4) : NULL;
+		if (
+			retVal || !num || !lit ||
+			num->valueType != number_value || ((json_number*) num->value)->value != 3.5 ||
+			((json_number*) num->value)->parentValue != num ||
+			lit->valueType != null_value || ((json_null*) lit->value)->parentValue != lit ||
+			factoryNumbers != ((override) ? 3 : 0)
+		) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_parser_parse(): nodes with new_json_number %s\n", (override) ? "replaced" : "default");
+			exit_failure(retVal);
+		}
+		json_visitor_free_all(parserState, topVal);
+	}
+	jsonFact->new_json_number = json_factory_new_json_number;
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_cpu_levels(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const JSON_CPU_LEVEL detected = json_cpu_detect();
+	if (
+		!json_parser_setopt(parserState, json_cpu_level, -1) ||
+		(detected + 1 < JSON_CPU_LEVEL_MAX && !json_parser_setopt(parserState, json_cpu_level, detected + 1))
+	) {
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt(): json_cpu_level above the CPU\n");
+		exit_failure(retVal);
+	}
+	
+	//Strings of every length around the 16, 32 and 64 byte blocks, with the special byte at the end
+	char jsonStr[16384] = "[";
+	size_t jsonStrLen = 1;
+	const char* specials[] = {"\\n", "\xC3\xA9", "\\\"", "\x7F"};
+	for (size_t len = 0; len < 130; len += 1) {
+		jsonStr[jsonStrLen++] = '"';
+		for (size_t k = 0; k < len; k += 1) {
+			jsonStr[jsonStrLen++] = 'a' + (k % 26);
+		}
+		const char* special = specials[len % 4];
+		memcpy(jsonStr + jsonStrLen, special, strlen(special));
+		jsonStrLen += strlen(special);
+		jsonStr[jsonStrLen++] = '"';
+		jsonStr[jsonStrLen++] = ',';
+	}
+	jsonStr[jsonStrLen - 1] = ']';
+	jsonStr[jsonStrLen] = 0;
+	
+	//Every level must give the output of the scalar kernels
+	char* expected[2] = {NULL, NULL};
+	for (int level = json_cpu_scalar; level <= (int) detected; level += 1) {
+		retVal = json_parser_setopt(parserState, json_cpu_level, level);
+		retVal = retVal || json_parser_reset(parserState);
+		json_value* topVal = (!retVal) ? json_parser_parse(parserState, jsonStr, jsonStrLen) : NULL;
+		for (int escape = 0; escape < 2 && topVal; escape += 1) {
+			size_t strLen = 0;
+			char* str = json_value_stringify(parserState, topVal, NULL, (escape) ? json_stringify_escape_non_ascii : json_stringify_default, &strLen);
+			if (!str || (expected[escape] && strcmp(str, expected[escape]))) {
+				retVal = 1;
+			}
+			if (expected[escape]) {
+				free(str);
+			} else {
+				expected[escape] = str;
+			}
+		}
+		
+		//A control character inside a long string is still an error
+		const char* badStr = "[\"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\t\"]";
+		json_parser_reset(parserState);
+		FILE* errorStream = parserState->errorStream;
+		json_parser_setopt(parserState, json_error_stream, NULL);
+		json_value* badVal = json_parser_parse(parserState, badStr, strlen(badStr));
+		json_parser_setopt(parserState, json_error_stream, errorStream);
+		
+		if (retVal || !topVal || badVal) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_cpu_level %d: output differs from json_cpu_scalar\n", level);
+			exit_failure(retVal);
+		}
+		json_visitor_free_all(parserState, topVal);
+	}
+	free(expected[0]);
+	free(expected[1]);
+	json_parser_setopt(parserState, json_cpu_level, detected);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static size_t reallocCount = 0;
+static void* test_realloc(void* ptr, size_t size) {
+	reallocCount += 1;
+	return realloc(ptr, size);
+}
+
+static int test_json_presize(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = (
+		"{"
+			"\"arr\": [1, [], {\"a\": \"[,,]\", \"b\": {}}, [2, 3], \"x,y\"],"
+			"\"empty\": [ ]"
+		"}"
+	);
+	const size_t jsonStrLen = strlen(jsonStr);
+	
+	retVal = json_parser_reset(parserState);
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_reset()\n");
+		exit_failure(retVal);
+	}
+	
+	json_value* topVal = json_parser_parse(parserState, jsonStr, jsonStrLen);
+	if (!topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with presized containers\n");
+		exit_failure(retVal);
+	}
+	
+	json_object* obj = topVal->value;
+	json_array* arr = obj->members[0].value->value;
+	json_object* obj2 = arr->values[2]->value;
+	json_array* arr2 = arr->values[3]->value;
+	json_array* arr3 = obj->members[1].value->value;
+	if (obj->capacity != 2 || arr->capacity != 5 || obj2->capacity != 2 || arr2->capacity != 2 || arr3->capacity != 0) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): containers not presized\n");
+		fprintf(stdout, "\tcapacities:\t%zu %zu %zu %zu %zu\n", obj->capacity, arr->capacity, obj2->capacity, arr2->capacity, arr3->capacity);
+		exit_failure(retVal);
+	}
+	
+	retVal = json_visitor_free_all(parserState, topVal);
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all()\n");
+		exit_failure(retVal);
+	}
+	
+	/* Without pre-scan, containers grow through the realloc hook */
+	retVal = json_parser_setopt(parserState, json_presize_containers, 0);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_realloc_function, test_realloc);
+	}
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt()\n");
+		exit_failure(retVal);
+	}
+	
+	const char* jsonStr2 = "[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20]";
+	json_parser_reset(parserState);
+	topVal = json_parser_parse(parserState, jsonStr2, strlen(jsonStr2));
+	if (!topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() without presized containers\n");
+		exit_failure(retVal);
+	}
+	arr = topVal->value;
+	if (arr->size != 20 || arr->capacity < 20 || reallocCount < 2) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): containers not grown with realloc hook\n");
+		fprintf(stdout, "\tarr size:\t%zu\tcapacity:\t%zu\treallocs:\t%zu\n", arr->size, arr->capacity, reallocCount);
+		exit_failure(retVal);
+	}
+	
+	retVal = json_visitor_free_all(parserState, topVal);
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all()\n");
+		exit_failure(retVal);
+	}
+	
+	json_parser_setopt(parserState, json_presize_containers, 1);
+	json_parser_setopt(parserState, json_realloc_function, realloc);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_packed_arrays(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "{\"coords\": [[1.5, -2], [3, 4e2]], \"mixed\": [1, 2, \"three\", 4]}";
+	const size_t jsonStrLen = strlen(jsonStr);
+	
+	retVal = json_parser_reset(parserState);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_pack_number_arrays, 1);
+	}
+	if (retVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt()\n");
+		exit_failure(retVal);
+	}
+	
+	json_value* topVal = json_parser_parse(parserState, jsonStr, jsonStrLen);
+	if (!topVal) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with packed arrays\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
-	num = NULL;
 	
-	query = "/obj/arr/1";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	if (!val) {
+	json_object* obj = topVal->value;
+	json_array* coords = obj->members[0].value->value;
+	json_array* mixed = obj->members[1].value->value;
+	size_t numbersLen = 0;
+	const double* numbers = json_array_get_numbers(coords->values[1]->value, &numbersLen);
+	if (json_array_get_numbers(coords, NULL) || !numbers || numbersLen != 2 || numbers[0] != 3.0 || numbers[1] != 400.0) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (2)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): array of numbers not packed\n");
 		exit_failure(retVal);
-	} else if (val->valueType != number_value) {
+	} else if (json_array_get_numbers(mixed, NULL) || mixed->size != 4 || mixed->values[3]->valueType != number_value) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (2)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): mixed array parsed incorrectly\n");
 		exit_failure(retVal);
 	}
-	num = val->value;
-	if (num->value != 2.0) {
+	
+	const char* jsonPlain = "{\"coords\":[[1.5,-2],[3,400]],\"mixed\":[1,2,\"three\",4]}";
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, 0, &stringifyLen);
+	if (!stringify || strcmp(jsonPlain, stringify)) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (2)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify() with packed arrays: unexpected output\n");
+		fprintf(stdout, "expected:\n%s\n\nhave:\n%s", jsonPlain, stringify);
 		exit_failure(retVal);
 	}
-	val = NULL;
-	num = NULL;
+	free(stringify);
 	
-	query = "/obj/arr/2";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	if (!val) {
+	const char* query = "/coords/0/1";
+	json_value* val = json_value_query(parserState, topVal, query, strlen(query));
+	if (!val || val->valueType != number_value || ((json_number*) val->value)->value != -2.0) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (3)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query() on packed array\n");
 		exit_failure(retVal);
-	} else if (val->valueType != number_value) {
+	}
+	
+	query = "/coords/1/9";
+	val = json_value_query(parserState, topVal, query, strlen(query));
+	numbers = json_array_get_numbers(coords->values[0]->value, &numbersLen);
+	if (val || !numbers || numbersLen != 2 || !json_array_get_numbers(coords->values[1]->value, NULL)) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (3)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query() unpacked a packed array\n");
 		exit_failure(retVal);
 	}
-	num = val->value;
-	if (num->value != 3.0) {
+	
+	retVal = json_visitor_free_all(parserState, topVal);
+	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (3)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all() with packed arrays\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
-	num = NULL;
 	
-	query = "/obj/str";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	if (val) {
+	json_parser_setopt(parserState, json_pack_number_arrays, 0);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_object_shapes(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr = "[{\"id\": 1, \"name\": \"a\"}, {\"id\": 2, \"name\": \"b\"}, {\"name\": \"c\", \"id\": 3}]";
+	const size_t jsonStrLen = strlen(jsonStr);
+	
+	retVal = json_parser_reset(parserState);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_share_object_shapes, 1);
+	}
+	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (4)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt()\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
 	
-	query = "/str";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	 if (!val) {
+	json_value* topVal = json_parser_parse(parserState, jsonStr, jsonStrLen);
+	if (!topVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (5)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with shared shapes\n");
 		exit_failure(retVal);
-	} else if (val->valueType != string_value) {
+	}
+	
+	json_array* arr = topVal->value;
+	json_object* obj1 = arr->values[0]->value;
+	json_object* obj2 = arr->values[1]->value;
+	json_object* obj3 = arr->values[2]->value;
+	if (!obj1->shape || obj1->shape != obj2->shape || obj1->members || obj1->shape->refCount != 2) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (5)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): objects with same names don't share shape\n");
+		exit_failure(retVal);
+	} else if (!obj3->shape || obj3->shape == obj1->shape) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): objects with different names share shape\n");
 		exit_failure(retVal);
 	}
-	json_string* str = val->value;
-	if (strncmp(str->value, "Some string here.", 17)) {
+	
+	const char* query = "/1/name";
+	json_value* val = json_value_query(parserState, topVal, query, strlen(query));
+	if (!val || val->valueType != string_value || strcmp(((json_string*) val->value)->value, "b")) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (5)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query() on shaped object\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
-	str = NULL;
 	
-	query = "/num";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	 if (!val) {
+	const char* jsonPlain = "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"},{\"name\":\"c\",\"id\":3}]";
+	size_t stringifyLen = 0;
+	char* stringify = json_value_stringify(parserState, topVal, NULL, 0, &stringifyLen);
+	if (!stringify || strcmp(jsonPlain, stringify)) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (6)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_stringify() with shaped objects: unexpected output\n");
+		fprintf(stdout, "expected:\n%s\n\nhave:\n%s", jsonPlain, stringify);
 		exit_failure(retVal);
-	} else if (val->valueType != number_value) {
+	}
+	free(stringify);
+	
+	retVal = json_object_unshape(parserState->JSON_Factory, obj2);
+	if (retVal || obj2->shape || !obj2->members || obj1->shape->refCount != 1 || strcmp(obj2->members[1].name->value, "name")) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (6)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_object_unshape()\n");
 		exit_failure(retVal);
 	}
-	num = val->value;
-	if (num->value != 3.1415926535897932) {
+	
+	retVal = json_visitor_free_all(parserState, topVal);
+	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (6)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all() with shaped objects\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
-	num = NULL;
 	
-	query = "/tru";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	 if (!val) {
+	json_parser_setopt(parserState, json_share_object_shapes, 0);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_interned_names(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const char* jsonStr1 = "[{\"id\": 1, \"n\\u0061me\": \"a\\\\\"}, {\"id\": 2, \"name\": \"b\"}]";
+	const char* jsonStr2 = "{\"name\": \"c\", \"id\": 3}";
+	
+	retVal = json_parser_reset(parserState);
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_intern_names, 1);
+	}
+	if (!retVal) {
+		retVal = json_parser_setopt(parserState, json_persist_interned_names, 1);
+	}
+	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (7)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_setopt()\n");
 		exit_failure(retVal);
-	} else if (val->valueType != true_value) {
+	}
+	
+	json_value* topVal1 = json_parser_parse(parserState, jsonStr1, strlen(jsonStr1));
+	if (!topVal1) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (7)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with interned names\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
 	
-	query = "/fals";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	 if (!val) {
+	json_array* arr = topVal1->value;
+	json_object* obj1 = arr->values[0]->value;
+	json_object* obj2 = arr->values[1]->value;
+	if (
+		obj1->members[0].name != obj2->members[0].name
+		|| obj1->members[1].name != obj2->members[1].name
+		|| !(obj1->members[0].flags & json_member_interned_name)
+		|| strcmp(obj1->members[1].name->value, "name")
+		|| strcmp(((json_string*) obj1->members[1].value->value)->value, "a\\")
+	) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (8)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): equal names aren't shared\n");
 		exit_failure(retVal);
-	} else if (val->valueType != false_value) {
+	}
+	
+	json_parser_reset(parserState);
+	json_value* topVal2 = json_parser_parse(parserState, jsonStr2, strlen(jsonStr2));
+	if (!topVal2) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (8)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with persistent interned names\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
 	
-	query = "/nul";
-	queryLen = strlen(query);
-	val = json_value_query(parserState, topVal, query, queryLen);
-	 if (!val) {
+	json_object* obj3 = topVal2->value;
+	if (obj3->members[0].name != obj1->members[1].name || obj3->members[1].name != obj1->members[0].name) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (9)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): names aren't shared across parses\n");
 		exit_failure(retVal);
-	} else if (val->valueType != null_value) {
+	} else if (json_parser_find_name(parserState, "id", 2) != obj3->members[1].name || json_parser_find_name(parserState, "other", 5)) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (9)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_find_name()\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
 	
-	const char query2[] = {'/', 'b', 'a', 'd', '\0', 'w', 'o', 'l', 'f'};
-	queryLen = 9;
-	val = json_value_query(parserState, topVal, query2, queryLen);
-	 if (!val) {
+	retVal = json_visitor_free_all(parserState, topVal1);
+	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): error during query (10)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all() with interned names\n");
 		exit_failure(retVal);
-	} else if (val->valueType != number_value) {
+	}
+	
+	const char* query = "/name";
+	json_value* val = json_value_query(parserState, topVal2, query, strlen(query));
+	if (!val || val->valueType != string_value || strcmp(((json_string*) val->value)->value, "c")) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (10)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_value_query() with interned names\n");
 		exit_failure(retVal);
 	}
-	num = val->value;
-	if (num->value != 1.0) {
+	json_visitor_free_all(parserState, topVal2);
+	
+	/* Shapes of objects with interned names share the names */
+	json_parser_setopt(parserState, json_persist_interned_names, 0);
+	json_parser_setopt(parserState, json_share_object_shapes, 1);
+	json_parser_reset(parserState);
+	topVal1 = json_parser_parse(parserState, jsonStr1, strlen(jsonStr1));
+	if (!topVal1) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_value_query(): query returned invalid (10)\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse() with interned names and shared shapes\n");
 		exit_failure(retVal);
 	}
-	val = NULL;
-	num = NULL;
 	
-	retVal = json_visitor_free_all(parserState, topVal);
+	arr = topVal1->value;
+	obj1 = arr->values[0]->value;
+	obj2 = arr->values[1]->value;
+	retVal = json_object_unshape(parserState->JSON_Factory, obj2);
+	if (
+		retVal || !obj1->shape
+		|| obj2->members[0].name != obj1->shape->names[0]
+		|| !(obj2->members[0].flags & json_member_interned_name)
+		|| json_parser_find_name(parserState, "id", 2)
+	) {
+		retVal = 1;
+		fprintf(stdout, "%s", "FAIL:\tjson_object_unshape() with interned names\n");
+		exit_failure(retVal);
+	}
+	
+	retVal = json_visitor_free_all(parserState, topVal1);
 	if (retVal) {
 		retVal = 1;
-		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all()\n");
+		fprintf(stdout, "%s", "FAIL:\tjson_visitor_free_all() with interned names and shared shapes\n");
 		exit_failure(retVal);
 	}
 	
+	json_parser_setopt(parserState, json_share_object_shapes, 0);
+	json_parser_setopt(parserState, json_intern_names, 0);
+	
+	retVal = 0;
+	return retVal;
+}
+
+static int test_json_number_format(json_parser_state* parserState) {
+	int retVal = 1;
+	
+	const double nums[] = {
+		0.0, -0.0, 1.0, -42.0, 0.1, 0.30000000000000004, 1e21, 1.5e-7, 0.000001,
+		123456789012345680000.0, 9007199254740993.0, 5e-324, 1.7976931348623157e308
+	};
+	const char* strs[] = {
+		"0", "-0", "1", "-42", "0.1", "0.30000000000000004", "1e+21", "1.5e-7", "0.000001",
+		"123456789012345680000", "9007199254740992", "5e-324", "1.7976931348623157e+308"
+	};
+	char buff[JSON_NUMBER_STRING_MAX];
+	
+	for (size_t k = 0, n = sizeof(nums) / sizeof(nums[0]); k < n; k += 1) {
+		size_t len = json_utils_format_number(nums[k], buff);
+		if (len != strlen(strs[k]) || strcmp(buff, strs[k])) {
+			retVal = 1;
+			fprintf(stdout, "%s", "FAIL:\tjson_utils_format_number(): unexpected output\n");
+			fprintf(stdout, "expected:\n%s\n\nhave:\n%s\n", strs[k], buff);
+			exit_failure(retVal);
+		}
+		
+		json_parser_reset(parserState);
+		json_value* val = json_parser_parse(parserState, buff, len);
+		if (!val || val->valueType != number_value || memcmp(&((json_number*) val->value)->value, &nums[k], sizeof(double))) {
+			retVal = 1;
+			fprintf(stdout, "FAIL:\tjson_utils_format_number(): %s doesn't round-trip\n", buff);
+			exit_failure(retVal);
+		}
+		json_visitor_free_all(parserState, val);
+	}
+	
 	retVal = 0;
 	return retVal;
 }
@@ -572,33 +2110,33 @@ int main(int argc, char** argv) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object parsed incorrectly\n");
 		exit_failure(retVal);
-	} else if (obj->names[0]->valueLen != 3 || strncmp(obj->names[0]->value, "obj", 3)) {
+	} else if (obj->members[0].name->valueLen != 3 || strncmp(obj->members[0].name->value, "obj", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
-	} else if (obj->names[1]->valueLen != 3 || strncmp(obj->names[1]->value, "str", 3)) {
+	} else if (obj->members[1].name->valueLen != 3 || strncmp(obj->members[1].name->value, "str", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
-	} else if (obj->names[2]->valueLen != 3 || strncmp(obj->names[2]->value, "num", 3)) {
+	} else if (obj->members[2].name->valueLen != 3 || strncmp(obj->members[2].name->value, "num", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
-	} else if (obj->names[3]->valueLen != 3 || strncmp(obj->names[3]->value, "tru", 3)) {
+	} else if (obj->members[3].name->valueLen != 3 || strncmp(obj->members[3].name->value, "tru", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
-	} else if (obj->names[4]->valueLen != 4 || strncmp(obj->names[4]->value, "fals", 3)) {
+	} else if (obj->members[4].name->valueLen != 4 || strncmp(obj->members[4].name->value, "fals", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
-	} else if (obj->names[5]->valueLen != 3 || strncmp(obj->names[5]->value, "nul", 3)) {
+	} else if (obj->members[5].name->valueLen != 3 || strncmp(obj->members[5].name->value, "nul", 3)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): top object names incorrect\n");
 		exit_failure(retVal);
 	}
-	json_object* obj2 = obj->values[0]->value;
-	if (obj->values[0]->valueType != object_value) {
+	json_object* obj2 = obj->members[0].value->value;
+	if (obj->members[0].value->valueType != object_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): nested object parsed incorrectly\n");
 		exit_failure(retVal);
@@ -607,8 +2145,8 @@ int main(int argc, char** argv) {
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): nested object parsed incorrectly\n");
 		exit_failure(retVal);
 	}
-	json_array* arr = obj2->values[0]->value;
-	if (obj2->names[0]->valueLen != 3 || strncmp(obj2->names[0]->value, "arr", 3) || obj2->values[0]->valueType != array_value) {
+	json_array* arr = obj2->members[0].value->value;
+	if (obj2->members[0].name->valueLen != 3 || strncmp(obj2->members[0].name->value, "arr", 3) || obj2->members[0].value->valueType != array_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): nested object parsed incorrectly\n");
 		exit_failure(retVal);
@@ -617,23 +2155,23 @@ int main(int argc, char** argv) {
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): array parsed incorrectly\n");
 		exit_failure(retVal);
 	}
-	if (obj->values[1]->valueType != string_value) {
+	if (obj->members[1].value->valueType != string_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): string parsed incorrectly\n");
 		exit_failure(retVal);
-	} else if (obj->values[2]->valueType != number_value) {
+	} else if (obj->members[2].value->valueType != number_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): number parsed incorrectly\n");
 		exit_failure(retVal);
-	} else if (obj->values[3]->valueType != true_value) {
+	} else if (obj->members[3].value->valueType != true_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): true parsed incorrectly\n");
 		exit_failure(retVal);
-	} else if (obj->values[4]->valueType != false_value) {
+	} else if (obj->members[4].value->valueType != false_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): false parsed incorrectly\n");
 		exit_failure(retVal);
-	} else if (obj->values[5]->valueType != null_value) {
+	} else if (obj->members[5].value->valueType != null_value) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): null parsed incorrectly\n");
 		exit_failure(retVal);
@@ -720,9 +2258,9 @@ int main(int argc, char** argv) {
 	}
 	arr = NULL;
 	for (size_t k = 0; k < obj->size; k += 1) {
-		json_string* name = obj->names[k];
+		json_string* name = obj->members[k].name;
 		if (!memcmp(name->value, "arr", 3)) {
-			arr = obj->values[k]->value;
+			arr = obj->members[k].value->value;
 			break;
 		}
 	}
@@ -762,7 +2300,7 @@ int main(int argc, char** argv) {
 	
 	/* Test handling escaped control chars in strings */
 	const char* jsonStr3 = "{\"bad\\u0000wolf\": 1}";
-	const size_t jsonStr3Len = strlen(jsonStr2);
+	const size_t jsonStr3Len = strlen(jsonStr3);
 	retVal = json_parser_reset(parserState);
 	if (retVal) {
 		retVal = 1;
@@ -785,11 +2323,11 @@ int main(int argc, char** argv) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): handle control chars in strings (1)\n");
 		exit_failure(retVal);
-	} else if (obj3->names[0]->valueLen != 8 || memcmp(obj3->names[0]->value, "bad\000wolf", 8)) {
+	} else if (obj3->members[0].name->valueLen != 8 || memcmp(obj3->members[0].name->value, "bad\000wolf", 8)) {
 		retVal = 1;
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_parse(): handle control chars in strings (2)\n");
-		fprintf(stdout, "\tstr len:\t%zu\n", obj3->names[0]->valueLen);
-		fprintf(stdout, "\tstr:\t%s\n", obj3->names[0]->value);
+		fprintf(stdout, "\tstr len:\t%zu\n", obj3->members[0].name->valueLen);
+		fprintf(stdout, "\tstr:\t%s\n", obj3->members[0].name->value);
 		exit_failure(retVal);
 	}
 	retVal = json_visitor_free_all(parserState, topVal);
@@ -854,6 +2392,126 @@ int main(int argc, char** argv) {
 		return retVal;
 	}
 	
+	/* Test escaping and indenting in stringify */
+	retVal = test_json_stringify_escapes(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test stringify to sinks */
+	retVal = test_json_stringify_sink(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test stringify into caller buffers */
+	retVal = test_json_stringify_into(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test stringify into iovecs */
+	retVal = test_json_stringify_iov(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test canonical stringify */
+	retVal = test_json_stringify_canonical(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test the streaming writer */
+	retVal = test_json_writer(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test minify and reformat */
+	retVal = test_json_minify_reformat(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test source span passthrough */
+	retVal = test_json_source_spans(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test memory accounting */
+	retVal = test_json_memory_usage(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test allocation counters */
+	retVal = test_json_stats(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test phase timers */
+	retVal = test_json_phase_stats(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test allocators carrying a context */
+	retVal = test_json_allocator_ctx(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test free lists of nodes */
+	retVal = test_json_node_pools(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test inline and replaced factory functions */
+	retVal = test_json_factory_override(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test the byte scanning kernels of each CPU level */
+	retVal = test_json_cpu_levels(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test container pre-sizing and realloc hook */
+	retVal = test_json_presize(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test packed arrays of numbers */
+	retVal = test_json_packed_arrays(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test objects sharing shapes */
+	retVal = test_json_object_shapes(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test interned object names */
+	retVal = test_json_interned_names(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
+	/* Test shortest round-trip number formatting */
+	retVal = test_json_number_format(parserState);
+	if (retVal) {
+		return retVal;
+	}
+	
 	retVal = json_parser_clear(parserState);
 	if (retVal) {
 		fprintf(stdout, "%s", "FAIL:\tjson_parser_clear()\n");